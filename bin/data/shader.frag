@@ -14,17 +14,23 @@ uniform vec3 ambientColor;
 
 uniform int isWater;
 
+// Props (see shader.vert) are drawn in a single color each.
+uniform int useInstances;
+uniform vec3 propColor;
+
 void main()
 {
 	// Color based on normals.
 	//vec3 meshColor = fragNormal * 0.5 + 0.5;
-	vec3 meshColor = vec3(90.0/256.0, 130.0/256.0, 30.0/256.0);
+	vec3 meshColor = useInstances == 1 ? propColor : vec3(90.0/256.0, 130.0/256.0, 30.0/256.0);
 	
 	// Lighting.
+	// Terrain cells bake how much of the sky each vertex can see into the length of its normal; other meshes have unit normals.
+	float skyVisibility = min(length(fragNormal), 1.0);
 	vec3 normal = normalize(fragNormal);
 	float nDotL = max(0, dot(normal, lightDirection));
-	// Surface lighting.
-	vec3 irradiance = ambientColor + lightColor * nDotL;
+	// Surface lighting; hollows get less of the sky's ambient light, and are partly shadowed from the sun too.
+	vec3 irradiance = ambientColor * skyVisibility + lightColor * nDotL * mix(0.5, 1.0, skyVisibility);
 	// Surface reflection.
 	vec3 linearColor = meshColor * irradiance;
 
@@ -8,13 +8,89 @@ uniform vec3 cameraPosition;
 uniform mat4 m; // Model transform.
 uniform mat4 mvp; // Movel-view-projection transform.
 
+// Height tile rendering (CellRenderMode::HeightTexture).
+// When enabled, "position" is a point on the shared grid patch and the height comes from the cell's tile.
+uniform int useHeightTiles;
+uniform sampler2DArray heightTiles;
+uniform float heightmapScale;
+uniform vec2 heightmapSize;
+uniform vec4 cellInstances[64]; // Start x, start z, texture array layer, unused.
+
+// Instanced props (CellManager::drawProps()).
+// When enabled, "position" is a point on the prop's unit-high mesh, and "instance" places and sizes the prop.
+layout (location = 5) in vec4 instance; // x, y, z and scale, in the space of the cell meshes.
+uniform int useInstances;
+uniform vec2 propFade; // Props are all drawn out to x, thin out beyond it, and are all gone by y.
+
 out vec3 fragNormal;
 out float distanceFromCamera;
 
+float tileHeight(ivec2 texel, int layer)
+{
+	texel = clamp(texel, ivec2(0), textureSize(heightTiles, 0).xy - 1);
+	return texelFetch(heightTiles, ivec3(texel, layer), 0).r * heightmapScale;
+}
+
+// Hashes a position (to the nearest hundredth of a pixel), so each prop gets the same turn and rank every frame.
+uint hashPosition(vec2 p)
+{
+	uvec2 q = uvec2(ivec2(p * 100.0));
+	uint h = q.x * 1664525u + q.y * 1013904223u;
+	h ^= h >> 16;
+	h *= 0x7feb352du;
+	h ^= h >> 15;
+	h *= 0x846ca68bu;
+	h ^= h >> 16;
+	return h;
+}
+
 void main()
 {
-	gl_Position = mvp * vec4(position, 1.0);
-	fragNormal = normal;
+	vec3 objectPosition = position;
+	vec3 objectNormal = normal;
+
+	if (useHeightTiles == 1)
+	{
+		vec4 cell = cellInstances[gl_InstanceID];
+		int layer = int(cell.z);
+
+		// Collapse vertices beyond the edge of the heightmap onto the edge.
+		vec2 gridPosition = min(cell.xy + position.xz, heightmapSize - 1.0) - cell.xy;
+
+		// Tiles have a one-texel border so that the normals match across cell edges.
+		ivec2 texel = ivec2(gridPosition) + 1;
+
+		objectPosition = vec3(cell.x + gridPosition.x, tileHeight(texel, layer), cell.y + gridPosition.y);
+
+		// Smooth normals from central differences.
+		float left = tileHeight(texel - ivec2(1, 0), layer);
+		float right = tileHeight(texel + ivec2(1, 0), layer);
+		float back = tileHeight(texel - ivec2(0, 1), layer);
+		float front = tileHeight(texel + ivec2(0, 1), layer);
+		objectNormal = normalize(vec3(left - right, 2.0, back - front));
+	}
+	else if (useInstances == 1)
+	{
+		uint hash = hashPosition(instance.xz);
+		float angle = float(hash & 0xFFFFu) / 65536.0 * 6.2831853;
+		float rank = float(hash >> 16) / 65536.0;
+
+		// Thin the props out with distance; the ones ranked above the density shrink to a point, so they have no area to draw.
+		float instanceDistance = length((m * vec4(instance.xyz, 1.0)).xyz - cameraPosition);
+		float density = 1.0 - smoothstep(propFade.x, propFade.y, instanceDistance);
+		float scale = rank < density ? instance.w : 0.0;
+
+		mat2 rotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+		vec2 turnedPosition = rotation * position.xz;
+		vec2 turnedNormal = rotation * normal.xz;
+
+		// Undo the model transform's vertical scale so that props keep their shape in the world.
+		objectPosition = instance.xyz + vec3(turnedPosition.x, position.y / m[1][1], turnedPosition.y) * scale;
+		objectNormal = vec3(turnedNormal.x, normal.y, turnedNormal.y);
+	}
+
+	gl_Position = mvp * vec4(objectPosition, 1.0);
+	fragNormal = objectNormal;
 
-	distanceFromCamera = abs(length((m * vec4(position, 1.0)).xyz - cameraPosition));
-}
\ No newline at end of file
+	distanceFromCamera = abs(length((m * vec4(objectPosition, 1.0)).xyz - cameraPosition));
+}
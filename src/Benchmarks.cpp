@@ -0,0 +1,433 @@
+#include "Benchmarks.h"
+#include "buildTerrainMesh.h"
+#include "CharacterCrowd.h"
+#include "HeightmapPyramid.h"
+#include "NoiseHeightSource.h"
+#include "Pathfinder.h"
+#include "Simulation.h"
+#include "TaskScheduler.h"
+#include "TerrainOcclusion.h"
+#include <chrono>
+#include <random>
+
+namespace
+{
+    // Runs a function several times and returns the average time taken in milliseconds.
+    template<typename Function>
+    double timeAverageMilliseconds(unsigned int repetitions, Function function)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        for (unsigned int i = 0; i < repetitions; i++)
+        {
+            function();
+        }
+
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() / repetitions;
+    }
+}
+
+void runTerrainMeshBenchmark(const ofShortPixels& heightmap, unsigned int cellSize)
+{
+    const unsigned int repetitions = 4;
+
+    struct Configuration
+    {
+        const char* name;
+        TerrainMeshOptions options;
+    };
+
+    TerrainMeshOptions flatColumns {};
+    TerrainMeshOptions smoothColumns {};
+    smoothColumns.smoothNormals = true;
+    TerrainMeshOptions smoothBlocks {};
+    smoothBlocks.smoothNormals = true;
+    smoothBlocks.indexOrder = TerrainIndexOrder::Blocks;
+
+    Configuration configurations[]
+    {
+        { "flat normals, columns", flatColumns },
+        { "smooth normals, columns", smoothColumns },
+        { "smooth normals, blocks", smoothBlocks },
+    };
+
+    // Use a cell from the middle of the heightmap, clamped the same way CellManager clamps cells.
+    unsigned int xStart = heightmap.getWidth() / 2;
+    unsigned int yStart = heightmap.getHeight() / 2;
+    unsigned int xEnd = std::min<unsigned int>(xStart + cellSize, heightmap.getWidth() - 1);
+    unsigned int yEnd = std::min<unsigned int>(yStart + cellSize, heightmap.getHeight() - 1);
+
+    ofLogNotice("Benchmarks") << "Terrain mesh, " << (xEnd - xStart) << " x " << (yEnd - yStart) << " quads:";
+
+    for (const Configuration& configuration : configurations)
+    {
+        ofMesh mesh {};
+        double milliseconds = timeAverageMilliseconds(repetitions, [&] ()
+        {
+            mesh.clear();
+            buildTerrainMesh(mesh, heightmap, xStart, yStart, xEnd, yEnd, glm::vec3(1), configuration.options);
+        });
+
+        ofLogNotice("Benchmarks") << "  " << configuration.name << ": " << milliseconds << " ms to build, "
+            << mesh.getNumVertices() << " vertices, "
+            << "ACMR " << calculateACMR(mesh.getIndices(), 16) << " (16-entry cache) / "
+            << calculateACMR(mesh.getIndices(), 32) << " (32-entry cache)";
+    }
+}
+
+void runNoiseBenchmark(const NoiseHeightSource& noise, unsigned int cellSize)
+{
+    const unsigned int repetitions = 8;
+
+    // The same tile size CellManager samples: the cell plus a border on each side.
+    glm::ivec2 tileSize { static_cast<int>(cellSize) + 3 };
+    std::vector<unsigned short> simdHeights(tileSize.x * tileSize.y);
+    std::vector<unsigned short> scalarHeights(tileSize.x * tileSize.y);
+
+    // Move the tile each repetition, including to negative coordinates.
+    unsigned int tile = 0;
+    auto nextStart = [&] ()
+    {
+        tile++;
+        return glm::ivec2(static_cast<int>(tile * cellSize) - 4096, static_cast<int>(tile * cellSize / 2));
+    };
+
+    double simdMilliseconds = timeAverageMilliseconds(repetitions, [&] ()
+    {
+        noise.sampleHeights(nextStart(), tileSize, simdHeights.data());
+    });
+
+    tile = 0;
+    double scalarMilliseconds = timeAverageMilliseconds(repetitions, [&] ()
+    {
+        noise.sampleHeightsScalar(nextStart(), tileSize, scalarHeights.data());
+    });
+
+    // Both paths should agree exactly; the last tile generated by each is the same.
+    size_t mismatches = 0;
+    for (size_t i = 0; i < simdHeights.size(); i++)
+    {
+        if (simdHeights[i] != scalarHeights[i])
+        {
+            mismatches++;
+        }
+    }
+
+    ofLogNotice("Benchmarks") << "Noise terrain, " << tileSize.x << " x " << tileSize.y << " samples per cell, "
+        << noise.octaves << " octaves:";
+    ofLogNotice("Benchmarks") << "  vectorized: " << simdMilliseconds << " ms per cell, " << 1000 / simdMilliseconds << " cells/s";
+    ofLogNotice("Benchmarks") << "  scalar: " << scalarMilliseconds << " ms per cell, " << 1000 / scalarMilliseconds << " cells/s";
+    ofLogNotice("Benchmarks") << "  speedup " << scalarMilliseconds / simdMilliseconds << "x, " << mismatches << " mismatched samples";
+}
+
+void runTaskSchedulerBenchmark(const ofShortPixels& heightmap, unsigned int cellSize)
+{
+    const unsigned int repetitions = 2;
+    TaskScheduler& scheduler = TaskScheduler::getShared();
+    unsigned int maxThreads = scheduler.getWorkerCount() + 1;
+
+    // A 4 x 4 block of cells from the middle of the heightmap, the same as the cells CellManager builds when it starts up.
+    const unsigned int cellsPerSide = 4;
+    unsigned int xFirst = heightmap.getWidth() / 2 - cellsPerSide / 2 * cellSize;
+    unsigned int yFirst = heightmap.getHeight() / 2 - cellsPerSide / 2 * cellSize;
+    std::vector<ofMesh> meshes(cellsPerSide * cellsPerSide);
+
+    TerrainMeshOptions options {};
+    options.smoothNormals = true;
+
+    HeightmapPyramid pyramid {};
+
+    ofLogNotice("Benchmarks") << "Task scheduler, " << scheduler.getWorkerCount() << " workers, "
+        << meshes.size() << " cell meshes of " << cellSize << " x " << cellSize << " quads:";
+
+    double singleThreadMeshMilliseconds = 0;
+    double singleThreadPyramidMilliseconds = 0;
+
+    for (unsigned int threads = 1; ; threads = std::min(threads * 2, maxThreads))
+    {
+        uint64_t stolenBefore = scheduler.getTasksStolen();
+
+        double meshMilliseconds = timeAverageMilliseconds(repetitions, [&] ()
+        {
+            scheduler.parallelFor(meshes.size(), [&] (size_t i)
+            {
+                unsigned int xStart = std::min<unsigned int>(xFirst + i % cellsPerSide * cellSize, heightmap.getWidth() - 1);
+                unsigned int yStart = std::min<unsigned int>(yFirst + i / cellsPerSide * cellSize, heightmap.getHeight() - 1);
+                unsigned int xEnd = std::min<unsigned int>(xStart + cellSize, heightmap.getWidth() - 1);
+                unsigned int yEnd = std::min<unsigned int>(yStart + cellSize, heightmap.getHeight() - 1);
+
+                meshes[i].clear();
+                buildTerrainMesh(meshes[i], heightmap, xStart, yStart, xEnd, yEnd, glm::vec3(1), options);
+            }, threads);
+        });
+
+        double pyramidMilliseconds = timeAverageMilliseconds(repetitions, [&] ()
+        {
+            pyramid.build(heightmap, threads);
+        });
+
+        if (threads == 1)
+        {
+            singleThreadMeshMilliseconds = meshMilliseconds;
+            singleThreadPyramidMilliseconds = pyramidMilliseconds;
+        }
+
+        ofLogNotice("Benchmarks") << "  " << threads << (threads == 1 ? " thread: " : " threads: ")
+            << "meshes " << meshMilliseconds << " ms (" << singleThreadMeshMilliseconds / meshMilliseconds << "x), "
+            << "pyramid " << pyramidMilliseconds << " ms (" << singleThreadPyramidMilliseconds / pyramidMilliseconds << "x), "
+            << (scheduler.getTasksStolen() - stolenBefore) << " tasks stolen";
+
+        if (threads == maxThreads)
+        {
+            break;
+        }
+    }
+}
+
+void runSimulationBenchmark(const World& world)
+{
+    const unsigned int ticks = 100000;
+    const float dt = 1.0f / 120;
+
+    ofLogNotice("Benchmarks") << "Simulation, " << ticks << " ticks of " << dt * 1000 << " ms:";
+
+    for (bool walking : { true, false })
+    {
+        Simulation simulation { world, glm::vec3(world.dimensions.x / 2, world.dimensions.y, world.dimensions.z / 2) };
+        SimulationInput input {};
+        input.walking = walking;
+        input.movement = glm::vec3(0, 0, 1);
+
+        double milliseconds = timeAverageMilliseconds(1, [&] ()
+        {
+            for (unsigned int i = 0; i < ticks; i++)
+            {
+                // Turn slowly and jump now and then, so that the path crosses plenty of terrain.
+                float angle = i * dt * 0.5f;
+                input.front = glm::vec3(std::cos(angle), 0, std::sin(angle));
+                input.jumpCount = i / 240;
+                simulation.step(input, dt);
+            }
+        });
+
+        ofLogNotice("Benchmarks") << "  " << (walking ? "walking: " : "flying: ") << ticks / milliseconds * 1000 << " ticks/s, "
+            << milliseconds * 1000 / ticks << " us per tick";
+    }
+}
+
+void runOcclusionBenchmark(const HeightSource& heightSource, unsigned int cellSize, float heightScale)
+{
+    const unsigned int repetitions = 8;
+    glm::ivec2 size { static_cast<int>(cellSize) };
+    float sampleScale = heightScale / USHRT_MAX;
+
+    // A cell from the middle of the source, with the border the bake needs.
+    glm::ivec2 start { heightSource.getSize() / 2 };
+    glm::ivec2 bordered { size + 1 + 2 * static_cast<int>(TerrainOcclusion::RADIUS) };
+    std::vector<unsigned short> heights(bordered.x * bordered.y);
+    heightSource.sampleHeights(start - static_cast<int>(TerrainOcclusion::RADIUS), bordered, heights.data());
+
+    std::vector<float> simdVisibility {};
+    std::vector<float> scalarVisibility {};
+    std::vector<float> cellVisibility {};
+
+    double simdMilliseconds = timeAverageMilliseconds(repetitions, [&] ()
+    {
+        TerrainOcclusion::bakeFromHeights(heights.data(), size, sampleScale, simdVisibility);
+    });
+
+    double scalarMilliseconds = timeAverageMilliseconds(repetitions, [&] ()
+    {
+        TerrainOcclusion::bakeFromHeightsScalar(heights.data(), size, sampleScale, scalarVisibility);
+    });
+
+    // What a cell actually pays, sampling included.
+    double cellMilliseconds = timeAverageMilliseconds(repetitions, [&] ()
+    {
+        TerrainOcclusion::bake(heightSource, start, size, sampleScale, cellVisibility);
+    });
+
+    float maxDifference = 0;
+    double totalVisibility = 0;
+    for (size_t i = 0; i < simdVisibility.size(); i++)
+    {
+        maxDifference = std::max(maxDifference, std::abs(simdVisibility[i] - scalarVisibility[i]));
+        totalVisibility += simdVisibility[i];
+    }
+
+    ofLogNotice("Benchmarks") << "Ambient occlusion bake, " << (cellSize + 1) << " x " << (cellSize + 1) << " pixels per cell:";
+    ofLogNotice("Benchmarks") << "  vectorized: " << simdMilliseconds << " ms per cell";
+    ofLogNotice("Benchmarks") << "  scalar: " << scalarMilliseconds << " ms per cell";
+    ofLogNotice("Benchmarks") << "  with sampling: " << cellMilliseconds << " ms per cell, " << 1000 / cellMilliseconds << " cells/s";
+    ofLogNotice("Benchmarks") << "  speedup " << scalarMilliseconds / simdMilliseconds << "x, max difference " << maxDifference
+        << ", average visibility " << totalVisibility / simdVisibility.size();
+}
+
+void runCellSizeSpecializationBenchmark(const ofShortPixels& heightmap)
+{
+    const unsigned int repetitions = 8;
+    const unsigned int cellSize = 256;
+
+    // A tile from the middle of the heightmap with CellManager's one-sample border.
+    ofShortPixels tile {};
+    tile.allocate(cellSize + 3, cellSize + 3, 1);
+    HeightmapHeightSource source { heightmap };
+    glm::ivec2 start { static_cast<int>(heightmap.getWidth() / 2), static_cast<int>(heightmap.getHeight() / 2) };
+    source.sampleHeights(start - 1, glm::ivec2(cellSize + 3), tile.getData());
+
+    TerrainMeshOptions options {};
+    options.smoothNormals = true;
+    options.indexOrder = TerrainIndexOrder::Blocks;
+    glm::vec3 scale { 1, 1600, 1 };
+    glm::vec3 offset { start.x - 1, 0, start.y - 1 };
+
+    ofMesh runtimeMesh {};
+    double runtimeMilliseconds = timeAverageMilliseconds(repetitions, [&] ()
+    {
+        runtimeMesh.clear();
+        buildTerrainMesh(runtimeMesh, tile, 1, 1, 1 + cellSize, 1 + cellSize, scale, options);
+
+        for (glm::vec3& vertex : runtimeMesh.getVertices())
+        {
+            vertex += offset;
+        }
+    });
+
+    ofMesh fixedMesh {};
+    double fixedMilliseconds = timeAverageMilliseconds(repetitions, [&] ()
+    {
+        fixedMesh.clear();
+        buildTerrainCellMesh<cellSize>(fixedMesh, tile.getData(), scale, offset, options);
+    });
+
+    bool same = runtimeMesh.getVertices() == fixedMesh.getVertices() && runtimeMesh.getNormals() == fixedMesh.getNormals()
+        && runtimeMesh.getIndices() == fixedMesh.getIndices();
+
+    ofLogNotice("Benchmarks") << "Cell mesh, " << cellSize << " x " << cellSize << " quads, smooth normals:";
+    ofLogNotice("Benchmarks") << "  runtime cell size: " << runtimeMilliseconds << " ms";
+    ofLogNotice("Benchmarks") << "  compile-time cell size: " << fixedMilliseconds << " ms";
+    ofLogNotice("Benchmarks") << "  speedup " << runtimeMilliseconds / fixedMilliseconds << "x, meshes " << (same ? "match" : "DIFFER");
+}
+
+void runCrowdBenchmark(const World& world, unsigned int terrainCellSize)
+{
+    const unsigned int warmUpTicks = 2;
+    const unsigned int ticks = 10;
+    const float dt = 1.0f / 120;
+    const float radius = 1;
+    const float characterHeight = 4;
+    const double frameMilliseconds = 1000.0 / 60;
+    unsigned int maxThreads = TaskScheduler::getShared().getWorkerCount() + 1;
+
+    for (unsigned int characterCount : { 10000u, 100000u })
+    {
+        ofLogNotice("Benchmarks") << "Crowd, " << characterCount << " characters, " << ticks << " ticks of " << dt * 1000 << " ms:";
+
+        double singleThreadMilliseconds = 0;
+
+        for (unsigned int threads = 1; ; threads = std::min(threads * 2, maxThreads))
+        {
+            // The same crowd each time: about one character to every nine square units around the middle of the world,
+            // walking in random directions, so that plenty of them bump into each other.
+            CharacterCrowd crowd { world, radius, static_cast<float>(terrainCellSize) };
+            std::mt19937 random { 1 };
+            std::uniform_real_distribution<float> unit { -1, 1 };
+            float halfWidth = std::sqrt(static_cast<float>(characterCount)) * 1.5f;
+
+            for (size_t i = 0; i < characterCount; i++)
+            {
+                glm::vec3 position { world.dimensions.x / 2 + unit(random) * halfWidth, 0, world.dimensions.z / 2 + unit(random) * halfWidth };
+                size_t index = crowd.addCharacter(position, characterHeight);
+                crowd.getCharacter(index).setDesiredVelocity(glm::vec3(unit(random), 0, unit(random)) * 4.0f);
+            }
+
+            for (unsigned int i = 0; i < warmUpTicks; i++)
+            {
+                crowd.update(dt, threads);
+            }
+
+            CrowdStats total {};
+            double milliseconds = timeAverageMilliseconds(ticks, [&] ()
+            {
+                crowd.update(dt, threads);
+
+                const CrowdStats& stats = crowd.getLastStats();
+                total.physicsMilliseconds += stats.physicsMilliseconds;
+                total.broadphaseMilliseconds += stats.broadphaseMilliseconds;
+                total.resolveMilliseconds += stats.resolveMilliseconds;
+                total.pairsTested += stats.pairsTested;
+                total.contacts += stats.contacts;
+            });
+
+            if (threads == 1)
+            {
+                singleThreadMilliseconds = milliseconds;
+            }
+
+            ofLogNotice("Benchmarks") << "  " << threads << (threads == 1 ? " thread: " : " threads: ")
+                << milliseconds << " ms per tick (" << milliseconds / frameMilliseconds * 100 << "% of a frame, "
+                << singleThreadMilliseconds / milliseconds << "x): physics " << total.physicsMilliseconds / ticks
+                << " ms, broadphase " << total.broadphaseMilliseconds / ticks << " ms, resolve " << total.resolveMilliseconds / ticks
+                << " ms, " << total.pairsTested / ticks << " pairs tested, " << total.contacts / ticks << " contacts";
+
+            if (threads == maxThreads)
+            {
+                break;
+            }
+        }
+    }
+}
+
+void runPathfinderBenchmark(const World& world, unsigned int clusterSize)
+{
+    const unsigned int queryCount = 256;
+    const unsigned int warmRepetitions = 4;
+
+    // The same queries each time, between random points anywhere on the map, so that most cross several clusters.
+    std::vector<PathQuery> queries(queryCount);
+    std::mt19937 random { 1 };
+    std::uniform_real_distribution<float> unit { 0, 1 };
+
+    for (PathQuery& query : queries)
+    {
+        query.start = glm::vec3(unit(random) * world.dimensions.x, 0, unit(random) * world.dimensions.z);
+        query.goal = glm::vec3(unit(random) * world.dimensions.x, 0, unit(random) * world.dimensions.z);
+    }
+
+    ofLogNotice("Benchmarks") << "Pathfinder, " << queryCount << " queries across the map, " << clusterSize << " pixel clusters:";
+
+    // A fresh pathfinder has only the transitions between clusters; each cluster's graph is built by the first query to reach it.
+    std::unique_ptr<Pathfinder> coldPathfinder {};
+    double transitionMilliseconds = timeAverageMilliseconds(1, [&] ()
+    {
+        coldPathfinder.reset(new Pathfinder { world, clusterSize });
+    });
+
+    size_t foundCount = 0;
+    double coldMilliseconds = timeAverageMilliseconds(1, [&] ()
+    {
+        for (const Path& path : coldPathfinder->findPaths(queries))
+        {
+            foundCount += path.found ? 1 : 0;
+        }
+    });
+
+    Pathfinder pathfinder { world, clusterSize };
+    double prebuildMilliseconds = timeAverageMilliseconds(1, [&] ()
+    {
+        pathfinder.buildClusterGraphs();
+    });
+
+    double warmMilliseconds = timeAverageMilliseconds(warmRepetitions, [&] ()
+    {
+        pathfinder.findPaths(queries);
+    });
+
+    ofLogNotice("Benchmarks") << "  transitions: " << transitionMilliseconds << " ms";
+    ofLogNotice("Benchmarks") << "  cold batch (graphs built on demand): " << coldMilliseconds << " ms, "
+        << foundCount << " of " << queryCount << " paths found";
+    ofLogNotice("Benchmarks") << "  prebuilding the cluster graphs: " << prebuildMilliseconds << " ms";
+    ofLogNotice("Benchmarks") << "  warm batch: " << warmMilliseconds << " ms (" << warmMilliseconds / queryCount << " ms per query, "
+        << coldMilliseconds / warmMilliseconds << "x faster than cold)";
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "ofMain.h"
+
+// Benchmarks for the terrain subsystems.  Results are written to the log.
+// These run on the calling thread and can take a few seconds, so they're meant to be triggered by hand.
+
+// Times building a cell mesh with each combination of normals and triangle order,
+// and reports the average cache miss ratio (ACMR) of each ordering.
+void runTerrainMeshBenchmark(const ofShortPixels& heightmap, unsigned int cellSize);
+
+class NoiseHeightSource;
+class HeightSource;
+
+// Times generating cell tiles of procedural terrain with and without SIMD, and reports cells per second for each.
+void runNoiseBenchmark(const NoiseHeightSource& noise, unsigned int cellSize);
+
+// Times building a batch of cell meshes and a HeightmapPyramid on the shared TaskScheduler with 1, 2, 4, ... threads
+// up to every worker plus the calling thread, and reports the speedup over one thread and how many tasks were stolen.
+void runTaskSchedulerBenchmark(const ofShortPixels& heightmap, unsigned int cellSize);
+
+struct World;
+
+// Times the camera simulation on its own, without a thread or any drawing, walking and flying across the terrain,
+// and reports ticks per second for each.
+void runSimulationBenchmark(const World& world);
+
+// Times baking the ambient occlusion of a cell (see TerrainOcclusion) with and without SIMD, and reports the bake time per cell
+// including sampling the heights.  "heightScale" is the height of the cell meshes, as passed to CellManager.
+void runOcclusionBenchmark(const HeightSource& heightSource, unsigned int cellSize, float heightScale);
+
+// Times building a 256 x 256 quad cell mesh the way CellManager does with a runtime cell size (buildTerrainMesh())
+// and with the size fixed at compile time (buildTerrainCellMesh<256>()), and checks that they give the same mesh.
+void runCellSizeSpecializationBenchmark(const ofShortPixels& heightmap);
+
+// Times updating crowds of 10,000 and 100,000 characters colliding with the terrain and each other (see CharacterCrowd)
+// with 1, 2, 4, ... threads, and reports the time per tick of each step against a 60 fps frame, the speedup over one thread,
+// and how many pairs the broadphase tested against how many were touching.  "terrainCellSize" is CellManager's cell size.
+void runCrowdBenchmark(const World& world, unsigned int terrainCellSize);
+
+// Times a batch of path queries between random points across the world (see Pathfinder), first on a fresh pathfinder
+// that builds each cluster's graph the first time a query reaches it, then after building every cluster's graph up front
+// on the shared TaskScheduler, and reports the time for the batch each way and for the prebuild.
+// "clusterSize" is the pathfinder's cluster size in heightmap pixels.
+void runPathfinderBenchmark(const World& world, unsigned int clusterSize);
@@ -0,0 +1,137 @@
+#include "CameraPath.h"
+#include <fstream>
+#include <sstream>
+
+void CameraPath::clear()
+{
+    keyframes.clear();
+}
+
+void CameraPath::addKeyframe(double time, glm::vec3 position, glm::vec3 front)
+{
+    keyframes.push_back({ time, position, front });
+}
+
+bool CameraPath::isEmpty() const
+{
+    return keyframes.empty();
+}
+
+double CameraPath::getDuration() const
+{
+    return keyframes.empty() ? 0 : keyframes.back().time;
+}
+
+CameraKeyframe CameraPath::sample(double time) const
+{
+    if (keyframes.empty())
+    {
+        return CameraKeyframe();
+    }
+
+    // Find the first keyframe after the time.
+    auto next = std::upper_bound(keyframes.begin(), keyframes.end(), time, [] (double time, const CameraKeyframe& keyframe)
+    {
+        return time < keyframe.time;
+    });
+
+    if (next == keyframes.begin())
+    {
+        return keyframes.front();
+    }
+    else if (next == keyframes.end())
+    {
+        return keyframes.back();
+    }
+
+    const CameraKeyframe& previous { *(next - 1) };
+    double span { next->time - previous.time };
+    float t { span > 0 ? static_cast<float>((time - previous.time) / span) : 1.0f };
+
+    CameraKeyframe result {};
+    result.time = time;
+    result.position = glm::mix(previous.position, next->position, t);
+    result.front = glm::normalize(glm::mix(previous.front, next->front, t));
+    return result;
+}
+
+bool CameraPath::save(const std::string& filePath) const
+{
+    std::ofstream file { filePath };
+    file << "# time positionX positionY positionZ frontX frontY frontZ\n";
+    file.precision(9);
+
+    for (const CameraKeyframe& keyframe : keyframes)
+    {
+        file << keyframe.time << ' '
+            << keyframe.position.x << ' ' << keyframe.position.y << ' ' << keyframe.position.z << ' '
+            << keyframe.front.x << ' ' << keyframe.front.y << ' ' << keyframe.front.z << '\n';
+    }
+
+    if (!file)
+    {
+        ofLogError("CameraPath") << "Couldn't write " << filePath << ".";
+        return false;
+    }
+
+    return true;
+}
+
+bool CameraPath::load(const std::string& filePath)
+{
+    std::ifstream file { filePath };
+    if (!file)
+    {
+        ofLogError("CameraPath") << "Couldn't open " << filePath << ".";
+        return false;
+    }
+
+    std::vector<CameraKeyframe> loaded {};
+    std::string line {};
+
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+
+        std::istringstream fields { line };
+        CameraKeyframe keyframe {};
+        fields >> keyframe.time
+            >> keyframe.position.x >> keyframe.position.y >> keyframe.position.z
+            >> keyframe.front.x >> keyframe.front.y >> keyframe.front.z;
+
+        if (!fields || (!loaded.empty() && keyframe.time < loaded.back().time))
+        {
+            ofLogError("CameraPath") << "Bad keyframe in " << filePath << ": " << line;
+            return false;
+        }
+
+        loaded.push_back(keyframe);
+    }
+
+    keyframes = std::move(loaded);
+    return true;
+}
+
+CameraPath CameraPath::makeSprintRoute(glm::vec3 center, float radius, float speed, unsigned int laps)
+{
+    // Enough keyframes per lap that linear interpolation stays close to the circle.
+    const unsigned int keyframesPerLap { 256 };
+
+    CameraPath path {};
+    double lapDuration { glm::two_pi<double>() * radius / speed };
+
+    for (unsigned int i { 0 }; i <= keyframesPerLap * laps; i++)
+    {
+        float angle { glm::two_pi<float>() * i / keyframesPerLap };
+        glm::vec3 position { center + glm::vec3(cos(angle), 0, sin(angle)) * radius };
+
+        // Face along the circle, looking slightly down at the terrain.
+        glm::vec3 front { glm::normalize(glm::vec3(-sin(angle), -0.2f, cos(angle))) };
+        path.addKeyframe(lapDuration * i / keyframesPerLap, position, front);
+    }
+
+    return path;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "ofMain.h"
+
+// A single sample of a camera path.
+struct CameraKeyframe
+{
+    // Seconds since the start of the path.
+    double time { 0 };
+
+    // The camera's position and view direction in world space.
+    glm::vec3 position {};
+    glm::vec3 front { 0, 0, -1 };
+};
+
+// A recorded or generated camera route that can be replayed on a fixed timestep,
+// so that performance runs on different builds follow exactly the same path.
+class CameraPath
+{
+public:
+    // Removes every keyframe.
+    void clear();
+
+    // Adds a keyframe; keyframes must be added in order of time.
+    void addKeyframe(double time, glm::vec3 position, glm::vec3 front);
+
+    bool isEmpty() const;
+
+    // The time of the last keyframe.
+    double getDuration() const;
+
+    // Gets the camera at a point in time, interpolating between keyframes and holding the ends.
+    CameraKeyframe sample(double time) const;
+
+    // Saves the path as text, one keyframe per line: time, position x y z, front x y z.
+    bool save(const std::string& filePath) const;
+
+    // Replaces the path with one loaded from a file written by save().
+    bool load(const std::string& filePath);
+
+    // Generates a stress route: laps of a circle around "center" at sprint speed, facing the direction of travel,
+    // so that the camera keeps crossing into cells that haven't been loaded yet.
+    static CameraPath makeSprintRoute(glm::vec3 center, float radius, float speed, unsigned int laps);
+
+private:
+    std::vector<CameraKeyframe> keyframes {};
+};
@@ -1,6 +1,28 @@
 #pragma once
 #include "ofMain.h"
 #include "buildTerrainMesh.h"
+#include "TerrainDrawPool.h"
+#include "HorizonCuller.h"
+#include "HeightmapEditor.h"
+#include "HeightSource.h"
+#include "Profiler.h"
+#include "MemoryTracker.h"
+#include "TaskScheduler.h"
+#include "TerrainOcclusion.h"
+#include "PropScatter.h"
+#include <mutex>
+#include <atomic>
+
+// How the cells of terrain are turned into geometry.
+enum class CellRenderMode
+{
+    // Each cell builds and uploads its own mesh on the CPU.
+    Mesh,
+
+    // Each cell only uploads a tile of the heightmap to a texture array;
+    // a single shared grid patch is drawn instanced for every cell and displaced in the vertex shader.
+    HeightTexture,
+};
 
 // A struct for maintaining the state of a single cell.
 struct Cell
@@ -9,343 +31,1863 @@ public:
     // The mesh containing the terrain geometry for the cell.
     ofMesh terrainMesh {};
 
-    // The VBO for the cell
-    ofVbo terrainVBO {};
+    // The corner defining the mesh's location in world space.
+    glm::vec2 startPos {};
+
+    // The lowest and highest terrain heights in the cell, in the same space as the mesh.
+    // Atomic, like the other fields below that the cell's tasks set while the render thread reads them for culling and budgeting.
+    std::atomic<float> minHeight { 0 };
+    std::atomic<float> maxHeight { 0 };
+
+    // The flat water over the parts of the cell below the water height (see CellManager::setWaterHeight()); empty if the cell is dry.
+    // Guarded by CellManager's refresh mutex, since edits can replace it while the cell is live.
+    ofMesh waterMesh {};
+    bool needsWaterRefresh { false };
+
+    // The props of each type scattered over the cell (see CellManager::setPropTypes()), each (x, y, z, scale) in the same
+    // space as the mesh.  Guarded by CellManager's refresh mutex, like the water.
+    std::vector<std::vector<glm::vec4>> props {};
+    bool needsPropRefresh { false };
+
+    // The CPU memory held by the cell's props.
+    std::atomic<size_t> propBytes { 0 };
+
+    // Set if the whole cell is underwater, in which case the water hides its terrain and the terrain isn't drawn.
+    std::atomic<bool> submerged { false };
+
+    // Set to true while a task is loading, rebuilding or editing the cell, so that the render thread leaves its mesh and
+    // height tile alone until the task is done.  A live cell keeps drawing whatever is already on the GPU meanwhile.
+    // Set on the main thread before the task is submitted, and cleared by the task when it's finished.
+    std::atomic<bool> loading { false };
+
+    // Set to false while the cell is inactive so that it's not rendered.
+    std::atomic<bool> live { false };
+
+    // Set to true after loading to copy the mesh into the cell's slot of the draw pool.
+    bool needsVBORefresh { false };
+
+    // Where the cell's data is on the GPU: the index of the draw pool holding its mesh (see CellManager::drawPools),
+    // or 0 once its height tile is in its texture layer.  -1 until then, including when a new cell is loaded into the slot,
+    // which holds the previous cell's data until it's uploaded.  Only touched on the main thread.
+    int uploadedPool { -1 };
+
+    // The range of vertices [begin, end) changed by heightmap edits since the last upload.
+    // Guarded by CellManager's refresh mutex since the cell's tasks and the render thread both touch it.
+    size_t dirtyVertexBegin { 0 };
+    size_t dirtyVertexEnd { 0 };
+
+    // The height samples covering the cell, with a border of one extra sample on each side for the normals at the edges.
+    // The mesh is built from these, and they're drawn directly in CellRenderMode::HeightTexture.
+    ofShortPixels heightTile {};
+
+    // Set to true after loading to upload the height tile to the texture array.
+    bool needsTileUpload { false };
+
+    // The sky visibility baked for the cell's pixels (see TerrainOcclusion), kept until it's been applied to the mesh.
+    std::vector<float> occlusion {};
+
+    // The level of detail the mesh was built at (see CellManager::setMeshLevelOfDetail()).
+    std::atomic<unsigned int> meshLevelOfDetail { 0 };
+
+    // Set to true when the mesh has to be rebuilt at a new level of detail.
+    bool needsRebuild { false };
+
+    // The CPU memory held by the cell's mesh and height tile.
+    std::atomic<size_t> cpuBytes { 0 };
+
+    // Edited pixels (inclusive) waiting for the cell to be free of other work before it's refreshed.
+    bool hasPendingEdit { false };
+    glm::ivec2 pendingEditMin {};
+    glm::ivec2 pendingEditMax {};
+};
+
+// Counts of what happened to the cells during the most recent call to CellManager::drawActiveCells().
+struct CellCullingStats
+{
+    // Live cells that were considered for drawing.
+    unsigned int liveCells { 0 };
+
+    // Cells skipped for being beyond the draw distance.
+    unsigned int distanceCulled { 0 };
+
+    // Cells skipped for being hidden behind nearer terrain.
+    unsigned int occluded { 0 };
+
+    // Cells actually drawn.
+    unsigned int drawn { 0 };
+
+    // Drawn cells that only drew their water, since their terrain is entirely underwater.
+    unsigned int underwater { 0 };
+};
+
+// Counts of the cell loading work, for tracking how well streaming keeps up with the camera.
+struct CellStreamingStats
+{
+    // Cells requested by the observers that haven't started loading yet.
+    unsigned int pendingLoads { 0 };
+
+    // The total number of cells loaded since the cell manager was initialized.
+    unsigned int cellsLoaded { 0 };
+};
+
+// A position that the cell manager keeps terrain loaded around (e.g. a player, a spectator camera or a server-side agent).
+struct CellObserver
+{
+    // Set to false for unused observer slots.
+    bool active { false };
+
+    // The index (in cells) of the first cell in the observer's square of loaded cells.
+    glm::ivec2 gridStartIndices {};
+};
+
+// A template class for managing partial terrain meshes, 
+// automatically loading and unloading cells as they go in and out of draw range.
+// Up to MAX_OBSERVERS observers share the cells; each one keeps a square of (2 * CELL_PAIRS_PER_DIMENSION)^2 cells
+// around itself loaded (or fewer; see setActiveCellPairs()), and cells in overlapping squares are only loaded (and stored) once.
+// If CELL_SIZE isn't 0, the cell size is fixed at compile time (and must match the one passed to the constructor),
+// so that the per-cell loops and index math are specialized for it, and full cells with smooth normals are built
+// by buildTerrainCellMesh<CELL_SIZE>().
+template<unsigned int CELL_PAIRS_PER_DIMENSION, unsigned int MAX_OBSERVERS = 1, unsigned int CELL_SIZE = 0>
+class CellManager
+{
+public:
+    // The height source can be unbounded (e.g. NoiseHeightSource), in which case cells are generated wherever the camera goes.
+    CellManager(const HeightSource& heightSource, float heightmapScale, unsigned int cellSize, CellRenderMode renderMode = CellRenderMode::Mesh)
+        : heightSource{ heightSource }, heightmapScale{ heightmapScale }, runtimeCellSize{ cellSize }, renderMode{ renderMode }
+    {
+        assert(CELL_SIZE == 0 || cellSize == CELL_SIZE);
+    }
+
+    // Don't support copy constructor or copy assignment operator.
+    CellManager(const CellManager& c) = delete;
+    CellManager& operator= (const CellManager& c) = delete;
+
+    // If enabled, cell meshes get baked ambient occlusion (see TerrainOcclusion) as an extra stage of loading.
+    // Only applies to CellRenderMode::Mesh.  This should be called before initializeForPosition().
+    void setBakeOcclusion(bool bake)
+    {
+        bakeOcclusion = bake;
+    }
+
+    // Sets the height of the water surface, in the same space as the cell meshes.  Each cell gets water over its parts
+    // that are below this height, and cells entirely below it skip drawing their terrain.
+    // This should be called before initializeForPosition(); by default there's no water.
+    void setWaterHeight(float height)
+    {
+        waterHeight = height;
+    }
+
+    // Sets the kinds of props scattered over each cell as it loads; none by default.
+    // This should be called before initializeForPosition().
+    void setPropTypes(const std::vector<PropType>& types)
+    {
+        propTypes = types;
+    }
+
+    // The size of each cell in pixels; a compile-time constant if CELL_SIZE is set.
+    unsigned int getCellSize() const
+    {
+        return CELL_SIZE != 0 ? CELL_SIZE : runtimeCellSize;
+    }
+
+    // Enables or disables skipping cells that are hidden behind nearer ridges.
+    void setOcclusionCulling(bool enabled)
+    {
+        occlusionCulling = enabled;
+    }
+
+    // Gets the counts of culled and drawn cells from the last call to drawActiveCells().
+    const CellCullingStats& getCullingStats() const
+    {
+        return cullingStats;
+    }
+
+    // Gets the current state of cell loading.
+    CellStreamingStats getStreamingStats() const
+    {
+        CellStreamingStats stats {};
+        stats.pendingLoads = cellsRequested - cellsDequeued;
+        stats.cellsLoaded = cellsLoaded;
+        return stats;
+    }
+
+    // Rebuilds the parts of any loaded cells that overlap a region of the heightmap that has been edited
+    // (see HeightmapEditor).  The work is done on the shared TaskScheduler, and only the changed vertices are re-uploaded.
+    void refreshRegion(const HeightmapRegion& region)
+    {
+        std::lock_guard<std::mutex> lock { editMutex };
+        pendingEdits.push_back(region);
+    }
+
+    // If enabled, each cell's CPU copy of its mesh (or height tile) is thrown away once it's been uploaded to the GPU.
+    // Edits then rebuild whole cells instead of patching the changed vertices.
+    void setDiscardAfterUpload(bool discard)
+    {
+        discardAfterUpload = discard;
+    }
+
+    // Meshes are built from every (2 ^ level)th height sample, so each level has a quarter of the vertices of the one before.
+    // Only applies to CellRenderMode::Mesh.  Live cells are rebuilt in the background, and drawn at their old level until then.
+    // The memory budget can hold the level above the one asked for (see setMemoryBudget()); getMeshLevelOfDetail() gives
+    // the level actually used.
+    void setMeshLevelOfDetail(unsigned int level)
+    {
+        meshLevelOfDetail = std::min(std::max(level, budgetLevelOfDetail), getMaxMeshLevelOfDetail());
+    }
+
+    unsigned int getMeshLevelOfDetail() const
+    {
+        return meshLevelOfDetail;
+    }
+
+    // Shrinks (or grows back) the square of cells kept loaded around each observer to (2 * pairs)^2 cells,
+    // from 1 up to CELL_PAIRS_PER_DIMENSION pairs.  Each observer's square keeps its center; cells that fall outside
+    // every square are unloaded in the background and new ones are requested.
+    void setActiveCellPairs(unsigned int pairs)
+    {
+        pairs = glm::clamp(pairs, 1u, CELL_PAIRS_PER_DIMENSION);
+
+        if (pairs == activeCellPairs)
+        {
+            return;
+        }
+
+        int shift { static_cast<int>(activeCellPairs) - static_cast<int>(pairs) };
+        activeCellPairs = pairs;
+
+        for (CellObserver& observer : observers)
+        {
+            if (observer.active)
+            {
+                observer.gridStartIndices += shift;
+
+                // Cells the observer already has are skipped as duplicates when their requests come up.
+                requestGridCells(observer.gridStartIndices, nullptr);
+            }
+        }
+
+        observersChanged = true;
+    }
+
+    unsigned int getActiveCellPairs() const
+    {
+        return activeCellPairs;
+    }
+
+    // Sets the most CPU and GPU memory the cells may use; 0 bytes means no limit.
+    // While over budget, update() first discards CPU copies after upload (if CPU memory is over),
+    // then lowers the mesh level of detail a step at a time.  The level it lowers to stays as the finest that
+    // setMeshLevelOfDetail() can ask for, so the two don't keep undoing each other (and rebuilding every cell).
+    void setMemoryBudget(MemoryUsage budget)
+    {
+        memoryBudget = budget;
+    }
+
+    // Gets the memory currently used by the cells.
+    MemoryUsage getMemoryUsage() const
+    {
+        MemoryUsage usage {};
+
+        for (const Cell& cell : cellBuffer)
+        {
+            usage.cpuBytes += cell.cpuBytes + cell.propBytes;
+        }
+
+        usage.gpuBytes = drawPools[0].getAllocatedBytes() + drawPools[1].getAllocatedBytes() + waterVBOBytes + propBatchBytes;
+
+        if (heightTileTexture != 0)
+        {
+            size_t tileSize { getCellSize() + 3 };
+            size_t gridVertices { (getCellSize() + 1) * (getCellSize() + 1) };
+            usage.gpuBytes += tileSize * tileSize * sizeof(unsigned short) * CELL_BUFFER_SIZE
+                + gridVertices * sizeof(glm::vec3) + gridVBO.getNumIndices() * sizeof(ofIndexType);
+        }
+
+        return usage;
+    }
+
+    // Sets the normals and triangle order used for cell meshes.
+    // This should be called before initializeForPosition().
+    void setMeshOptions(const TerrainMeshOptions& options)
+    {
+        meshOptions = options;
+    }
+
+    // This function should be called in your ofApp::setup() function.  
+    // Pass in whatever position you want the loaded terrain to be centered around; it becomes observer 0.
+    void initializeForPosition(glm::vec3 position)
+    {
+        // The range of loaded cells should be centered on the player.
+        observers[0].active = true;
+        observers[0].gridStartIndices = getCenteredGridStartIndices(position);
+
+        // Load each cell before returning, so that there's terrain to draw from the first frame.
+        requestGridCells(observers[0].gridStartIndices, nullptr);
+        while (!cellLoadQueue.empty())
+        {
+            scheduleLoads();
+            waitForCellTasks();
+        }
+    }
+
+    // This function should be called in your ofApp::update() function to unload cells that have gotten to be far away
+    // and request new cells that have gotten closer.  No meshes are actually loaded in this function;
+    // it hands the loading, edits and rebuilds that are ready to go to the shared TaskScheduler.
+    // This moves observer 0; use setObserverPosition() for any others.
+    void optimizeForPosition(glm::vec3 position)
+    {
+        setObserverPosition(0, position);
+    }
+
+    // Adds another position to keep terrain loaded around, returning its observer index, or -1 if there are already MAX_OBSERVERS.
+    // Its cells are loaded in the background, skipping any that are already loaded for other observers.
+    int addObserver(glm::vec3 position)
+    {
+        glm::ivec2 gridStartIndices { getCenteredGridStartIndices(position) };
+        int index { -1 };
+
+        for (unsigned int i { 0 }; i < MAX_OBSERVERS && index < 0; i++)
+        {
+            if (!observers[i].active)
+            {
+                observers[i].active = true;
+                observers[i].gridStartIndices = gridStartIndices;
+                index = static_cast<int>(i);
+            }
+        }
+
+        if (index < 0)
+        {
+            ofLogError("CellManager") << "Can't add more than " << MAX_OBSERVERS << " observers.";
+            return -1;
+        }
+
+        requestGridCells(gridStartIndices, nullptr);
+        return index;
+    }
+
+    // Stops keeping terrain loaded around an observer; cells that no other observer needs are unloaded in the background.
+    void removeObserver(int index)
+    {
+        observers[index].active = false;
+        observersChanged = true;
+    }
+
+    // The same as optimizeForPosition(), for any observer.
+    void setObserverPosition(int index, glm::vec3 position)
+    {
+        scheduleCellWork();
+
+        CellObserver& observer { observers[index] };
+
+        // Calculate a lower bound (in each dimension) on where the observer's grid can start.
+        glm::ivec2 minGridStartIndices { glm::ceil(glm::vec2(position.x, position.z) / static_cast<float>(getCellSize())) - glm::vec2(activeCellPairs) };
+
+        // Only move the grid of loaded cells if it's outside of the lower / upper bounds (the upper bound is one cell further on).
+        // This ensures that unnecessary loading doesn't occur.
+        glm::ivec2 newGridStartIndices { glm::clamp(observer.gridStartIndices, minGridStartIndices, minGridStartIndices + 1) };
+
+        // Only do something if the grid of loaded cells needs to change.
+        if (newGridStartIndices != observer.gridStartIndices)
+        {
+            glm::ivec2 oldGridStartIndices { observer.gridStartIndices };
+            observer.gridStartIndices = newGridStartIndices;
+            observersChanged = true;
+
+            // Request the cells that have come into range; this also covers very fast movement that skips whole rows.
+            requestGridCells(newGridStartIndices, &oldGridStartIndices);
+        }
+    }
+
+    // This function should be called once per frame in your ofApp::update() function, after the observers have been moved,
+    // with the GL context current.  It takes a step towards the memory budget and uploads the cells (and their water and props)
+    // that tasks have finished with, so that the draw functions below only cull and draw, however many views there are.
+    void update()
+    {
+        PROFILE_ZONE("CellManager::update");
+
+        enforceMemoryBudget();
+
+        size_t bytesUploaded { renderMode == CellRenderMode::HeightTexture ? uploadHeightTiles() : uploadCellMeshes() };
+        PROFILE_COUNTER("Bytes uploaded", bytesUploaded);
+
+        uploadCellProps();
+        uploadWater();
+    }
+
+    // This function iterates over all the available cells and draws all of them that are within the draw 
+    // distance from the current camera position. This should be called from your ofApp::draw() function.  
+    // The draw distance should be the same as the far plane from your projection matrix.
+    // With several observers, call this once for each observer's view; every live cell is a candidate, whichever observer loaded it.
+    // Only cells that update() has uploaded are drawn.
+    // The camera position should be in the same space as the cell meshes (i.e. before the model transform),
+    // so that it can be compared with the cells' heights for occlusion culling.
+    // The shader should be the one currently bound; it receives the per-cell data in CellRenderMode::HeightTexture.
+    void drawActiveCells(glm::vec3 camPosition, float drawDistance, const ofShader& shader)
+    {
+        PROFILE_ZONE("CellManager::drawActiveCells");
+
+        updateVisibleCells(camPosition, drawDistance);
+
+        if (renderMode == CellRenderMode::HeightTexture)
+        {
+            drawActiveCellsFromHeightTiles(shader);
+            return;
+        }
+
+        for (TerrainDrawPool& pool : drawPools)
+        {
+            pool.clearDraws();
+        }
+
+        for (unsigned int i : visibleCells)
+        {
+            if (cellBuffer[i].uploadedPool >= 0 && !cellBuffer[i].submerged)
+            {
+                drawPools[cellBuffer[i].uploadedPool].addDraw(i);
+            }
+        }
+
+        // Draw all the visible cells at once (or twice, while the level of detail is changing).
+        for (TerrainDrawPool& pool : drawPools)
+        {
+            pool.draw();
+        }
+    }
+
+    // Draws the water of every live cell as one mesh, with the same shader and transforms as drawActiveCells().
+    // Call it after drawActiveCells() so that water hidden behind the terrain fails the depth test before it's shaded.
+    void drawWater()
+    {
+        PROFILE_ZONE("CellManager::drawWater");
+
+        if (!waterVBOCells.empty())
+        {
+            waterVBO.drawElements(GL_TRIANGLES, waterVBO.getNumIndices());
+        }
+    }
+
+    // Draws the props (see setPropTypes()) of the live cells within each type's draw distance, with one instanced draw call
+    // per prop type and the same shader and transforms as drawActiveCells().  Call it after drawActiveCells(), like drawWater().
+    // Each cell has a fixed-size slot in every type's instance buffer, the same way it does in the draw pool, so a cell's
+    // props are uploaded once when it goes live, without touching the other cells' props.  The props of the cells in range
+    // are then packed together on the GPU (only when the cells in range change), so that no instance is drawn for
+    // cells out of range or for the unused part of a slot.
+    // The camera position should be in the same space as the cell meshes, as for drawActiveCells().
+    void drawProps(glm::vec3 camPosition, const ofShader& shader)
+    {
+        PROFILE_ZONE("CellManager::drawProps");
+
+        if (propTypes.empty())
+        {
+            return;
+        }
+
+        // Nothing has gone live yet.
+        if (propSlotCount == 0)
+        {
+            return;
+        }
+
+        glm::vec2 camPosition2D { camPosition.x, camPosition.z };
+        shader.setUniform1i("useInstances", 1);
+
+        for (size_t type { 0 }; type < propTypes.size(); type++)
+        {
+            PropBatch& batch { propBatches[type] };
+
+            // The same test as for drawing the cells, with the type's draw distance.
+            float threshold { propTypes[type].drawDistance + getCellSize() * glm::sqrt(0.5f) };
+            propVisibleSlots.clear();
+
+            for (unsigned int i { 0 }; i < propSlotCount; i++)
+            {
+                if (propSlotsFilled[i] && batch.slotCounts[i] > 0
+                    && distance(camPosition2D, cellBuffer[i].startPos + getCellSize() * 0.5f) < threshold)
+                {
+                    propVisibleSlots.push_back(i);
+                }
+            }
+
+            if (propSlotsChanged || propVisibleSlots != batch.drawnSlots)
+            {
+                PROFILE_ZONE("Pack visible props");
+                size_t packed { 0 };
+
+                for (unsigned int i : propVisibleSlots)
+                {
+                    batch.instances.copyTo(batch.visibleInstances, static_cast<int>(i * batch.capacity * sizeof(glm::vec4)),
+                        static_cast<int>(packed * sizeof(glm::vec4)), batch.slotCounts[i] * sizeof(glm::vec4));
+                    packed += batch.slotCounts[i];
+                }
+
+                batch.drawnSlots = propVisibleSlots;
+                batch.drawnCount = packed;
+            }
+
+            if (batch.drawnCount > 0)
+            {
+                shader.setUniform3f("propColor", propTypes[type].color);
+                shader.setUniform2f("propFade", glm::vec2(propTypes[type].fullDensityDistance, propTypes[type].drawDistance));
+                batch.vbo.drawElementsInstanced(GL_TRIANGLES, batch.vbo.getNumIndices(), static_cast<int>(batch.drawnCount));
+            }
+        }
+
+        // Every batch is packed from the new slots now; other views only repack if their cells in range differ.
+        propSlotsChanged = false;
+        shader.setUniform1i("useInstances", 0);
+    }
+
+    // Runs the culling part of drawActiveCells() without drawing anything, updating the culling stats.
+    // This doesn't need a GL context, so it can be used for headless runs.
+    void updateVisibleCells(glm::vec3 camPosition, float drawDistance)
+    {
+        PROFILE_ZONE("CellManager::updateVisibleCells");
+
+        // Calculate an appropriate threshold for deciding if cells are too far away to draw.
+        float threshold = drawDistance + getCellSize() * glm::sqrt(0.5f);
+
+        findVisibleCells(camPosition, threshold);
+
+        PROFILE_COUNTER("Live cells", cullingStats.liveCells);
+        PROFILE_COUNTER("Drawn cells", cullingStats.drawn);
+        PROFILE_COUNTER("Load queue", cellsRequested - cellsDequeued);
+    }
+
+    // This function waits for the cells' background work and frees the GPU resources; it should be called from ofApp::exit().
+    void stop()
+    {
+        // Finish the cells' tasks before other resources are destroyed.
+        waitForCellTasks();
+
+        for (TerrainDrawPool& pool : drawPools)
+        {
+            pool.release();
+        }
+        waterVBO.clear();
+        propBatches.clear();
+        propSlotCount = 0;
+
+        if (heightTileTexture != 0)
+        {
+            glDeleteTextures(1, &heightTileTexture);
+            heightTileTexture = 0;
+        }
+    }
+
+private:
+    // The most cells loaded around each observer.
+    const static unsigned int GRID_CELLS { 4 * CELL_PAIRS_PER_DIMENSION * CELL_PAIRS_PER_DIMENSION };
+
+    // The maximum number of cells that can be currently loaded at once, enough for every observer to be far from the others.
+    const static unsigned int CELL_BUFFER_SIZE { GRID_CELLS * MAX_OBSERVERS };
+
+    // The buffer of loaded cells.
+    Cell cellBuffer[CELL_BUFFER_SIZE] {};
+
+    // Where the heights of the terrain come from.
+    const HeightSource& heightSource;
+
+    float heightmapScale;
+
+    // The size of each cell (assumed to be square), if it isn't fixed at compile time; see getCellSize().
+    unsigned int runtimeCellSize;
+
+    // Whether cells are drawn from their own meshes or from height tiles displacing a shared grid.
+    CellRenderMode renderMode;
+
+    // The normals and triangle order used for cell meshes and the shared grid patch.
+    TerrainMeshOptions meshOptions {};
+
+    // The GPU storage for every cell's mesh in CellRenderMode::Mesh; the slot for each cell is its index in the cell buffer.
+    // Cells are loaded into the lowest free index, so a pool only grows as far as the observers' combined area needs.
+    // The slots are sized for a level of detail, so when the level changes, a new pool is made for it and the cells
+    // keep drawing from the old one until they've been rebuilt and uploaded to the new one, which then becomes the only one.
+    TerrainDrawPool drawPools[2] {};
+    unsigned int poolLevelsOfDetail[2] {};
+
+    // The pool that cells built at the current level of detail are uploaded to.
+    int currentDrawPool { 0 };
+
+    // The maximum number of cells drawn by one instanced draw call; must match the size of cellInstances in shader.vert.
+    const static unsigned int MAX_INSTANCES_PER_DRAW { 64 };
+
+    // The grid patch shared by all cells in CellRenderMode::HeightTexture.
+    ofVbo gridVBO {};
+
+    // A texture array with one layer of heights per slot in the cell buffer (for every observer, since tiles are small).
+    GLuint heightTileTexture { 0 };
+
+    // See setDiscardAfterUpload(); read by the cells' tasks.
+    std::atomic<bool> discardAfterUpload { false };
+
+    // See setMeshLevelOfDetail(); read by the cells' tasks.
+    std::atomic<unsigned int> meshLevelOfDetail { 0 };
+
+    // The finest level of detail the memory budget allows; see enforceMemoryBudget().
+    unsigned int budgetLevelOfDetail { 0 };
+
+    // See setActiveCellPairs().
+    unsigned int activeCellPairs { CELL_PAIRS_PER_DIMENSION };
+
+    // See setBakeOcclusion().
+    bool bakeOcclusion { false };
+
+    // See setWaterHeight().
+    float waterHeight { std::numeric_limits<float>::lowest() };
+
+    // The water of every live cell, and the cells it was built from.
+    ofVbo waterVBO {};
+    std::vector<unsigned int> waterVBOCells {};
+    size_t waterVBOBytes { 0 };
+
+    // See setPropTypes().
+    std::vector<PropType> propTypes {};
+
+    // The GPU side of a prop type: its mesh, and its instances, with a slot of "capacity" instances for each cell.
+    // The instances of the cells being drawn are packed into "visibleInstances", which the mesh is drawn from.
+    struct PropBatch
+    {
+        ofVbo vbo {};
+        ofBufferObject instances {};
+        ofBufferObject visibleInstances {};
+        unsigned int capacity { 0 };
+
+        // The number of instances in each slot.
+        std::vector<unsigned int> slotCounts {};
+
+        // The slots packed into "visibleInstances", and the instances they hold.
+        std::vector<unsigned int> drawnSlots {};
+        size_t drawnCount { 0 };
+    };
+
+    // One batch per prop type, each with "propSlotCount" slots, and whether each slot holds a live cell's props.
+    std::vector<PropBatch> propBatches {};
+    unsigned int propSlotCount { 0 };
+    std::vector<bool> propSlotsFilled {};
+    size_t propBatchBytes { 0 };
+    std::vector<unsigned int> propVisibleSlots {};
+
+    // Set when update() changes any slot's props, so that every batch is packed again for the next view drawn.
+    bool propSlotsChanged { false };
+
+    // The location of the per-instance attribute in shader.vert.
+    const static int PROP_INSTANCE_ATTRIBUTE { 5 };
+
+    // The size (in pixels) of the blocks that water is added to or left out of.
+    const static unsigned int WATER_BLOCK_SIZE { 16 };
+
+    // See setMemoryBudget().
+    MemoryUsage memoryBudget {};
+
+    // The number of frames since the budget last forced a change, so that each change can take effect before the next.
+    unsigned int framesSinceBudgetStep { 0 };
+    bool budgetWarningLogged { false };
+
+    // Whether cells hidden behind nearer terrain are skipped.
+    bool occlusionCulling { true };
+
+    HorizonCuller horizonCuller {};
+
+    // The indices of the cells to draw this frame, found by findVisibleCells().
+    std::vector<unsigned int> visibleCells {};
+
+    CellCullingStats cullingStats {};
+
+    // The positions to keep cells loaded around; observer 0 is set up by initializeForPosition().
+    CellObserver observers[MAX_OBSERVERS] {};
+
+    // Set when an observer's grid moves or is removed, so that cells that are no longer needed get unloaded.
+    bool observersChanged { false };
+
+    // A queue containing the corners of cells that need to be loaded.
+    std::queue<glm::vec2> cellLoadQueue {};
+
+    // Counters behind getStreamingStats(); cells loaded are counted by the cells' tasks and the rest on the main thread.
+    std::atomic<unsigned int> cellsRequested { 0 };
+    std::atomic<unsigned int> cellsDequeued { 0 };
+    std::atomic<unsigned int> cellsLoaded { 0 };
+
+    // The last task of the work in progress on each cell in the buffer, if any.
+    // Only one piece of work runs on a cell at a time; anything else for the cell waits until the task has finished.
+    TaskHandle cellTasks[CELL_BUFFER_SIZE] {};
+
+    // Edited heightmap regions waiting to be handed out to the cells.
+    std::vector<HeightmapRegion> pendingEdits {};
+    std::mutex editMutex {};
+
+    // Guards the cells' dirty vertex ranges.
+    std::mutex refreshMutex {};
+
+    // The coarsest level of detail that still leaves 8 quads across a cell.
+    unsigned int getMaxMeshLevelOfDetail() const
+    {
+        unsigned int level { 0 };
+
+        while ((getCellSize() >> (level + 1)) >= 8)
+        {
+            level++;
+        }
+
+        return level;
+    }
+
+    // Gets the number of draw pool slots needed to cover every cell in use, in whole observer grids.
+    unsigned int getRequiredSlotCount() const
+    {
+        unsigned int usedSlots { 0 };
+
+        for (unsigned int i { 0 }; i < CELL_BUFFER_SIZE; i++)
+        {
+            if (cellBuffer[i].live || cellBuffer[i].loading)
+            {
+                usedSlots = i + 1;
+            }
+        }
+
+        return std::max(1u, (usedSlots + GRID_CELLS - 1) / GRID_CELLS) * GRID_CELLS;
+    }
+
+    // (Re)creates one of the draw pools with slots big enough for a full cell at the given level of detail.
+    // Any cells that were in it lose their place and are drawn again once they've been rebuilt at the current level.
+    void allocateDrawPool(int pool, unsigned int levelOfDetail, unsigned int slotCount)
+    {
+        unsigned int quads { getCellSize() >> levelOfDetail };
+
+        // flatNormals() gives every triangle its own three vertices, so a full cell has 6 vertices per quad.
+        unsigned int verticesPerCell { meshOptions.smoothNormals ? (quads + 1) * (quads + 1) : 6 * quads * quads };
+        drawPools[pool].allocate(slotCount, verticesPerCell, 6 * quads * quads);
+        poolLevelsOfDetail[pool] = levelOfDetail;
+
+        for (Cell& cell : cellBuffer)
+        {
+            if (cell.uploadedPool == pool)
+            {
+                cell.uploadedPool = -1;
+            }
+        }
+    }
+
+    // Gets the allocated draw pool whose slots fit meshes at a level of detail, preferring the current one, or -1 if neither does.
+    int findDrawPool(unsigned int levelOfDetail) const
+    {
+        for (int pool : { currentDrawPool, 1 - currentDrawPool })
+        {
+            if (drawPools[pool].isAllocated() && poolLevelsOfDetail[pool] == levelOfDetail)
+            {
+                return pool;
+            }
+        }
+
+        return -1;
+    }
+
+    // Takes one step towards fitting in the memory budget if the cells are over it.
+    void enforceMemoryBudget()
+    {
+        const unsigned int FRAMES_BETWEEN_BUDGET_STEPS { 30 };
+
+        if (framesSinceBudgetStep < FRAMES_BETWEEN_BUDGET_STEPS)
+        {
+            framesSinceBudgetStep++;
+            return;
+        }
+
+        MemoryUsage usage { getMemoryUsage() };
+        bool overCPU { memoryBudget.cpuBytes != 0 && usage.cpuBytes > memoryBudget.cpuBytes };
+        bool overGPU { memoryBudget.gpuBytes != 0 && usage.gpuBytes > memoryBudget.gpuBytes };
+
+        if (!overCPU && !overGPU)
+        {
+            return;
+        }
+
+        // Wait for the last change of detail, and any other work on live cells, to finish before judging it.
+        for (const Cell& cell : cellBuffer)
+        {
+            if (cell.live && (cell.loading || cell.needsRebuild || cell.needsVBORefresh || cell.meshLevelOfDetail != meshLevelOfDetail))
+            {
+                return;
+            }
+        }
+
+        if (overCPU && !discardAfterUpload)
+        {
+            ofLogNotice("CellManager") << "Over the CPU memory budget; discarding CPU copies of cells after upload.";
+            discardAfterUpload = true;
+        }
+        else if (renderMode == CellRenderMode::Mesh && meshLevelOfDetail < getMaxMeshLevelOfDetail())
+        {
+            ofLogNotice("CellManager") << "Over the memory budget; lowering the cell level of detail to " << meshLevelOfDetail + 1 << ".";
+            budgetLevelOfDetail = meshLevelOfDetail + 1;
+            meshLevelOfDetail = budgetLevelOfDetail;
+        }
+        else
+        {
+            if (!budgetWarningLogged)
+            {
+                ofLogWarning("CellManager") << "Can't fit the cells in the memory budget.";
+                budgetWarningLogged = true;
+            }
+
+            return;
+        }
+
+        framesSinceBudgetStep = 0;
+    }
+
+    // Adds a cell to the load queue.
+    void requestCellLoad(glm::vec2 cellStartPos)
+    {
+        cellLoadQueue.push(cellStartPos);
+        cellsRequested++;
+    }
+
+    // Gets the start of a grid of cells centered on a position.
+    glm::ivec2 getCenteredGridStartIndices(glm::vec3 position) const
+    {
+        return glm::ivec2(glm::round(glm::vec2(position.x, position.z) / static_cast<float>(getCellSize()))) - glm::ivec2(activeCellPairs);
+    }
+
+    bool isInGrid(glm::ivec2 cellIndices, glm::ivec2 gridStartIndices) const
+    {
+        glm::ivec2 offset { cellIndices - gridStartIndices };
+        int gridSize { 2 * static_cast<int>(activeCellPairs) };
+        return offset.x >= 0 && offset.y >= 0 && offset.x < gridSize && offset.y < gridSize;
+    }
+
+    // Requests every cell in an observer's grid, skipping those that were already in its previous grid (if there was one).
+    // Cells that other observers have already loaded are skipped when the request comes up.
+    void requestGridCells(glm::ivec2 gridStartIndices, const glm::ivec2* previousGridStartIndices)
+    {
+        for (unsigned int i { 0 }; i < 2 * activeCellPairs; i++)
+        {
+            for (unsigned int j { 0 }; j < 2 * activeCellPairs; j++)
+            {
+                glm::ivec2 cellIndices { gridStartIndices + glm::ivec2(i, j) };
+
+                if (previousGridStartIndices == nullptr || !isInGrid(cellIndices, *previousGridStartIndices))
+                {
+                    requestCellLoad(glm::vec2(cellIndices) * getCellSize());
+                }
+            }
+        }
+    }
+
+    // Creates the shared grid patch and the height tile texture array the first time they're needed.
+    void initHeightTileResources()
+    {
+        if (heightTileTexture != 0)
+        {
+            return;
+        }
+
+        ofMesh gridMesh {};
+        buildTerrainGridPatch(gridMesh, getCellSize(), meshOptions);
+        gridVBO.setMesh(gridMesh, GL_STATIC_DRAW);
+
+        unsigned int tileSize { getCellSize() + 3 };
+        glGenTextures(1, &heightTileTexture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, heightTileTexture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R16, tileSize, tileSize, CELL_BUFFER_SIZE, 0, GL_RED, GL_UNSIGNED_SHORT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+
+    // Fills in visibleCells with the live cells that are in range and not hidden behind nearer terrain.
+    void findVisibleCells(glm::vec3 camPosition, float threshold)
+    {
+        glm::vec2 camPosition2D { camPosition.x, camPosition.z };
+        cullingStats = CellCullingStats();
+        visibleCells.clear();
+
+        for (unsigned int i { 0 }; i < CELL_BUFFER_SIZE; i++)
+        {
+            Cell& cell { cellBuffer[i] };
+
+            // Make sure the cell is live/active and check the distance from the cell center to the camera position
+            if (cell.live)
+            {
+                cullingStats.liveCells++;
+
+                if (distance(camPosition2D, cell.startPos + getCellSize() * 0.5f) < threshold)
+                {
+                    visibleCells.push_back(i);
+                }
+                else
+                {
+                    cullingStats.distanceCulled++;
+                }
+            }
+        }
+
+        if (occlusionCulling)
+        {
+            // The horizon has to be built front to back.
+            std::sort(visibleCells.begin(), visibleCells.end(), [&] (unsigned int a, unsigned int b)
+            {
+                return distance(camPosition2D, cellBuffer[a].startPos + getCellSize() * 0.5f)
+                    < distance(camPosition2D, cellBuffer[b].startPos + getCellSize() * 0.5f);
+            });
+
+            horizonCuller.begin(camPosition);
+
+            auto firstOccluded = std::stable_partition(visibleCells.begin(), visibleCells.end(), [&] (unsigned int i)
+            {
+                const Cell& cell { cellBuffer[i] };
+                // Water above the terrain raises the top of the cell.
+                return !horizonCuller.testAndAddCell(cell.startPos, cell.startPos + glm::vec2(getCellSize()), cell.minHeight, std::max(cell.maxHeight.load(), waterHeight));
+            });
+
+            cullingStats.occluded = static_cast<unsigned int>(visibleCells.end() - firstOccluded);
+            visibleCells.erase(firstOccluded, visibleCells.end());
+        }
+
+        cullingStats.drawn = static_cast<unsigned int>(visibleCells.size());
+        cullingStats.underwater = static_cast<unsigned int>(std::count_if(visibleCells.begin(), visibleCells.end(),
+            [&] (unsigned int i) { return cellBuffer[i].submerged; }));
+    }
+
+    // Draws every visible cell as an instance of the shared grid patch, displaced by the cell's height tile.
+    void drawActiveCellsFromHeightTiles(const ofShader& shader)
+    {
+        if (heightTileTexture == 0)
+        {
+            return;
+        }
+
+        // Each instance is (start x, start z, texture array layer, unused).
+        std::vector<glm::vec4> instances {};
+
+        for (unsigned int i : visibleCells)
+        {
+            if (cellBuffer[i].uploadedPool >= 0 && !cellBuffer[i].submerged)
+            {
+                instances.push_back(glm::vec4(cellBuffer[i].startPos, i, 0));
+            }
+        }
+
+        shader.setUniform1i("useHeightTiles", 1);
+        shader.setUniformTexture("heightTiles", GL_TEXTURE_2D_ARRAY, heightTileTexture, 0);
+        shader.setUniform1f("heightmapScale", heightmapScale);
+        // Unbounded sources have no edge to collapse vertices onto.
+        shader.setUniform2f("heightmapSize", heightSource.isBounded() ? glm::vec2(heightSource.getSize()) : glm::vec2(std::numeric_limits<float>::max()));
+
+        // Draw in batches that fit in the shader's instance array.
+        for (size_t first { 0 }; first < instances.size(); first += MAX_INSTANCES_PER_DRAW)
+        {
+            int count { static_cast<int>(std::min<size_t>(MAX_INSTANCES_PER_DRAW, instances.size() - first)) };
+            shader.setUniform4fv("cellInstances", &instances[first].x, count);
+            gridVBO.drawElementsInstanced(GL_TRIANGLES, gridVBO.getNumIndices(), count);
+        }
+
+        shader.setUniform1i("useHeightTiles", 0);
+    }
+
+    // Copies the meshes of cells that tasks have finished with into their slots of the draw pool, creating or growing the pool
+    // first if necessary.  Every cell that's ready is uploaded, not just the visible ones, so that CPU copies can be discarded
+    // as early as possible.  Returns the number of bytes uploaded.
+    size_t uploadCellMeshes()
+    {
+        unsigned int levelOfDetail { meshLevelOfDetail };
+        unsigned int slotCount { getRequiredSlotCount() };
+
+        if (!drawPools[currentDrawPool].isAllocated())
+        {
+            allocateDrawPool(currentDrawPool, levelOfDetail, slotCount);
+        }
+        else if (poolLevelsOfDetail[currentDrawPool] != levelOfDetail)
+        {
+            // The cells stay in the pool they're in until they're rebuilt to fit the other one.  If the level changes
+            // back before they've all moved, the old pool is still there; otherwise any cells left in it have to wait.
+            currentDrawPool = 1 - currentDrawPool;
+            if (findDrawPool(levelOfDetail) != currentDrawPool)
+            {
+                allocateDrawPool(currentDrawPool, levelOfDetail, slotCount);
+            }
+        }
+
+        // More observers are covering more ground; grow the pool, keeping the cells already in it.
+        if (slotCount > drawPools[currentDrawPool].getSlotCount())
+        {
+            drawPools[currentDrawPool].grow(slotCount);
+        }
+
+        size_t bytesUploaded { 0 };
+
+        for (unsigned int i { 0 }; i < CELL_BUFFER_SIZE; i++)
+        {
+            Cell& cell { cellBuffer[i] };
+
+            if (!cell.live || cell.loading)
+            {
+                continue;
+            }
+
+            // A cell built before the level of detail changed is rebuilt, but until then it's kept up to date in the old pool.
+            int pool { findDrawPool(cell.meshLevelOfDetail) };
+            if (pool >= 0 && i >= drawPools[pool].getSlotCount())
+            {
+                // The old pool isn't grown, so a cell loaded beyond its slots has to wait for its rebuild.
+                pool = -1;
+            }
+
+            if (pool != currentDrawPool)
+            {
+                cell.needsRebuild = true;
+            }
+
+            if (pool < 0)
+            {
+                continue;
+            }
+
+            // Update the cell's slot in the pool if necessary.
+            if (cell.needsVBORefresh)
+            {
+                PROFILE_ZONE("Refresh cell VBO");
+                drawPools[pool].uploadMesh(i, cell.terrainMesh);
+                bytesUploaded += cell.terrainMesh.getNumVertices() * 2 * sizeof(glm::vec3) + cell.terrainMesh.getNumIndices() * sizeof(ofIndexType);
+                cell.needsVBORefresh = false;
+                cell.uploadedPool = pool;
+
+                if (discardAfterUpload)
+                {
+                    // Assign a new mesh rather than clearing so that the memory is actually freed.
+                    cell.terrainMesh = ofMesh();
+                    cell.cpuBytes = 0;
+                }
+
+                std::lock_guard<std::mutex> lock { refreshMutex };
+                cell.dirtyVertexBegin = cell.dirtyVertexEnd = 0;
+            }
+            else if (cell.uploadedPool == pool)
+            {
+                // Only upload the vertices touched by heightmap edits.
+                std::lock_guard<std::mutex> lock { refreshMutex };
+
+                if (cell.dirtyVertexEnd > cell.dirtyVertexBegin)
+                {
+                    PROFILE_ZONE("Refresh cell VBO range");
+                    drawPools[pool].uploadVertexRange(i, cell.terrainMesh, cell.dirtyVertexBegin, cell.dirtyVertexEnd - cell.dirtyVertexBegin);
+                    bytesUploaded += (cell.dirtyVertexEnd - cell.dirtyVertexBegin) * 2 * sizeof(glm::vec3);
+                    cell.dirtyVertexBegin = cell.dirtyVertexEnd = 0;
+                }
+            }
+        }
+
+        // Free the old pool once every live cell has moved out of it.
+        int previousPool { 1 - currentDrawPool };
+        if (drawPools[previousPool].isAllocated() && std::none_of(std::begin(cellBuffer), std::end(cellBuffer),
+            [previousPool] (const Cell& cell) { return cell.live && cell.uploadedPool == previousPool; }))
+        {
+            drawPools[previousPool].release();
+        }
+
+        return bytesUploaded;
+    }
+
+    // Uploads the height tiles of cells that tasks have finished with into their layers of the texture array.
+    // Returns the number of bytes uploaded.
+    size_t uploadHeightTiles()
+    {
+        initHeightTileResources();
+
+        unsigned int tileSize { getCellSize() + 3 };
+        size_t bytesUploaded { 0 };
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, heightTileTexture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+
+        for (unsigned int i { 0 }; i < CELL_BUFFER_SIZE; i++)
+        {
+            Cell& cell { cellBuffer[i] };
+
+            if (cell.needsTileUpload && !cell.loading)
+            {
+                PROFILE_ZONE("Upload height tile");
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, tileSize, tileSize, 1, GL_RED, GL_UNSIGNED_SHORT, cell.heightTile.getData());
+                bytesUploaded += tileSize * tileSize * sizeof(unsigned short);
+                cell.needsTileUpload = false;
+                cell.uploadedPool = 0;
+
+                if (discardAfterUpload)
+                {
+                    cell.heightTile.clear();
+                    cell.cpuBytes = 0;
+                }
+            }
+        }
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        return bytesUploaded;
+    }
+
+    // Uploads the props of cells that have gone live or been edited into their slots of the prop batches,
+    // and empties the slots of cells that have been unloaded.
+    void uploadCellProps()
+    {
+        if (propTypes.empty())
+        {
+            return;
+        }
+
+        // The batches only grow as far as the highest live slot; cells are loaded into the lowest free one.
+        unsigned int slotsNeeded { 0 };
+        for (unsigned int i { 0 }; i < CELL_BUFFER_SIZE; i++)
+        {
+            if (cellBuffer[i].live)
+            {
+                slotsNeeded = i + 1;
+            }
+        }
+
+        if (slotsNeeded > propSlotCount)
+        {
+            allocatePropBatches(slotsNeeded);
+            propSlotsChanged = true;
+        }
+
+        std::lock_guard<std::mutex> lock { refreshMutex };
+
+        for (unsigned int i { 0 }; i < propSlotCount; i++)
+        {
+            Cell& cell { cellBuffer[i] };
+
+            if (cell.live && (cell.needsPropRefresh || !propSlotsFilled[i]))
+            {
+                PROFILE_ZONE("Upload cell props");
+                uploadPropSlot(i, cell.props);
+                propSlotsFilled[i] = true;
+                cell.needsPropRefresh = false;
+                propSlotsChanged = true;
+            }
+            else if (!cell.live && propSlotsFilled[i])
+            {
+                uploadPropSlot(i, {});
+                propSlotsFilled[i] = false;
+                propSlotsChanged = true;
+            }
+        }
+    }
+
+    // Rebuilds the combined water mesh when cells have come, gone or been edited.
+    void uploadWater()
+    {
+        std::vector<unsigned int> wetCells {};
+        bool waterChanged { false };
+
+        std::lock_guard<std::mutex> lock { refreshMutex };
+
+        for (unsigned int i { 0 }; i < CELL_BUFFER_SIZE; i++)
+        {
+            Cell& cell { cellBuffer[i] };
+
+            if (cell.live && cell.waterMesh.getNumVertices() > 0)
+            {
+                wetCells.push_back(i);
+                waterChanged = waterChanged || cell.needsWaterRefresh;
+                cell.needsWaterRefresh = false;
+            }
+        }
+
+        if (waterChanged || wetCells != waterVBOCells)
+        {
+            PROFILE_ZONE("Refresh water VBO");
+            ofMesh water {};
+
+            for (unsigned int i : wetCells)
+            {
+                water.append(cellBuffer[i].waterMesh);
+            }
+
+            waterVBO.setMesh(water, GL_DYNAMIC_DRAW);
+            waterVBOBytes = getMeshBytes(water);
+            waterVBOCells = wetCells;
+        }
+    }
+
+    bool isCellDistant(glm::vec2 cellStartPos)
+    {
+        // Distant cells are outside of every observer's grid of cells.
+        // Rounding to cell indices accounts for round-off error in the start position.
+        glm::ivec2 cellIndices { glm::round(cellStartPos / static_cast<float>(getCellSize())) };
+
+        for (const CellObserver& observer : observers)
+        {
+            if (observer.active && isInGrid(cellIndices, observer.gridStartIndices))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool isCellDuplicate(glm::vec2 cellStartPos, float tolerance)
+    {
+        for (unsigned int i { 0 }; i < CELL_BUFFER_SIZE; i++)
+        {
+            const Cell& otherCell { cellBuffer[i] };
+
+            // If two cells' start position is within a certain tolerance, they are considered duplicates.
+            // Unused cells keep their old start positions, so only count cells that are in use
+            // (including those briefly not live while a task rebuilds them).
+            if ((otherCell.live || otherCell.loading || isCellBusy(i)) && distance(otherCell.startPos, cellStartPos) < tolerance)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Gets the size of a cell's mesh in quads, which is smaller than the cell size at the far edges of a bounded source.
+    // Returns false if the cell is entirely outside a bounded source.
+    bool getCellMeshSize(glm::ivec2 startIndices, glm::ivec2& size) const
+    {
+        size = glm::ivec2(getCellSize());
 
-    // The corner defining the mesh's location in world space.
-    glm::vec2 startPos {};
+        if (heightSource.isBounded())
+        {
+            glm::ivec2 sourceSize { heightSource.getSize() };
 
-    // Set to true while the mesh is loading so that it's not rendered mid-load.
-    bool loading { false };
+            if (startIndices.x < 0 || startIndices.y < 0 || startIndices.x >= sourceSize.x || startIndices.y >= sourceSize.y)
+            {
+                return false;
+            }
 
-    // Set to false while the cell is inactive so that it's not rendered.
-    bool live { false };
+            // Clamp the size to the bounds of the source.
+            size = glm::min(size, sourceSize - startIndices - 1);
+        }
 
-    // Set to true after loading to refresh the VBO.
-    bool needsVBORefresh { false };
+        return true;
+    }
 
-    void draw()
+    // Samples the heights for a cell into its tile: (cellSize + 3) x (cellSize + 3) samples starting one pixel before the cell.
+    void sampleHeightTileForTerrainCell(ofShortPixels& heightTile, glm::ivec2 startIndices) const
     {
-        // Update VBO if necessary
-        if (needsVBORefresh)
+        unsigned int tileSize { getCellSize() + 3 };
+
+        if (!heightTile.isAllocated() || heightTile.getWidth() != tileSize)
         {
-            terrainVBO.setMesh(terrainMesh, GL_DYNAMIC_DRAW);
-            needsVBORefresh = false;
+            heightTile.allocate(tileSize, tileSize, 1);
         }
 
-        // Draw the cell.
-        terrainVBO.drawElements(GL_TRIANGLES, terrainVBO.getNumIndices());
+        heightSource.sampleHeights(startIndices - 1, glm::ivec2(tileSize), heightTile.getData());
     }
-};
 
-// A template class for managing partial terrain meshes, 
-// automatically loading and unloading cells as they go in and out of draw range.
-template<unsigned int CELL_PAIRS_PER_DIMENSION>
-class CellManager
-{
-public:
-    CellManager(const ofShortImage& heightmap, float heightmapScale, unsigned int cellSize)
-        : heightmap{ heightmap }, heightmapScale{ heightmapScale }, cellSize{ cellSize }
+    // Builds the mesh for a particular cell of the terrain from its height tile.
+    // The first parameter is a reference to the mesh to be initialized.
+    // The second parameter is the cell's height tile, from sampleHeightTileForTerrainCell().
+    // The third parameter is the coordinates (pixel indices) of the cell to load.
+    // The fourth parameter is the dimensions (in pixels) of the mesh.
+    // The fifth parameter is the level of detail; the mesh uses every (2 ^ levelOfDetail)th sample.
+    void buildMeshForTerrainCell(ofMesh& terrainMesh, const ofShortPixels& heightTile, glm::ivec2 startIndices, glm::ivec2 size,
+        unsigned int levelOfDetail) const
     {
-    }
+        int step { 1 << levelOfDetail };
+        glm::ivec2 quads { glm::max(size / step, glm::ivec2(1)) };
+        ofShortPixels coarseTile {};
 
-    // Don't support copy constructor or copy assignment operator.
-    CellManager(const CellManager& c) = delete;
-    CellManager& operator= (const CellManager& c) = delete;
+        if (step > 1)
+        {
+            // Pick out every step-th sample, keeping a border sample on each side.
+            // The border samples are only one pixel out rather than a whole step, so the normals along cell edges are approximate.
+            int maxIndex { static_cast<int>(heightTile.getWidth()) - 1 };
+            coarseTile.allocate(quads.x + 3, quads.y + 3, 1);
 
-    // This function should be called in your ofApp::setup() function.  
-    // Pass in whatever position you want the loaded terrain to be centered around.
-    void initializeForPosition(glm::vec3 position)
-    {
-        // The range of loaded cells should be centered on the player.
-        glm::vec2 cellGridMidIndices { glm::round(glm::vec2(position.x, position.z) / cellSize) };
+            for (int y { 0 }; y < quads.y + 3; y++)
+            {
+                int sourceY { y == 0 ? 0 : std::min(1 + (y - 1) * step, maxIndex) };
 
-        // Calculate the actual start position of the first cell in the loaded grid.
-        cellGridStartPos = (cellGridMidIndices - glm::vec2(CELL_PAIRS_PER_DIMENSION)) * cellSize;
+                for (int x { 0 }; x < quads.x + 3; x++)
+                {
+                    int sourceX { x == 0 ? 0 : std::min(1 + (x - 1) * step, maxIndex) };
+                    coarseTile.getData()[y * (quads.x + 3) + x] = heightTile.getData()[sourceY * heightTile.getWidth() + sourceX];
+                }
+            }
+        }
 
-        // Load each cell.
-        unsigned int bufferIndex { 0 };
-        for (unsigned int i { 0 }; i < 2 * CELL_PAIRS_PER_DIMENSION; i++)
+        // Full cells at full detail can use the builder specialized for the cell size, if it's fixed.
+        if (step == 1 && size == glm::ivec2(getCellSize()) && meshOptions.smoothNormals
+            && buildFixedSizeCellMesh(terrainMesh, heightTile, startIndices, std::integral_constant<bool, CELL_SIZE != 0>()))
         {
-            for (unsigned int j { 0 }; j < 2 * CELL_PAIRS_PER_DIMENSION; j++)
-            {
-                initCell(cellBuffer[bufferIndex], (cellGridStartPos + glm::vec2(i, j) * cellSize));
-                bufferIndex++;
-            }
+            return;
         }
 
-        // Start cell loading thread
-        cellLoadThread = std::thread 
+        // Use buildTerrainMesh() to initialize or re-initialize the mesh, skipping the tile's border.
+        // The scale parameter taken by buildTerrainMesh needs to be relative to the dimensions of the heightmap
+        buildTerrainMesh(terrainMesh, step > 1 ? coarseTile : heightTile, 1, 1, 1 + quads.x, 1 + quads.y,
+            glm::vec3(step, heightmapScale, step), meshOptions);
+
+        // Move the mesh from tile coordinates to the cell's place in the world.
+        glm::vec3 offset { startIndices.x - step, 0, startIndices.y - step };
+        for (glm::vec3& vertex : terrainMesh.getVertices())
         {
-            [&] () 
-            { 
-                while (!stopping) 
-                { 
-                    processLoadQueue(); 
+            vertex += offset;
+        }
+    }
 
-                    if (cellLoadQueue.empty())
-                    {
-                        // Sleep for 0.1 seconds if the load queue is empty.
-                        std::this_thread::sleep_for(std::chrono::milliseconds(10));
-                    }
-                } 
-            }
-        };
+    // Builds a full cell's mesh with buildTerrainCellMesh<CELL_SIZE>(), in the same place and layout as buildMeshForTerrainCell().
+    // Returns false without building anything if the cell size isn't fixed.
+    bool buildFixedSizeCellMesh(ofMesh& terrainMesh, const ofShortPixels& heightTile, glm::ivec2 startIndices, std::true_type) const
+    {
+        buildTerrainCellMesh<CELL_SIZE>(terrainMesh, heightTile.getData(), glm::vec3(1, heightmapScale, 1),
+            glm::vec3(startIndices.x - 1, 0, startIndices.y - 1), meshOptions);
+        return true;
     }
 
-    // This function should be called in your ofApp::update() function to unload cells that have gotten to be far away
-    // and request new cells that have gotten closer.  No meshes are actually loaded in this function;
-    // call processLoadQueue to actually load the meshes.
-    void optimizeForPosition(glm::vec3 position)
+    bool buildFixedSizeCellMesh(ofMesh&, const ofShortPixels&, glm::ivec2, std::false_type) const
+    {
+        return false;
+    }
+
+    // Builds a cell's mesh from its height tile at the current level of detail.
+    void buildCellGeometry(Cell& cell, glm::ivec2 startIndices)
     {
-        // Calculate a lower bound (in each dimension) on where the lower grid can start.
-        glm::vec2 minGridStartIndices { glm::ceil(glm::vec2(position.x, position.z) / cellSize) - glm::vec2(CELL_PAIRS_PER_DIMENSION) };
+        unsigned int levelOfDetail { meshLevelOfDetail };
+        glm::ivec2 meshSize {};
 
-        // Calculate the actual start position of the first cell in the loaded grid at the lower bound in each dimension.
-        glm::vec2 minGridStartPos { minGridStartIndices * cellSize };
+        // Clear the old terrain mesh and rebuild it for the current cell (leaving it empty beyond the edge of a bounded source).
+        cell.terrainMesh.clear();
+        if (getCellMeshSize(startIndices, meshSize))
+        {
+            buildMeshForTerrainCell(cell.terrainMesh, cell.heightTile, startIndices, meshSize, levelOfDetail);
+        }
 
-        // THe actual start position of the first cell in the loaded grid at the upper bound in each dimension.
-        glm::vec2 maxGridStartPos { minGridStartPos + glm::vec2(cellSize) };
+        cell.meshLevelOfDetail = levelOfDetail;
+    }
 
-        // Only move the grid of loaded cells if it's outside of the lower / upper bounds.
-        // This ensures that unnecessary loading doesn't occur.
-        glm::vec2 newGridStartPos { clamp(cellGridStartPos, minGridStartPos, maxGridStartPos) };
+    // Frees a cell's height tile once its mesh is built (it's sampled again if the cell is edited) and marks the mesh for upload.
+    void finishCellMesh(Cell& cell)
+    {
+        cell.heightTile.clear();
+        cell.cpuBytes = getMeshBytes(cell.terrainMesh);
 
-        // Only do something if the grid of loaded cells needs to change.
-        if (newGridStartPos != cellGridStartPos)
+        // VBO needs to be updated
+        cell.needsVBORefresh = true;
+    }
+
+    void buildCellMesh(Cell& cell, glm::ivec2 startIndices)
+    {
+        buildCellGeometry(cell, startIndices);
+
+        if (bakeOcclusion)
         {
-            int bufferIndex { 0 };
+            bakeCellOcclusion(cell, startIndices);
+            applyCellOcclusion(cell, startIndices);
+        }
+
+        finishCellMesh(cell);
+    }
+
+    // Bakes the sky visibility over a cell from the height source, which it samples itself
+    // (the cell's tile doesn't reach far enough), so it can run alongside the rest of the cell's loading.
+    void bakeCellOcclusion(Cell& cell, glm::ivec2 startIndices)
+    {
+        PROFILE_ZONE("CellManager::bakeCellOcclusion");
+        TerrainOcclusion::bake(heightSource, startIndices, glm::ivec2(getCellSize()), heightmapScale / USHRT_MAX, cell.occlusion);
+    }
+
+    // Stores the baked visibility in the lengths of the mesh's normals, then frees it.
+    void applyCellOcclusion(Cell& cell, glm::ivec2 startIndices)
+    {
+        TerrainOcclusion::apply(cell.terrainMesh, startIndices, glm::ivec2(getCellSize()), cell.occlusion);
+        cell.occlusion = std::vector<float>();
+    }
 
-            if (newGridStartPos.x > cellGridStartPos.x)
+    // Finds the lowest and highest heights within a cell's tile, scaled the same way as the cell's mesh.
+    void findHeightBoundsForTerrainCell(Cell& cell) const
+    {
+        const ofShortPixels& heightTile { cell.heightTile };
+        unsigned int tileSize { getCellSize() + 3 };
+        unsigned short minValue { USHRT_MAX };
+        unsigned short maxValue { 0 };
+
+        // Samples past the edge of a bounded source repeat the edge, so including them keeps the bounds conservative.
+        for (unsigned int y { 1 }; y <= getCellSize() + 1; y++)
+        {
+            for (unsigned int x { 1 }; x <= getCellSize() + 1; x++)
             {
-                // Loop in case a cell was skipped over (only for very fast movement; usually will only run once).
-                for (float x { cellGridStartPos.x + cellSize }; x <= newGridStartPos.x + 0.00001f; x += cellSize)
-                {
-                    // Add new cells to the right of the old active region
-                    for (unsigned int j { 0 }; j < 2 * CELL_PAIRS_PER_DIMENSION; j++)
-                    {
-                        cellLoadQueue.push(glm::vec2(x, newGridStartPos.y) + glm::vec2(2 * CELL_PAIRS_PER_DIMENSION - 1, j) * cellSize);
-                    }
-                }
+                unsigned short value { heightTile.getData()[y * tileSize + x] };
+                minValue = std::min(minValue, value);
+                maxValue = std::max(maxValue, value);
             }
-            else if (newGridStartPos.x < cellGridStartPos.x)
+        }
+
+        cell.minHeight = minValue / static_cast<float>(USHRT_MAX) * heightmapScale;
+        cell.maxHeight = maxValue / static_cast<float>(USHRT_MAX) * heightmapScale;
+    }
+
+    // Builds a cell's water from its height tile, once its height bounds are known.
+    void buildCellWater(Cell& cell, glm::ivec2 startIndices)
+    {
+        ofMesh water {};
+        glm::ivec2 meshSize {};
+
+        if (cell.minHeight < waterHeight && getCellMeshSize(startIndices, meshSize))
+        {
+            // Build in tile coordinates, skipping the border, then move to the cell's place in the world.
+            buildWaterMesh(water, cell.heightTile, 1, 1, 1 + meshSize.x, 1 + meshSize.y, glm::vec3(1, heightmapScale, 1),
+                waterHeight, WATER_BLOCK_SIZE);
+
+            glm::vec3 offset { startIndices.x - 1, 0, startIndices.y - 1 };
+            for (glm::vec3& vertex : water.getVertices())
             {
-                // Loop in case a cell was skipped over (only for very fast movement; usually will only run once).
-                for (float x { cellGridStartPos.x - cellSize }; x >= newGridStartPos.x - 0.00001f; x -= cellSize)
-                {
-                    // Add new cells to the left of the old active region
-                    for (unsigned int j { 0 }; j < 2 * CELL_PAIRS_PER_DIMENSION; j++)
-                    {
-                        cellLoadQueue.push(glm::vec2(x, newGridStartPos.y + j * cellSize));
-                    }
-                }
+                vertex += offset;
             }
+        }
 
-            // startX and endX for filling in new rows of cells.
-            float startX, endX;
+        std::lock_guard<std::mutex> lock { refreshMutex };
+        cell.waterMesh = std::move(water);
+        cell.needsWaterRefresh = true;
+        cell.submerged = cell.maxHeight < waterHeight;
+    }
+
+    // Scatters a cell's props from its height tile, once its water height is known.
+    void buildCellProps(Cell& cell, glm::ivec2 startIndices)
+    {
+        if (propTypes.empty())
+        {
+            return;
+        }
+
+        std::vector<std::vector<glm::vec4>> props(propTypes.size());
+        size_t bytes { 0 };
+        glm::ivec2 meshSize {};
 
-            // Don't do the top left corner if we just added an entire left-hand column of cells in the preceding code
-            if (newGridStartPos.x < cellGridStartPos.x)
+        if (getCellMeshSize(startIndices, meshSize))
+        {
+            for (unsigned int type { 0 }; type < propTypes.size(); type++)
             {
-                startX = cellGridStartPos.x;
+                scatterProps(props[type], propTypes[type], type, cell.heightTile, startIndices, meshSize, heightmapScale, waterHeight);
+                bytes += props[type].capacity() * sizeof(glm::vec4);
             }
-            else
+        }
+
+        std::lock_guard<std::mutex> lock { refreshMutex };
+        cell.props = std::move(props);
+        cell.propBytes = bytes;
+        cell.needsPropRefresh = true;
+    }
+
+    // Creates (or grows) every prop type's batch with room for a number of cells.  The new instance buffers don't keep
+    // the old contents, so every live cell's props are uploaded again.
+    void allocatePropBatches(unsigned int slotCount)
+    {
+        propBatches.resize(propTypes.size());
+        propBatchBytes = 0;
+
+        for (size_t type { 0 }; type < propTypes.size(); type++)
+        {
+            PropBatch& batch { propBatches[type] };
+
+            if (batch.vbo.getNumVertices() == 0)
             {
-                startX = newGridStartPos.x;
+                ofMesh mesh {};
+                buildPropMesh(mesh, propTypes[type].shape);
+                batch.vbo.setMesh(mesh, GL_STATIC_DRAW);
             }
 
-            if (newGridStartPos.x > cellGridStartPos.x)
+            batch.capacity = getPropCapacity(propTypes[type], getCellSize());
+            size_t instanceBytes { static_cast<size_t>(slotCount) * batch.capacity * sizeof(glm::vec4) };
+            batch.instances.allocate(instanceBytes, GL_DYNAMIC_DRAW);
+            batch.visibleInstances.allocate(instanceBytes, GL_DYNAMIC_DRAW);
+            batch.vbo.setAttributeBuffer(PROP_INSTANCE_ATTRIBUTE, batch.visibleInstances, 4, sizeof(glm::vec4));
+            batch.vbo.setAttributeDivisor(PROP_INSTANCE_ATTRIBUTE, 1);
+            batch.slotCounts.assign(slotCount, 0);
+            batch.drawnSlots.clear();
+            batch.drawnCount = 0;
+
+            propBatchBytes += instanceBytes * 2
+                + batch.vbo.getNumVertices() * 2 * sizeof(glm::vec3) + batch.vbo.getNumIndices() * sizeof(ofIndexType);
+        }
+
+        propSlotCount = slotCount;
+        propSlotsFilled.assign(slotCount, false);
+    }
+
+    // Replaces the props in a cell's slot of every batch.
+    void uploadPropSlot(unsigned int slot, const std::vector<std::vector<glm::vec4>>& props)
+    {
+        for (size_t type { 0 }; type < propBatches.size(); type++)
+        {
+            PropBatch& batch { propBatches[type] };
+            unsigned int count { type < props.size() ? std::min(static_cast<unsigned int>(props[type].size()), batch.capacity) : 0 };
+
+            if (count > 0)
             {
-                endX = cellGridStartPos.x + (2 * CELL_PAIRS_PER_DIMENSION - 1) * cellSize;
+                batch.instances.updateData(static_cast<GLintptr>(slot) * batch.capacity * sizeof(glm::vec4),
+                    count * sizeof(glm::vec4), props[type].data());
             }
-            else
+
+            batch.slotCounts[slot] = count;
+        }
+    }
+
+    // Brings a live cell up to date with an edited region of the heightmap.
+    // Runs on a worker while the cell is marked as loading, so that the render thread doesn't upload or discard the mesh
+    // and tile as they're changed.
+    void refreshCellRegion(Cell& cell, glm::ivec2 regionMin, glm::ivec2 regionMax)
+    {
+        glm::ivec2 start { round(cell.startPos) };
+        glm::ivec2 meshSize {};
+        if (!getCellMeshSize(start, meshSize))
+        {
+            return;
+        }
+
+        // Skip cells that don't overlap the region.
+        glm::ivec2 end { start + meshSize };
+        if (regionMax.x < start.x || regionMax.y < start.y || regionMin.x > end.x || regionMin.y > end.y)
+        {
+            return;
+        }
+
+        sampleHeightTileForTerrainCell(cell.heightTile, start);
+
+        // The bounds have to stay conservative for occlusion culling, so recalculate them over the whole cell.
+        findHeightBoundsForTerrainCell(cell);
+        buildCellWater(cell, start);
+        buildCellProps(cell, start);
+
+        if (renderMode == CellRenderMode::HeightTexture)
+        {
+            cell.cpuBytes = cell.heightTile.size() * sizeof(unsigned short);
+            cell.needsTileUpload = true;
+        }
+        else if (!meshOptions.smoothNormals || cell.meshLevelOfDetail != 0 || cell.terrainMesh.getNumVertices() == 0)
+        {
+            // Flat-normal meshes don't share vertices, lower detail meshes skip pixels, and discarded meshes are gone,
+            // so none of them can be patched in place; rebuild the whole cell.
+            buildCellMesh(cell, start);
+        }
+        else
+        {
+            // The mesh was built from the tile, so the region needs to be in tile coordinates too.
+            glm::ivec2 tileOffset { 1 - start };
+            std::pair<size_t, size_t> range { updateTerrainMeshRegion(cell.terrainMesh, cell.heightTile,
+                1, 1, 1 + meshSize.x, 1 + meshSize.y, glm::vec3(1, heightmapScale, 1), regionMin + tileOffset, regionMax + tileOffset) };
+
+            if (bakeOcclusion && range.second > range.first)
             {
-                endX = newGridStartPos.x + (2 * CELL_PAIRS_PER_DIMENSION - 1) * cellSize;
+                // The edit shades everything within the occlusion radius, and the patched normals lost their baked term,
+                // so bake the whole cell again.
+                bakeCellOcclusion(cell, start);
+                applyCellOcclusion(cell, start);
+                range = { 0, cell.terrainMesh.getNumVertices() };
             }
 
-            if (newGridStartPos.y > cellGridStartPos.y)
+            // Merge with any range that hasn't been uploaded yet.
+            std::lock_guard<std::mutex> lock { refreshMutex };
+
+            if (cell.dirtyVertexEnd > cell.dirtyVertexBegin)
             {
-                // Loop in case a cell was skipped over (only for very fast movement; usually will only run once).
-                for (float y { cellGridStartPos.y + cellSize }; y <= newGridStartPos.y + 0.00001f; y += cellSize)
-                {
-                    // Add the top cells
-                    for (float x { startX }; x <= endX + 0.00001f; x += cellSize)
-                    {
-                        cellLoadQueue.push(glm::vec2(x, y + (2 * CELL_PAIRS_PER_DIMENSION - 1) * cellSize));
-                    }
-                }
+                cell.dirtyVertexBegin = std::min(cell.dirtyVertexBegin, range.first);
+                cell.dirtyVertexEnd = std::max(cell.dirtyVertexEnd, range.second);
             }
-            else if (newGridStartPos.y < cellGridStartPos.y)
+            else
             {
-                // Loop in case a cell was skipped over (only for very fast movement; usually will only run once).
-                for (float y { cellGridStartPos.y - cellSize }; y >= newGridStartPos.y - 0.00001f; y -= cellSize)
-                {
-                    // Add the bottom cells
-                    for (float x { startX }; x <= endX + 0.00001f; x += cellSize)
-                    {
-                        cellLoadQueue.push(glm::vec2(x, y));
-                    }
-                }
+                cell.dirtyVertexBegin = range.first;
+                cell.dirtyVertexEnd = range.second;
             }
 
-            // Update the starting coordinates of the new grid of loaded cells.
-            cellGridStartPos = newGridStartPos;
+            cell.heightTile.clear();
         }
     }
 
-    // This function iterates over all the available cells and draws all of them that are within the draw 
-    // distance from the current camera position. This should be called from your ofApp::draw() function.  
-    // The draw distance should be the same as the far plane from your projection matrix.
-    void drawActiveCells(glm::vec3 camPosition, float drawDistance)
+    bool isCellBusy(unsigned int index) const
     {
-        // Calculate an appropriate threshold for deciding if cells are too far away to draw.
-        float threshold = drawDistance + cellSize * glm::sqrt(0.5f);
+        return cellTasks[index] && !cellTasks[index]->isFinished();
+    }
 
-        for (Cell& cell : cellBuffer)
+    // Waits for every cell's work in progress to finish.
+    void waitForCellTasks()
+    {
+        for (const TaskHandle& task : cellTasks)
         {
-            // Make sure the cell is live/active and check the distance from the cell center to the camera position
-            if (cell.live && distance(glm::vec2(camPosition.x, camPosition.z), cell.startPos + cellSize * 0.5f) < threshold)
+            if (task)
             {
-                cell.draw();
+                TaskScheduler::getShared().wait(task);
             }
         }
     }
 
-    // This function stops the cell loading thread and should be called from ofApp::exit().
-    void stop()
+    // The most cells loading at once, so that streaming doesn't crowd other work off the scheduler.
+    unsigned int getMaxLoadsInFlight() const
     {
-        // Stop the cell load thread before other resources are destroyed.
-        stopping = true;
-        cellLoadThread.join();
+        return 2 * (TaskScheduler::getShared().getWorkerCount() + 1);
     }
 
-private:
-    // The maximum number of cells that can be currently loaded at once.
-    const static unsigned int CELL_BUFFER_SIZE { 4 * CELL_PAIRS_PER_DIMENSION * CELL_PAIRS_PER_DIMENSION };
+    // Hands the cell work that's ready to go to the task scheduler.  This runs on the main thread,
+    // which owns the cell buffer's bookkeeping; the tasks only touch the cells they were started for.
+    void scheduleCellWork()
+    {
+        PROFILE_ZONE("CellManager::scheduleCellWork");
 
-    // The buffer of loaded cells.
-    Cell cellBuffer[CELL_BUFFER_SIZE] {};
+        scheduleEdits();
+        scheduleRebuilds();
+        scheduleLoads();
+    }
 
-    // A reference to the pixel array containing the world heightmap.
-    const ofShortImage& heightmap{ nullptr };
+    // Starts loading a cell as a chain of tasks: fetch the height tile, then find the height bounds (and with them the water
+    // and props) and build the mesh side by side (with the occlusion bake alongside them, if enabled), then make the cell live.
+    // (The mesh stage does the normals too, since buildTerrainMesh() makes both at once.)
+    void startCellLoad(unsigned int index, glm::vec2 startPos)
+    {
+        Cell& cell { cellBuffer[index] };
 
-    float heightmapScale;
+        // Set cell's starting position, it is current loading and not yet live.
+        cell.startPos = startPos;
+        cell.live = false;
+        cell.loading = true;
+        cell.needsRebuild = false;
+        cell.hasPendingEdit = false;
+        cell.uploadedPool = -1;
+
+        // Remap to the resolution of the heightmap and round to the nearest integer
+        glm::ivec2 startIndices { round(glm::vec2(startPos.x, startPos.y)) };
+        TaskScheduler& scheduler { TaskScheduler::getShared() };
 
-    // The size of each cell (assumed to be square).
-    unsigned int cellSize;
+        TaskHandle fetch { scheduler.submit([this, &cell, startIndices] ()
+        {
+            PROFILE_ZONE("CellManager::fetchCellTile");
+            sampleHeightTileForTerrainCell(cell.heightTile, startIndices);
+        }) };
 
-    // The "first" cell that is currently loaded; the corner of the rectangle of loaded cells.
-    glm::vec2 cellGridStartPos;
+        // The height bounds are used for occlusion culling, and to decide where the cell needs water.
+        std::vector<TaskHandle> stages { scheduler.submit([this, &cell, startIndices] ()
+        {
+            findHeightBoundsForTerrainCell(cell);
+            buildCellWater(cell, startIndices);
+            buildCellProps(cell, startIndices);
+        }, TaskPriority::Normal, { fetch }) };
 
-    // A queue containing the corners of cells that need to be loaded.
-    std::queue<glm::vec2> cellLoadQueue {};
+        if (renderMode == CellRenderMode::Mesh)
+        {
+            stages.push_back(scheduler.submit([this, &cell, startIndices] ()
+            {
+                PROFILE_ZONE("CellManager::buildCellMesh");
+                buildCellGeometry(cell, startIndices);
+            }, TaskPriority::Normal, { fetch }));
 
-    // Thread to load cells in the background.
-    std::thread cellLoadThread {};
+            // The occlusion samples its own heights, so it doesn't need to wait for the fetch.
+            if (bakeOcclusion)
+            {
+                stages.push_back(scheduler.submit([this, &cell, startIndices] ()
+                {
+                    bakeCellOcclusion(cell, startIndices);
+                }));
+            }
+        }
 
-    // Flag to signal the cell loading thread to stop.
-    bool stopping {};
+        cellTasks[index] = scheduler.submit([this, &cell, startIndices] ()
+        {
+            if (renderMode == CellRenderMode::HeightTexture)
+            {
+                // Only the heights are needed; the vertex shader does the rest.
+                cell.cpuBytes = cell.heightTile.size() * sizeof(unsigned short);
+                cell.needsTileUpload = true;
+            }
+            else
+            {
+                if (bakeOcclusion)
+                {
+                    applyCellOcclusion(cell, startIndices);
+                }
 
-    bool isCellDistant(glm::vec2 cellStartPos)
-    {
-        // Distant cells are outside of the rectangle of cells currently loaded.
-        return cellStartPos.x < cellGridStartPos.x - cellSize * 0.125f // subtract a little extra to account for round-off error
-            || cellStartPos.y < cellGridStartPos.y - cellSize * 0.125f
-            || cellStartPos.x + cellSize > cellGridStartPos.x + cellSize * (2 * CELL_PAIRS_PER_DIMENSION + 0.125f)
-            || cellStartPos.y + cellSize > cellGridStartPos.y + cellSize * (2 * CELL_PAIRS_PER_DIMENSION + 0.125f);
+                finishCellMesh(cell);
+            }
+
+            // Once the cell has been successfully loaded, make it live.
+            cell.loading = false;
+            cell.live = true;
+            cellsLoaded++;
+            PROFILE_COUNTER("Cells built", cellsLoaded);
+        }, TaskPriority::Normal, stages);
     }
 
-    bool isCellDuplicate(glm::vec2 cellStartPos, float tolerance)
+    // Rebuilds the meshes of live cells in the background after the level of detail has changed.
+    void scheduleRebuilds()
     {
-        for (Cell& otherCell : cellBuffer)
+        for (unsigned int i { 0 }; i < CELL_BUFFER_SIZE; i++)
         {
-            // If two cells' start position is within a certain tolerance, they are considered duplicates.
-            if (distance(otherCell.startPos, cellStartPos) < tolerance)
+            Cell& cell { cellBuffer[i] };
+
+            if (!cell.live || !cell.needsRebuild || isCellBusy(i))
             {
-                return true;
+                continue;
             }
-        }
 
-        return false;
+            // Keep the render thread away from the mesh while it's rebuilt.
+            // Sampling the tile again picks up any edits waiting for the cell too.
+            cell.loading = true;
+            cell.needsRebuild = false;
+            cell.hasPendingEdit = false;
+            glm::ivec2 startIndices { round(cell.startPos) };
+
+            cellTasks[i] = TaskScheduler::getShared().submit([this, &cell, startIndices] ()
+            {
+                PROFILE_ZONE("CellManager::rebuildCell");
+                sampleHeightTileForTerrainCell(cell.heightTile, startIndices);
+                findHeightBoundsForTerrainCell(cell);
+                buildCellWater(cell, startIndices);
+                buildCellProps(cell, startIndices);
+
+                // Start from a new mesh so that the memory held by the old, more detailed one is freed.
+                cell.terrainMesh = ofMesh();
+                buildCellMesh(cell, startIndices);
+                cell.loading = false;
+            }, TaskPriority::Low);
+        }
     }
 
-    // Builds the mesh for a particular cell of the terrain.
-    // The first parameter is a reference to the mesh to be initialized.
-    // The second parameter is the coordinates (pixel indices) of the cell to load.
-    // The third parameter is the dimensions (in pixels) of the cell to load.
-    void buildMeshForTerrainCell(ofMesh& terrainMesh, glm::uvec2 startPos, glm::uvec2 size) const
+    // Starts bringing cells up to date with edited regions of the heightmap.
+    // Edits are merged per cell, and a cell that's busy with other work keeps them until it's free.
+    void scheduleEdits()
     {
-        if (startPos.x < heightmap.getWidth() && startPos.y < heightmap.getHeight())
+        std::vector<HeightmapRegion> edits {};
+
+        {
+            std::lock_guard<std::mutex> lock { editMutex };
+            std::swap(edits, pendingEdits);
+        }
+
+        for (const HeightmapRegion& edit : edits)
         {
-            // Clamp the size to the bounds of the heightmap
-            size = glm::min(size, glm::uvec2(heightmap.getWidth(), heightmap.getHeight()) - startPos - 1u);
+            // Normals depend on the neighbouring pixels, so the pixels just outside the edit change too.
+            // Baked occlusion looks much further, so with it, everything within its radius of the edit is shaded differently.
+            int padding { bakeOcclusion && renderMode == CellRenderMode::Mesh ? static_cast<int>(TerrainOcclusion::RADIUS) : 1 };
+            glm::ivec2 regionMin { edit.min - padding };
+            glm::ivec2 regionMax { edit.max + padding };
 
-            // Use buildTerrainMesh() to initialize or re-initialize the mesh.
-            // The scale parameter taken by buildTerrainMesh needs to be relative to the dimensions of the heightmap
-            buildTerrainMesh(terrainMesh, heightmap.getPixels(), startPos.x, startPos.y, startPos.x + size.x, startPos.y + size.y, glm::vec3(1, heightmapScale, 1));
+            // Loading cells may have sampled their heights before the edit, so they get it too.
+            for (Cell& cell : cellBuffer)
+            {
+                if (!(cell.live || cell.loading))
+                {
+                    continue;
+                }
+
+                glm::ivec2 start { round(cell.startPos) };
+                if (regionMax.x < start.x || regionMax.y < start.y
+                    || regionMin.x > start.x + static_cast<int>(getCellSize()) || regionMin.y > start.y + static_cast<int>(getCellSize()))
+                {
+                    continue;
+                }
+
+                cell.pendingEditMin = cell.hasPendingEdit ? glm::min(cell.pendingEditMin, regionMin) : regionMin;
+                cell.pendingEditMax = cell.hasPendingEdit ? glm::max(cell.pendingEditMax, regionMax) : regionMax;
+                cell.hasPendingEdit = true;
+            }
         }
-    }
-    
-    void initCell(Cell& cell, glm::vec2 startPos)
-    {
-        // Set cell's starting position, it is current loading and not yet live.
-        cell.startPos = startPos;
-        cell.live = false;
-        cell.loading = true;
-        // Remap to the resolution of the heightmap and round to the nearest integer
-        glm::uvec2 startIndices { round(glm::vec2(startPos.x, startPos.y)) };
 
-        // Clear the old terrain mesh and rebuild it for the current cell.
-        cell.terrainMesh.clear();
-        buildMeshForTerrainCell(cell.terrainMesh, startIndices, glm::uvec2(cellSize, cellSize));
+        for (unsigned int i { 0 }; i < CELL_BUFFER_SIZE; i++)
+        {
+            Cell& cell { cellBuffer[i] };
 
-        // VBO needs to be updated
-        cell.needsVBORefresh = true;
+            // A mesh or tile that hasn't been uploaded yet is still the render thread's to read (and maybe discard),
+            // so the edit waits for it.
+            if (!cell.hasPendingEdit || !cell.live || cell.loading || isCellBusy(i) || cell.needsVBORefresh || cell.needsTileUpload)
+            {
+                continue;
+            }
+
+            glm::ivec2 regionMin { cell.pendingEditMin };
+            glm::ivec2 regionMax { cell.pendingEditMax };
+            cell.hasPendingEdit = false;
+
+            // Keep the render thread away from the mesh and tile while they're changed, as for rebuilds.
+            cell.loading = true;
 
-        // Once the cell has been successfully loaded, make it live.
-        cell.loading = false;
-        cell.live = true;
+            // Edits are interactive, so they go ahead of streaming.
+            cellTasks[i] = TaskScheduler::getShared().submit([this, &cell, regionMin, regionMax] ()
+            {
+                PROFILE_ZONE("CellManager::refreshCell");
+                refreshCellRegion(cell, regionMin, regionMax);
+                cell.loading = false;
+            }, TaskPriority::High);
+        }
     }
 
-    // This function is called from the cell loading thread.
-    // This function is where the terrain meshes actually get created.
-    void processLoadQueue()
+    // Unloads cells that no observer needs any more and starts loading requested cells.
+    void scheduleLoads()
     {
-        if (!cellLoadQueue.empty())
+        if (observersChanged || !cellLoadQueue.empty())
         {
-            // Deactivate cells that are now out of range.
-            for (Cell& cell : cellBuffer)
+            observersChanged = false;
+
+            // Deactivate cells that are now out of range of every observer, freeing their CPU copies
+            // so that memory follows the area the observers cover.
+            for (unsigned int i { 0 }; i < CELL_BUFFER_SIZE; i++)
             {
-                if (isCellDistant(cell.startPos))
+                Cell& cell { cellBuffer[i] };
+
+                if (cell.live && isCellDistant(cell.startPos))
                 {
+                    if (isCellBusy(i))
+                    {
+                        // Try again once the cell's task is done with it.
+                        observersChanged = true;
+                        continue;
+                    }
+
                     cell.live = false;
+                    cell.terrainMesh = ofMesh();
+                    cell.heightTile.clear();
+
+                    std::lock_guard<std::mutex> lock { refreshMutex };
+                    cell.waterMesh = ofMesh();
+                    cell.props = std::vector<std::vector<glm::vec4>>();
+                    cell.propBytes = 0;
+                    cell.needsPropRefresh = false;
+                    cell.cpuBytes = 0;
                 }
             }
+        }
+
+        unsigned int loadsInFlight { 0 };
+        for (const Cell& cell : cellBuffer)
+        {
+            if (cell.loading)
+            {
+                loadsInFlight++;
+            }
+        }
+
+        unsigned int bufferIndex { 0 };
 
-            unsigned int bufferIndex { 0 };
+        while (!cellLoadQueue.empty() && loadsInFlight < getMaxLoadsInFlight())
+        {
+            glm::vec2 cellStartPos { cellLoadQueue.front() };
 
-            // Check to ensure that there are available cells in the buffer and that there are still cell requests left to process.
-            if (bufferIndex < CELL_BUFFER_SIZE && !cellLoadQueue.empty())
+            // Make sure we still want the cell
+            if (!isCellDistant(cellStartPos) && !isCellDuplicate(cellStartPos, getCellSize() * 0.125f))
             {
                 // Find the next unused cell in the buffer.
-                while (bufferIndex < CELL_BUFFER_SIZE && (cellBuffer[bufferIndex].live || cellBuffer[bufferIndex].loading))
+                while (bufferIndex < CELL_BUFFER_SIZE && (cellBuffer[bufferIndex].live || cellBuffer[bufferIndex].loading || isCellBusy(bufferIndex)))
                 {
                     bufferIndex++;
                 }
 
-                if (bufferIndex < CELL_BUFFER_SIZE)
+                if (bufferIndex == CELL_BUFFER_SIZE)
                 {
-                    if (!isCellDistant(cellLoadQueue.front())
-                        && !isCellDuplicate(cellLoadQueue.front(), cellSize * 0.125f)) // Make sure we still want the cell
-                    {
-
-                        // Load the next requested cell.
-                        initCell(cellBuffer[bufferIndex], cellLoadQueue.front());
-                    }
-
-                    cellLoadQueue.pop();
+                    // Leave the request queued until a cell is unloaded.
+                    break;
                 }
+
+                startCellLoad(bufferIndex, cellStartPos);
+                loadsInFlight++;
             }
+
+            cellLoadQueue.pop();
+            cellsDequeued++;
         }
     }
 };
@@ -0,0 +1,218 @@
+#include "CharacterCrowd.h"
+#include "TaskScheduler.h"
+#include <chrono>
+
+using namespace std::chrono;
+
+namespace
+{
+    // The number of characters each thread takes at a time.
+    const size_t CHUNK_SIZE { 1024 };
+
+    // Halves a terrain cell for as long as the grid cells stay at least a capsule wide,
+    // so that overlapping capsules are always in the same or neighbouring grid cells.
+    float getGridCellSize(float radius, float terrainCellSize)
+    {
+        float cellSize { terrainCellSize };
+        while (cellSize * 0.5f >= radius * 2)
+        {
+            cellSize *= 0.5f;
+        }
+
+        return cellSize;
+    }
+
+    // Gets the lowest and highest points of the line running down the middle of a character's capsule.
+    glm::vec2 getCapsuleCore(glm::vec3 head, float characterHeight, float radius)
+    {
+        float low { head.y - characterHeight + radius };
+        float high { head.y - radius };
+
+        // A character shorter than a capsule is wide is a sphere around their middle.
+        if (low > high)
+        {
+            low = high = head.y - characterHeight * 0.5f;
+        }
+
+        return glm::vec2(low, high);
+    }
+
+    double getMilliseconds(steady_clock::time_point start, steady_clock::time_point end)
+    {
+        return duration<double, std::milli>(end - start).count();
+    }
+}
+
+CharacterCrowd::CharacterCrowd(const World& world, float radius, float terrainCellSize)
+    : world { world }, radius { radius }, broadphase { getGridCellSize(radius, terrainCellSize) }
+{
+}
+
+size_t CharacterCrowd::addCharacter(glm::vec3 position, float characterHeight)
+{
+    characters.emplace_back(world);
+
+    CharacterPhysics& character { characters.back() };
+    character.setCharacterHeight(characterHeight);
+    character.setPosition(glm::vec3(position.x, std::max(position.y, characterHeight + world.getTerrainHeightAtPosition(position)), position.z));
+
+    return characters.size() - 1;
+}
+
+size_t CharacterCrowd::getCharacterCount() const
+{
+    return characters.size();
+}
+
+CharacterPhysics& CharacterCrowd::getCharacter(size_t index)
+{
+    return characters[index];
+}
+
+const CharacterPhysics& CharacterCrowd::getCharacter(size_t index) const
+{
+    return characters[index];
+}
+
+float CharacterCrowd::getRadius() const
+{
+    return radius;
+}
+
+const CrowdStats& CharacterCrowd::getLastStats() const
+{
+    return lastStats;
+}
+
+void CharacterCrowd::update(float dt, unsigned int threadCount)
+{
+    TaskScheduler& scheduler { TaskScheduler::getShared() };
+    size_t count { characters.size() };
+    positions.resize(count);
+    pushes.resize(count);
+
+    CrowdStats stats {};
+    steady_clock::time_point start { steady_clock::now() };
+
+    // Move everyone against the terrain; characters don't affect each other here.
+    scheduler.parallelFor(count, CHUNK_SIZE, [&] (size_t begin, size_t end)
+    {
+        for (size_t i { begin }; i < end; i++)
+        {
+            characters[i].update(dt);
+            positions[i] = characters[i].getPosition();
+        }
+    }, threadCount);
+
+    steady_clock::time_point moved { steady_clock::now() };
+    broadphase.build(positions, threadCount);
+
+    const std::vector<uint32_t>& sortedIndices { broadphase.getSortedIndices() };
+    sortedBodies.resize(count);
+
+    scheduler.parallelFor(count, CHUNK_SIZE, [&] (size_t begin, size_t end)
+    {
+        for (size_t slot { begin }; slot < end; slot++)
+        {
+            uint32_t index { sortedIndices[slot] };
+            Body& body { sortedBodies[slot] };
+            body.head = positions[index];
+            body.core = getCapsuleCore(body.head, characters[index].getCharacterHeight(), radius);
+            body.index = index;
+        }
+    }, threadCount);
+
+    steady_clock::time_point sorted { steady_clock::now() };
+
+    std::atomic<uint64_t> pairsTested { 0 };
+    std::atomic<uint64_t> contacts { 0 };
+
+    // Every character finds their own push before anyone moves, so the order characters are handled in doesn't matter.
+    scheduler.parallelFor(count, CHUNK_SIZE, [&] (size_t begin, size_t end)
+    {
+        uint64_t chunkPairsTested { 0 };
+        uint64_t chunkContacts { 0 };
+
+        for (size_t slot { begin }; slot < end; slot++)
+        {
+            pushes[sortedBodies[slot].index] = findPush(static_cast<uint32_t>(slot), chunkPairsTested, chunkContacts);
+        }
+
+        pairsTested += chunkPairsTested;
+        contacts += chunkContacts;
+    }, threadCount);
+
+    scheduler.parallelFor(count, CHUNK_SIZE, [&] (size_t begin, size_t end)
+    {
+        for (size_t i { begin }; i < end; i++)
+        {
+            if (pushes[i] != glm::vec3(0))
+            {
+                // Don't push anyone into a slope.
+                glm::vec3 position { positions[i] + pushes[i] };
+                position.y = std::max(position.y, characters[i].getCharacterHeight() + world.getTerrainHeightAtPosition(position));
+                characters[i].setPosition(position);
+            }
+        }
+    }, threadCount);
+
+    steady_clock::time_point resolved { steady_clock::now() };
+
+    stats.physicsMilliseconds = getMilliseconds(start, moved);
+    stats.broadphaseMilliseconds = getMilliseconds(moved, sorted);
+    stats.resolveMilliseconds = getMilliseconds(sorted, resolved);
+    stats.pairsTested = pairsTested;
+    stats.contacts = contacts;
+    lastStats = stats;
+}
+
+glm::vec3 CharacterCrowd::findPush(uint32_t slot, uint64_t& pairsTested, uint64_t& contacts) const
+{
+    const Body& body { sortedBodies[slot] };
+    float minDistance { radius * 2 };
+    glm::vec2 push { 0 };
+
+    broadphase.forEachNearby(body.head, [&] (uint32_t otherSlot)
+    {
+        if (otherSlot == slot)
+        {
+            return;
+        }
+
+        pairsTested++;
+
+        const Body& other { sortedBodies[otherSlot] };
+
+        // The gap between the capsules' cores in height; zero if they overlap in height.
+        float verticalGap { std::max(0.0f, std::max(body.core.x, other.core.x) - std::min(body.core.y, other.core.y)) };
+        if (verticalGap >= minDistance)
+        {
+            return;
+        }
+
+        glm::vec2 offset { body.head.x - other.head.x, body.head.z - other.head.z };
+        float horizontalDistanceSquared { glm::dot(offset, offset) };
+
+        // The horizontal distance at which the capsules just touch.
+        float contactDistance { std::sqrt(minDistance * minDistance - verticalGap * verticalGap) };
+        if (horizontalDistanceSquared >= contactDistance * contactDistance)
+        {
+            return;
+        }
+
+        if (other.index > body.index)
+        {
+            contacts++;
+        }
+
+        float horizontalDistance { std::sqrt(horizontalDistanceSquared) };
+
+        // Characters standing exactly on top of each other are split along x, the lower index going towards +x.
+        glm::vec2 direction { horizontalDistance > 1e-6f ? offset / horizontalDistance : glm::vec2(body.index < other.index ? 1.0f : -1.0f, 0.0f) };
+
+        // Each character moves half of the way apart.
+        push += direction * ((contactDistance - horizontalDistance) * 0.5f);
+    });
+
+    return glm::vec3(push.x, 0, push.y);
+}
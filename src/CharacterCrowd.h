@@ -0,0 +1,80 @@
+#pragma once
+#include "ofMain.h"
+#include "CharacterPhysics.h"
+#include "SpatialHash.h"
+
+// How long the last CharacterCrowd update took, and how much colliding it did.
+struct CrowdStats
+{
+    double physicsMilliseconds { 0 };
+    double broadphaseMilliseconds { 0 };
+    double resolveMilliseconds { 0 };
+
+    // Pairs of characters whose capsules were tested against each other (each pair counted from both sides).
+    uint64_t pairsTested { 0 };
+
+    // Pairs of characters found overlapping (each pair counted once).
+    uint64_t contacts { 0 };
+};
+
+// A crowd of characters that collide with the terrain (through CharacterPhysics) and with each other.
+//
+// Each character is an upright capsule of a given radius, running from their feet to their head.  Each update moves
+// every character, then sorts them into a SpatialHash so that only characters in neighbouring grid cells are tested
+// against each other, and pushes overlapping pairs apart horizontally, each by half the overlap.
+// Every character works out its own push from its neighbours and only moves itself, so all three steps run in parallel
+// on the shared TaskScheduler without locking, and the results don't depend on the number of threads.
+//
+// The grid cells are the terrain cells of a CellManager split in half as many times as they can be while staying
+// at least a capsule wide, so grid cell coordinates are terrain cell coordinates scaled by a power of two.
+class CharacterCrowd
+{
+public:
+    // "terrainCellSize" is the CellManager's cell size, in world-space units.
+    CharacterCrowd(const World& world, float radius = 0.5f, float terrainCellSize = 256);
+
+    // Adds a character whose head is at a position in world space (lifted onto the terrain if need be), returning their index.
+    size_t addCharacter(glm::vec3 position, float characterHeight);
+
+    size_t getCharacterCount() const;
+
+    CharacterPhysics& getCharacter(size_t index);
+    const CharacterPhysics& getCharacter(size_t index) const;
+
+    float getRadius() const;
+
+    // Advances every character by dt and separates those that overlap,
+    // with at most "threadCount" threads; 0 lets every worker join in.
+    void update(float dt, unsigned int threadCount = 0);
+
+    const CrowdStats& getLastStats() const;
+
+private:
+    const World& world;
+    float radius;
+
+    std::vector<CharacterPhysics> characters {};
+
+    // A character's capsule, copied into the broadphase's sorted order so that neighbours are close together in memory.
+    struct Body
+    {
+        glm::vec3 head {};
+
+        // The lowest and highest points of the line running down the middle of the capsule.
+        glm::vec2 core {};
+
+        uint32_t index { 0 };
+    };
+
+    // Each character's head position after moving, and then how far they're pushed by their neighbours.
+    std::vector<glm::vec3> positions {};
+    std::vector<glm::vec3> pushes {};
+
+    SpatialHash broadphase;
+    std::vector<Body> sortedBodies {};
+
+    CrowdStats lastStats {};
+
+    // Works out how far the character at a place in the sorted order is pushed by the characters overlapping them.
+    glm::vec3 findPush(uint32_t slot, uint64_t& pairsTested, uint64_t& contacts) const;
+};
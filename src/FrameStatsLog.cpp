@@ -0,0 +1,127 @@
+#include "FrameStatsLog.h"
+#include <fstream>
+
+void FrameStatsLog::clear()
+{
+    frames.clear();
+}
+
+void FrameStatsLog::add(const FrameStats& stats)
+{
+    frames.push_back(stats);
+}
+
+size_t FrameStatsLog::getFrameCount() const
+{
+    return frames.size();
+}
+
+double FrameStatsLog::getPercentile(double FrameStats::* field, double percentile) const
+{
+    if (frames.empty())
+    {
+        return 0;
+    }
+
+    std::vector<double> values {};
+    for (const FrameStats& stats : frames)
+    {
+        values.push_back(stats.*field);
+    }
+
+    // Nearest rank.
+    size_t rank { static_cast<size_t>(std::ceil(percentile / 100 * values.size())) };
+    size_t index { std::min(std::max<size_t>(rank, 1), values.size()) - 1 };
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+bool FrameStatsLog::writeCSV(const std::string& filePath) const
+{
+    std::ofstream file { filePath };
+    file << "frame,time,frameMs,cpuMs,cameraX,cameraY,cameraZ,"
+        << "liveCells,distanceCulled,occluded,drawn,underwater,pendingLoads,cellsLoaded\n";
+
+    for (const FrameStats& stats : frames)
+    {
+        file << stats.frame << ',' << stats.time << ',' << stats.frameMilliseconds << ',' << stats.cpuMilliseconds << ','
+            << stats.cameraPosition.x << ',' << stats.cameraPosition.y << ',' << stats.cameraPosition.z << ','
+            << stats.culling.liveCells << ',' << stats.culling.distanceCulled << ',' << stats.culling.occluded << ','
+            << stats.culling.drawn << ',' << stats.culling.underwater << ',' << stats.streaming.pendingLoads << ',' << stats.streaming.cellsLoaded << '\n';
+    }
+
+    if (!file)
+    {
+        ofLogError("FrameStatsLog") << "Couldn't write " << filePath << ".";
+        return false;
+    }
+
+    return true;
+}
+
+bool FrameStatsLog::writeJSON(const std::string& filePath) const
+{
+    ofJson json {};
+
+    json["summary"] = {
+        { "frames", frames.size() },
+        { "frameMsP50", getPercentile(&FrameStats::frameMilliseconds, 50) },
+        { "frameMsP95", getPercentile(&FrameStats::frameMilliseconds, 95) },
+        { "frameMsP99", getPercentile(&FrameStats::frameMilliseconds, 99) },
+        { "frameMsMax", getPercentile(&FrameStats::frameMilliseconds, 100) },
+        { "cpuMsP50", getPercentile(&FrameStats::cpuMilliseconds, 50) },
+        { "cpuMsP95", getPercentile(&FrameStats::cpuMilliseconds, 95) },
+        { "cpuMsP99", getPercentile(&FrameStats::cpuMilliseconds, 99) },
+        { "cpuMsMax", getPercentile(&FrameStats::cpuMilliseconds, 100) },
+    };
+
+    ofJson frameArray = ofJson::array();
+    for (const FrameStats& stats : frames)
+    {
+        frameArray.push_back({
+            { "frame", stats.frame },
+            { "time", stats.time },
+            { "frameMs", stats.frameMilliseconds },
+            { "cpuMs", stats.cpuMilliseconds },
+            { "camera", { stats.cameraPosition.x, stats.cameraPosition.y, stats.cameraPosition.z } },
+            { "liveCells", stats.culling.liveCells },
+            { "distanceCulled", stats.culling.distanceCulled },
+            { "occluded", stats.culling.occluded },
+            { "drawn", stats.culling.drawn },
+            { "underwater", stats.culling.underwater },
+            { "pendingLoads", stats.streaming.pendingLoads },
+            { "cellsLoaded", stats.streaming.cellsLoaded },
+        });
+    }
+    json["frames"] = frameArray;
+
+    if (!ofSaveJson(filePath, json))
+    {
+        ofLogError("FrameStatsLog") << "Couldn't write " << filePath << ".";
+        return false;
+    }
+
+    return true;
+}
+
+void FrameStatsLog::logSummary() const
+{
+    if (frames.empty())
+    {
+        return;
+    }
+
+    unsigned int maxPendingLoads { 0 };
+    for (const FrameStats& stats : frames)
+    {
+        maxPendingLoads = std::max(maxPendingLoads, stats.streaming.pendingLoads);
+    }
+
+    ofLogNotice("FrameStatsLog") << frames.size() << " frames; frame time p50 " << getPercentile(&FrameStats::frameMilliseconds, 50)
+        << " ms, p95 " << getPercentile(&FrameStats::frameMilliseconds, 95)
+        << " ms, p99 " << getPercentile(&FrameStats::frameMilliseconds, 99)
+        << " ms; CPU time p50 " << getPercentile(&FrameStats::cpuMilliseconds, 50)
+        << " ms, p99 " << getPercentile(&FrameStats::cpuMilliseconds, 99) << " ms";
+    ofLogNotice("FrameStatsLog") << (frames.back().streaming.cellsLoaded - frames.front().streaming.cellsLoaded)
+        << " cells loaded, at most " << maxPendingLoads << " waiting to load";
+}
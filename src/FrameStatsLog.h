@@ -0,0 +1,49 @@
+#pragma once
+#include "ofMain.h"
+#include "CellManager.h"
+
+// Everything measured during one frame of a camera replay.
+struct FrameStats
+{
+    unsigned int frame { 0 };
+
+    // Replay time in seconds; advances by a fixed step every frame.
+    double time { 0 };
+
+    // The wall-clock time since the previous frame, including waiting for the GPU and vsync.
+    double frameMilliseconds { 0 };
+
+    // The CPU time spent in update() and draw() for this frame.
+    double cpuMilliseconds { 0 };
+
+    glm::vec3 cameraPosition {};
+
+    CellCullingStats culling {};
+    CellStreamingStats streaming {};
+};
+
+// Collects per-frame stats during a replay and writes them out for comparing builds.
+class FrameStatsLog
+{
+public:
+    void clear();
+
+    void add(const FrameStats& stats);
+
+    size_t getFrameCount() const;
+
+    // Writes one row per frame.
+    bool writeCSV(const std::string& filePath) const;
+
+    // Writes a summary plus one object per frame.
+    bool writeJSON(const std::string& filePath) const;
+
+    // Logs frame time percentiles and streaming totals.
+    void logSummary() const;
+
+private:
+    std::vector<FrameStats> frames {};
+
+    // Gets a percentile (0 to 100) of one of the per-frame times.
+    double getPercentile(double FrameStats::* field, double percentile) const;
+};
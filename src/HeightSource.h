@@ -0,0 +1,81 @@
+#pragma once
+#include "ofMain.h"
+#include <shared_mutex>
+
+// A source of terrain heights, sampled on an integer grid of pixels.
+// Heights use the same 16-bit range as the heightmap images (0 to USHRT_MAX).
+// Implementations must be safe to sample from several threads at once.
+class HeightSource
+{
+public:
+    virtual ~HeightSource() = default;
+
+    // Fills "heights" with a block of (size.x x size.y) samples starting at "start", row by row.
+    virtual void sampleHeights(glm::ivec2 start, glm::ivec2 size, unsigned short* heights) const = 0;
+
+    // Samples a single pixel.
+    unsigned short sampleHeight(glm::ivec2 pixel) const
+    {
+        unsigned short height { 0 };
+        sampleHeights(pixel, glm::ivec2(1), &height);
+        return height;
+    }
+
+    // Returns true if the source only covers the pixels from (0, 0) to getSize() - 1.
+    // Unbounded sources can be sampled anywhere, including at negative coordinates.
+    virtual bool isBounded() const = 0;
+
+    // The number of pixels in each dimension.
+    // For unbounded sources, this is the nominal area that World::dimensions is measured against.
+    virtual glm::ivec2 getSize() const = 0;
+};
+
+// A height source backed by a heightmap image held in memory.
+// Samples outside the image repeat its edges.
+class HeightmapHeightSource : public HeightSource
+{
+public:
+    // The pixels must outlive the source.  Edits to the pixels (see HeightmapEditor) show up in later samples.
+    // If the pixels are edited while they're being sampled, pass the editor's mutex; each block is sampled holding it shared.
+    HeightmapHeightSource(const ofShortPixels& heightmap, std::shared_timed_mutex* mutex = nullptr)
+        : heightmap { heightmap }, mutex { mutex }
+    {
+    }
+
+    void sampleHeights(glm::ivec2 start, glm::ivec2 size, unsigned short* heights) const override
+    {
+        std::shared_lock<std::shared_timed_mutex> lock {};
+        if (mutex)
+        {
+            lock = std::shared_lock<std::shared_timed_mutex>(*mutex);
+        }
+
+        glm::ivec2 maxIndices { getSize() - 1 };
+        const unsigned short* data { heightmap.getData() };
+
+        for (int y { 0 }; y < size.y; y++)
+        {
+            int sourceY { glm::clamp(start.y + y, 0, maxIndices.y) };
+
+            for (int x { 0 }; x < size.x; x++)
+            {
+                int sourceX { glm::clamp(start.x + x, 0, maxIndices.x) };
+                heights[y * size.x + x] = data[heightmap.getPixelIndex(sourceX, sourceY)];
+            }
+        }
+    }
+
+    bool isBounded() const override
+    {
+        return true;
+    }
+
+    glm::ivec2 getSize() const override
+    {
+        return glm::ivec2(heightmap.getWidth(), heightmap.getHeight());
+    }
+
+private:
+    const ofShortPixels& heightmap;
+    std::shared_timed_mutex* mutex;
+};
@@ -0,0 +1,82 @@
+#include "HeightmapEditor.h"
+
+using namespace glm;
+
+HeightmapEditor::HeightmapEditor(ofShortPixels& heightmap, std::shared_timed_mutex* mutex)
+    : heightmap { heightmap }, mutex { mutex }
+{
+}
+
+void HeightmapEditor::applyBrush(vec2 center, float radius, float amount)
+{
+    applyProfile(center, radius, 1.0f, [amount] (float distance)
+    {
+        // Smoothstep falloff to zero at the edge of the brush.
+        float falloff { 1.0f - smoothstep(0.0f, 1.0f, distance) };
+        return amount * falloff;
+    });
+}
+
+void HeightmapEditor::applyCrater(vec2 center, float radius, float depth)
+{
+    // The rim extends half a radius beyond the bowl.
+    applyProfile(center, radius, 1.5f, [depth] (float distance)
+    {
+        if (distance < 1.0f)
+        {
+            return depth * (distance * distance - 1.0f);
+        }
+        else
+        {
+            // Rises from the lip of the bowl and falls back to the original height at the edge, so there's no step at either end.
+            return depth * 0.2f * sin(PI * (distance - 1.0f) / 0.5f);
+        }
+    });
+}
+
+std::vector<HeightmapRegion> HeightmapEditor::takeDirtyRegions()
+{
+    std::vector<HeightmapRegion> regions {};
+    std::swap(regions, dirtyRegions);
+    return regions;
+}
+
+void HeightmapEditor::applyProfile(vec2 center, float radius, float reach, const std::function<float(float)>& profile)
+{
+    if (radius <= 0)
+    {
+        return;
+    }
+
+    HeightmapRegion region {};
+    region.min = max(ivec2(floor(center - radius * reach)), ivec2(0));
+    region.max = min(ivec2(ceil(center + radius * reach)), ivec2(heightmap.getWidth() - 1, heightmap.getHeight() - 1));
+
+    if (region.min.x > region.max.x || region.min.y > region.max.y)
+    {
+        return;
+    }
+
+    std::unique_lock<std::shared_timed_mutex> lock {};
+    if (mutex)
+    {
+        lock = std::unique_lock<std::shared_timed_mutex>(*mutex);
+    }
+
+    for (int y { region.min.y }; y <= region.max.y; y++)
+    {
+        for (int x { region.min.x }; x <= region.max.x; x++)
+        {
+            float distanceFromCenter { distance(vec2(x, y), center) / radius };
+
+            if (distanceFromCenter < reach)
+            {
+                unsigned short& value { heightmap.getData()[heightmap.getPixelIndex(x, y)] };
+                float newValue { value + profile(distanceFromCenter) * USHRT_MAX };
+                value = static_cast<unsigned short>(ofClamp(round(newValue), 0, USHRT_MAX));
+            }
+        }
+    }
+
+    dirtyRegions.push_back(region);
+}
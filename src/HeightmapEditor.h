@@ -0,0 +1,43 @@
+#pragma once
+#include "ofMain.h"
+#include <shared_mutex>
+
+// A rectangle of heightmap pixels, inclusive of both corners.
+struct HeightmapRegion
+{
+    glm::ivec2 min {};
+    glm::ivec2 max {};
+};
+
+// Deforms a heightmap in place at runtime and keeps track of the regions that have changed,
+// so that only the affected terrain needs to be rebuilt.
+// Anything reading the same pixels (e.g. World) sees the changes immediately.
+// Readers on other threads should hold the mutex passed to the constructor shared while they read;
+// the editor holds it exclusively while it writes the pixels.
+class HeightmapEditor
+{
+public:
+    // The heightmap (and the mutex, if any) must outlive the editor.
+    HeightmapEditor(ofShortPixels& heightmap, std::shared_timed_mutex* mutex = nullptr);
+
+    // Raises (positive amount) or lowers (negative amount) the terrain with a smooth circular brush.
+    // "center" and "radius" are in heightmap pixels; "amount" is the change at the center as a fraction of the full height range.
+    void applyBrush(glm::vec2 center, float radius, float amount);
+
+    // Digs a bowl-shaped crater with a slightly raised rim.
+    // "depth" is the depth at the center as a fraction of the full height range.
+    void applyCrater(glm::vec2 center, float radius, float depth);
+
+    // Returns the regions edited since the last call and forgets them.
+    std::vector<HeightmapRegion> takeDirtyRegions();
+
+private:
+    ofShortPixels& heightmap;
+    std::shared_timed_mutex* mutex;
+
+    std::vector<HeightmapRegion> dirtyRegions {};
+
+    // Adds a height offset (as a fraction of the full range) to every pixel within "reach" of the center.
+    // The offset for each pixel is given by "profile" as a function of its distance from the center divided by "radius".
+    void applyProfile(glm::vec2 center, float radius, float reach, const std::function<float(float)>& profile);
+};
@@ -0,0 +1,317 @@
+#include "HeightmapPyramid.h"
+#include "TaskScheduler.h"
+#include <cstdint>
+#include <fstream>
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PYRAMID_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    // Levels are split into bands of this many rows, which the threads take turns claiming.
+    const unsigned int ROWS_PER_BAND { 32 };
+
+    // Identifies a cache file, followed by a version number.
+    const char CACHE_MAGIC[8] { 'H', 'M', 'P', 'Y', 'R', 'A', 'M', '1' };
+
+    const uint64_t FNV_OFFSET_BASIS { 0xcbf29ce484222325ULL };
+    const uint64_t FNV_PRIME { 0x100000001b3ULL };
+
+    uint64_t hashBytes(const unsigned char* bytes, size_t count, uint64_t hash = FNV_OFFSET_BASIS)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            hash = (hash ^ bytes[i]) * FNV_PRIME;
+        }
+
+        return hash;
+    }
+
+    // Runs "function(index)" for every index in [0, count) on the shared task scheduler, using at most threadCount threads.
+    template<typename Function>
+    void parallelFor(size_t count, unsigned int threadCount, Function function)
+    {
+        TaskScheduler::getShared().parallelFor(count, function, threadCount);
+    }
+
+    // Filters three source rows into one row of weighted column sums (1, 2, 1).
+    void sumRows(const unsigned short* above, const unsigned short* middle, const unsigned short* below, uint32_t* sums, int width)
+    {
+        int x { 0 };
+
+#ifdef PYRAMID_USE_SSE2
+        __m128i zero { _mm_setzero_si128() };
+
+        for (; x + 8 <= width; x += 8)
+        {
+            __m128i a { _mm_loadu_si128(reinterpret_cast<const __m128i*>(above + x)) };
+            __m128i m { _mm_loadu_si128(reinterpret_cast<const __m128i*>(middle + x)) };
+            __m128i b { _mm_loadu_si128(reinterpret_cast<const __m128i*>(below + x)) };
+
+            // Widen to 32 bits; the sums can be up to four times USHRT_MAX.
+            __m128i low { _mm_add_epi32(_mm_add_epi32(_mm_unpacklo_epi16(a, zero), _mm_unpacklo_epi16(b, zero)),
+                _mm_slli_epi32(_mm_unpacklo_epi16(m, zero), 1)) };
+            __m128i high { _mm_add_epi32(_mm_add_epi32(_mm_unpackhi_epi16(a, zero), _mm_unpackhi_epi16(b, zero)),
+                _mm_slli_epi32(_mm_unpackhi_epi16(m, zero), 1)) };
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + x), low);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + x + 4), high);
+        }
+#endif
+
+        for (; x < width; x++)
+        {
+            sums[x] = above[x] + 2u * middle[x] + below[x];
+        }
+    }
+
+    // Filters a row of column sums horizontally (1, 2, 1) and keeps every second sample.
+    uint16_t filterSum(const uint32_t* sums, int x, int sourceWidth)
+    {
+        uint32_t left { sums[std::max(x - 1, 0)] };
+        uint32_t right { sums[std::min(x + 1, sourceWidth - 1)] };
+        return static_cast<uint16_t>((left + 2u * sums[x] + right + 8u) >> 4);
+    }
+
+    void downsampleRow(const uint32_t* sums, unsigned short* destination, int sourceWidth, int destinationWidth)
+    {
+        int i { 0 };
+
+        // The first sample needs its left neighbour clamped.
+        destination[i++] = filterSum(sums, 0, sourceWidth);
+
+#ifdef PYRAMID_USE_SSE2
+        __m128i bias { _mm_set1_epi32(8) };
+        __m128i packOffset { _mm_set1_epi32(32768) };
+        __m128i unpackOffset { _mm_set1_epi16(static_cast<short>(0x8000)) };
+
+        // Four destination samples need source samples 2i - 1 to 2i + 7.
+        for (; i + 4 <= destinationWidth && 2 * i + 7 < sourceWidth; i += 4)
+        {
+            __m128 previous { _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + 2 * i - 2))) };
+            __m128 current0 { _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + 2 * i))) };
+            __m128 current1 { _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + 2 * i + 4))) };
+            __m128 previous1 { _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + 2 * i + 2))) };
+
+            // Split into the even samples (the centres) and the odd samples either side of them.
+            __m128i centre { _mm_castps_si128(_mm_shuffle_ps(current0, current1, _MM_SHUFFLE(2, 0, 2, 0))) };
+            __m128i right { _mm_castps_si128(_mm_shuffle_ps(current0, current1, _MM_SHUFFLE(3, 1, 3, 1))) };
+            __m128i left { _mm_castps_si128(_mm_shuffle_ps(previous, previous1, _MM_SHUFFLE(3, 1, 3, 1))) };
+
+            __m128i filtered { _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(left, right), _mm_add_epi32(_mm_slli_epi32(centre, 1), bias)), 4) };
+
+            // SSE2 can only pack with signed saturation, so shift into the signed range and back.
+            __m128i packed { _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(filtered, packOffset), packOffset), unpackOffset) };
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(destination + i), packed);
+        }
+#endif
+
+        for (; i < destinationWidth; i++)
+        {
+            destination[i] = filterSum(sums, 2 * i, sourceWidth);
+        }
+    }
+
+    // Builds the next level down from a single-channel level.
+    void downsampleLevel(const ofShortPixels& source, ofShortPixels& destination, unsigned int threadCount)
+    {
+        int sourceWidth { static_cast<int>(source.getWidth()) };
+        int sourceHeight { static_cast<int>(source.getHeight()) };
+        int destinationWidth { (sourceWidth - 1) / 2 + 1 };
+        int destinationHeight { (sourceHeight - 1) / 2 + 1 };
+
+        destination.allocate(destinationWidth, destinationHeight, 1);
+
+        const unsigned short* sourceData { source.getData() };
+        unsigned short* destinationData { destination.getData() };
+        size_t bandCount { (destinationHeight + ROWS_PER_BAND - 1) / ROWS_PER_BAND };
+
+        parallelFor(bandCount, threadCount, [&] (size_t band)
+        {
+            std::vector<uint32_t> sums(sourceWidth);
+            int firstRow { static_cast<int>(band * ROWS_PER_BAND) };
+            int lastRow { std::min(firstRow + static_cast<int>(ROWS_PER_BAND), destinationHeight) };
+
+            for (int y { firstRow }; y < lastRow; y++)
+            {
+                int sourceY { 2 * y };
+                const unsigned short* above { sourceData + static_cast<size_t>(std::max(sourceY - 1, 0)) * sourceWidth };
+                const unsigned short* middle { sourceData + static_cast<size_t>(sourceY) * sourceWidth };
+                const unsigned short* below { sourceData + static_cast<size_t>(std::min(sourceY + 1, sourceHeight - 1)) * sourceWidth };
+
+                sumRows(above, middle, below, sums.data(), sourceWidth);
+                downsampleRow(sums.data(), destinationData + static_cast<size_t>(y) * destinationWidth, sourceWidth, destinationWidth);
+            }
+        });
+    }
+}
+
+void HeightmapPyramid::setSource(const ofShortPixels& heightmap, unsigned int threadCount)
+{
+    if (heightmap.getNumChannels() == 1)
+    {
+        source = &heightmap;
+        sourceCopy.clear();
+    }
+    else
+    {
+        sourceCopy = heightmap.getChannel(0);
+        source = &sourceCopy;
+    }
+
+    // Hash bands of rows in parallel, then hash the band hashes together.
+    size_t width { source->getWidth() };
+    size_t height { source->getHeight() };
+    size_t bandCount { (height + ROWS_PER_BAND - 1) / ROWS_PER_BAND };
+    std::vector<uint64_t> bandHashes(bandCount);
+
+    parallelFor(bandCount, threadCount, [&] (size_t band)
+    {
+        size_t firstRow { band * ROWS_PER_BAND };
+        size_t rowCount { std::min<size_t>(ROWS_PER_BAND, height - firstRow) };
+        bandHashes[band] = hashBytes(reinterpret_cast<const unsigned char*>(source->getData() + firstRow * width),
+            rowCount * width * sizeof(unsigned short));
+    });
+
+    uint32_t dimensions[2] { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
+    sourceHash = hashBytes(reinterpret_cast<const unsigned char*>(dimensions), sizeof(dimensions));
+    sourceHash = hashBytes(reinterpret_cast<const unsigned char*>(bandHashes.data()), bandHashes.size() * sizeof(uint64_t), sourceHash);
+}
+
+void HeightmapPyramid::build(const ofShortPixels& heightmap, unsigned int threadCount)
+{
+    setSource(heightmap, threadCount);
+    buildLevels(threadCount);
+}
+
+void HeightmapPyramid::buildLevels(unsigned int threadCount)
+{
+    levels.clear();
+
+    // Each level depends on the one before it, so only the rows within a level are done in parallel.
+    // Levels are addressed by index since adding one can move the others.
+    while (getLevel(getLevelCount() - 1).getWidth() > 2 || getLevel(getLevelCount() - 1).getHeight() > 2)
+    {
+        ofShortPixels level {};
+        downsampleLevel(getLevel(getLevelCount() - 1), level, threadCount);
+        levels.push_back(std::move(level));
+    }
+}
+
+bool HeightmapPyramid::buildWithCache(const ofShortPixels& heightmap, const std::string& cachePath, unsigned int threadCount)
+{
+    setSource(heightmap, threadCount);
+
+    if (loadCache(cachePath))
+    {
+        return true;
+    }
+
+    buildLevels(threadCount);
+    saveCache(cachePath);
+    return false;
+}
+
+unsigned int HeightmapPyramid::getLevelCount() const
+{
+    return source ? static_cast<unsigned int>(levels.size()) + 1 : 0;
+}
+
+const ofShortPixels& HeightmapPyramid::getLevel(unsigned int level) const
+{
+    return level == 0 ? *source : levels.at(level - 1);
+}
+
+size_t HeightmapPyramid::getMemoryBytes() const
+{
+    size_t bytes { sourceCopy.getTotalBytes() };
+
+    for (const ofShortPixels& level : levels)
+    {
+        bytes += level.getTotalBytes();
+    }
+
+    return bytes;
+}
+
+unsigned int HeightmapPyramid::getLevelForSpacing(float spacing) const
+{
+    unsigned int level { 0 };
+
+    while (level + 1 < getLevelCount() && static_cast<float>(1u << (level + 1)) <= spacing)
+    {
+        level++;
+    }
+
+    return level;
+}
+
+bool HeightmapPyramid::loadCache(const std::string& cachePath)
+{
+    std::ifstream file { cachePath, std::ios::binary };
+    if (!file)
+    {
+        return false;
+    }
+
+    char magic[sizeof(CACHE_MAGIC)] {};
+    uint64_t hash { 0 };
+    uint32_t levelCount { 0 };
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&hash), sizeof(hash));
+    file.read(reinterpret_cast<char*>(&levelCount), sizeof(levelCount));
+
+    if (!file || !std::equal(std::begin(magic), std::end(magic), std::begin(CACHE_MAGIC)) || hash != sourceHash)
+    {
+        ofLogNotice("HeightmapPyramid") << "Cache " << cachePath << " is out of date; rebuilding.";
+        return false;
+    }
+
+    std::vector<ofShortPixels> loadedLevels(levelCount);
+    for (ofShortPixels& level : loadedLevels)
+    {
+        uint32_t size[2] { 0, 0 };
+        file.read(reinterpret_cast<char*>(size), sizeof(size));
+
+        if (!file || size[0] == 0 || size[1] == 0)
+        {
+            break;
+        }
+
+        level.allocate(size[0], size[1], 1);
+        file.read(reinterpret_cast<char*>(level.getData()), level.size() * sizeof(unsigned short));
+    }
+
+    if (!file)
+    {
+        ofLogWarning("HeightmapPyramid") << "Cache " << cachePath << " is truncated; rebuilding.";
+        return false;
+    }
+
+    levels = std::move(loadedLevels);
+    return true;
+}
+
+void HeightmapPyramid::saveCache(const std::string& cachePath) const
+{
+    std::ofstream file { cachePath, std::ios::binary | std::ios::trunc };
+    uint32_t levelCount { static_cast<uint32_t>(levels.size()) };
+
+    file.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    file.write(reinterpret_cast<const char*>(&sourceHash), sizeof(sourceHash));
+    file.write(reinterpret_cast<const char*>(&levelCount), sizeof(levelCount));
+
+    for (const ofShortPixels& level : levels)
+    {
+        uint32_t size[2] { static_cast<uint32_t>(level.getWidth()), static_cast<uint32_t>(level.getHeight()) };
+        file.write(reinterpret_cast<const char*>(size), sizeof(size));
+        file.write(reinterpret_cast<const char*>(level.getData()), level.size() * sizeof(unsigned short));
+    }
+
+    if (!file)
+    {
+        ofLogWarning("HeightmapPyramid") << "Couldn't write cache " << cachePath << ".";
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include "ofMain.h"
+
+// A chain of successively half-resolution copies of a heightmap, all built from the one full-resolution image.
+// Each level keeps the corner samples of the level above (a (2n + 1)-pixel heightmap becomes an (n + 1)-pixel one),
+// so every level spans the same world-space area and can be passed anywhere a heightmap is expected,
+// e.g. buildTerrainMesh() for a far-field mesh or World::heightmap for coarse queries.
+// Edits made to the full-resolution heightmap after building (see HeightmapEditor) aren't reflected in the other levels.
+class HeightmapPyramid
+{
+public:
+    HeightmapPyramid() = default;
+
+    // Don't support copy constructor or copy assignment operator.
+    HeightmapPyramid(const HeightmapPyramid& p) = delete;
+    HeightmapPyramid& operator= (const HeightmapPyramid& p) = delete;
+
+    // Builds every level from the heightmap, down to 2 x 2 pixels, splitting each level across several threads.
+    // The heightmap must outlive the pyramid since it's used directly as level 0.
+    // The work runs on the shared TaskScheduler, with at most "threadCount" threads; 0 lets every worker join in.
+    void build(const ofShortPixels& heightmap, unsigned int threadCount = 0);
+
+    // Loads the levels from a cache file if it was written for the same heightmap; otherwise builds them and writes the cache.
+    // Returns true if the cache was used.
+    bool buildWithCache(const ofShortPixels& heightmap, const std::string& cachePath, unsigned int threadCount = 0);
+
+    // The number of levels, including the full-resolution heightmap.
+    unsigned int getLevelCount() const;
+
+    // Gets a level of the pyramid; level 0 is the full-resolution heightmap and each level after it is half the resolution.
+    const ofShortPixels& getLevel(unsigned int level) const;
+
+    // The CPU memory used by the pyramid, not counting the full-resolution heightmap it was built from.
+    size_t getMemoryBytes() const;
+
+    // Gets the finest level whose pixels are at least "spacing" full-resolution pixels apart (clamped to the coarsest level).
+    unsigned int getLevelForSpacing(float spacing) const;
+
+private:
+    // The full-resolution heightmap.
+    const ofShortPixels* source { nullptr };
+
+    // A single-channel copy of the heightmap, only used if the heightmap has more than one channel.
+    ofShortPixels sourceCopy {};
+
+    // Levels 1 and up.
+    std::vector<ofShortPixels> levels {};
+
+    // Identifies the contents of the source heightmap so that a stale cache isn't used.
+    uint64_t sourceHash { 0 };
+
+    // Sets the source, converting it to a single channel if necessary, and hashes it.
+    void setSource(const ofShortPixels& heightmap, unsigned int threadCount);
+
+    // Builds levels 1 and up from the source.
+    void buildLevels(unsigned int threadCount);
+
+    bool loadCache(const std::string& cachePath);
+    void saveCache(const std::string& cachePath) const;
+};
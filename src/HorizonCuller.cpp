@@ -0,0 +1,91 @@
+#include "HorizonCuller.h"
+
+using namespace glm;
+
+void HorizonCuller::begin(vec3 cameraPosition)
+{
+    this->cameraPosition = cameraPosition;
+    std::fill(std::begin(horizon), std::end(horizon), -INFINITY);
+}
+
+bool HorizonCuller::testAndAddCell(vec2 cellMin, vec2 cellMax, float minHeight, float maxHeight)
+{
+    vec2 camera { cameraPosition.x, cameraPosition.z };
+
+    // Cells containing the camera surround it in every direction; they can't be culled or used as occluders.
+    if (all(greaterThanEqual(camera, cellMin)) && all(lessThanEqual(camera, cellMax)))
+    {
+        return false;
+    }
+
+    // The nearest and farthest horizontal distances from the camera to the cell.
+    vec2 nearestPoint { clamp(camera, cellMin, cellMax) };
+    vec2 farthestPoint { mix(cellMax, cellMin, greaterThan(camera, (cellMin + cellMax) * 0.5f)) };
+    float nearDistance { distance(camera, nearestPoint) };
+    float farDistance { distance(camera, farthestPoint) };
+
+    // The azimuth range covered by the cell, measured around the direction to its center so that it never wraps.
+    vec2 toCenter { (cellMin + cellMax) * 0.5f - camera };
+    float centerAngle { atan2(toCenter.y, toCenter.x) };
+    float minOffset { INFINITY };
+    float maxOffset { -INFINITY };
+
+    for (vec2 corner : { cellMin, vec2(cellMin.x, cellMax.y), vec2(cellMax.x, cellMin.y), cellMax })
+    {
+        vec2 toCorner { corner - camera };
+        float offset { atan2(toCorner.y, toCorner.x) - centerAngle };
+
+        // Wrap into (-pi, pi].
+        if (offset > PI)
+        {
+            offset -= TWO_PI;
+        }
+        else if (offset <= -PI)
+        {
+            offset += TWO_PI;
+        }
+
+        minOffset = std::min(minOffset, offset);
+        maxOffset = std::max(maxOffset, offset);
+    }
+
+    float binsPerRadian { HORIZON_RESOLUTION / TWO_PI };
+    float startBin { (centerAngle + minOffset) * binsPerRadian };
+    float endBin { (centerAngle + maxOffset) * binsPerRadian };
+    auto wrapBin = [] (int bin) { return ((bin % HORIZON_RESOLUTION) + HORIZON_RESOLUTION) % HORIZON_RESOLUTION; };
+
+    // The steepest elevation at which any of the cell's terrain could be seen.
+    // Positive rises are steepest at the nearest point, negative ones at the farthest.
+    float maxRise { maxHeight - cameraPosition.y };
+    float maxElevation { maxRise / std::max(maxRise > 0 ? nearDistance : farDistance, 0.0001f) };
+
+    // The cell is hidden if the horizon is above it in every bin it overlaps, even partially.
+    bool occluded { true };
+    for (int bin { static_cast<int>(floor(startBin)) }; bin <= static_cast<int>(floor(endBin)); bin++)
+    {
+        if (maxElevation >= horizon[wrapBin(bin)])
+        {
+            occluded = false;
+            break;
+        }
+    }
+
+    if (occluded)
+    {
+        return true;
+    }
+
+    // Every ray in the cell's azimuth range crosses its footprint, and the terrain there is at least minHeight,
+    // so anything below this elevation is hidden behind the cell.
+    // Only bins completely inside the range are raised so that the horizon stays conservative.
+    float minRise { minHeight - cameraPosition.y };
+    float blockedElevation { minRise / std::max(minRise > 0 ? farDistance : nearDistance, 0.0001f) };
+
+    for (int bin { static_cast<int>(ceil(startBin)) }; bin + 1 <= static_cast<int>(floor(endBin)); bin++)
+    {
+        float& binHorizon { horizon[wrapBin(bin)] };
+        binHorizon = std::max(binHorizon, blockedElevation);
+    }
+
+    return false;
+}
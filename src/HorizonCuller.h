@@ -0,0 +1,28 @@
+#pragma once
+#include "ofMain.h"
+
+// A conservative CPU occlusion test for heightfield terrain.
+// Cells are fed in front-to-back order; each one is tested against the horizon built from the cells in front of it,
+// and then raises the horizon by the height its own terrain is guaranteed to reach (its minimum height).
+// The horizon is stored as the steepest blocked elevation (rise over run) for each of a fixed number of azimuth bins.
+class HorizonCuller
+{
+public:
+    // Clears the horizon for a new camera position (in the same space as the cell bounds).
+    void begin(glm::vec3 cameraPosition);
+
+    // Tests a cell against the horizon and then adds it as an occluder.
+    // "cellMin" and "cellMax" are the corners of the cell's footprint in x and z,
+    // and "minHeight" and "maxHeight" bound the heights of its terrain.
+    // Returns true if the cell is entirely below the horizon and doesn't need to be drawn.
+    bool testAndAddCell(glm::vec2 cellMin, glm::vec2 cellMax, float minHeight, float maxHeight);
+
+private:
+    // The number of azimuth bins around the camera.
+    const static int HORIZON_RESOLUTION { 512 };
+
+    glm::vec3 cameraPosition {};
+
+    // The steepest elevation below which everything is known to be hidden, for each azimuth bin.
+    float horizon[HORIZON_RESOLUTION] {};
+};
@@ -0,0 +1,294 @@
+#include "LocalSocket.h"
+
+#ifdef _WIN32
+// Winsock has to come before anything that includes windows.h.
+#include <winsock2.h>
+#include <afunix.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "ofMain.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+namespace
+{
+#ifdef _WIN32
+    using NativeSocket = SOCKET;
+
+    void closeNativeSocket(NativeSocket socket)
+    {
+        closesocket(socket);
+    }
+
+    const int SHUTDOWN_BOTH { SD_BOTH };
+    const int SEND_FLAGS { 0 };
+
+    using PollEntry = WSAPOLLFD;
+
+    int pollSockets(PollEntry* entries, size_t count)
+    {
+        return WSAPoll(entries, static_cast<ULONG>(count), -1);
+    }
+
+    bool wasInterrupted()
+    {
+        return false;
+    }
+#else
+    using NativeSocket = int;
+
+    void closeNativeSocket(NativeSocket socket)
+    {
+        ::close(socket);
+    }
+
+    const int SHUTDOWN_BOTH { SHUT_RDWR };
+
+    // Report a closed peer as a failed write rather than killing the process with SIGPIPE.
+#ifdef MSG_NOSIGNAL
+    const int SEND_FLAGS { MSG_NOSIGNAL };
+#else
+    const int SEND_FLAGS { 0 };
+#endif
+
+    using PollEntry = pollfd;
+
+    int pollSockets(PollEntry* entries, size_t count)
+    {
+        return ::poll(entries, static_cast<nfds_t>(count), -1);
+    }
+
+    // A signal arriving during a wait isn't a failure; the caller just waits again.
+    bool wasInterrupted()
+    {
+        return errno == EINTR;
+    }
+#endif
+
+    NativeSocket toNative(intptr_t handle)
+    {
+        return static_cast<NativeSocket>(handle);
+    }
+
+    // Winsock has to be started once per process before any sockets are made.
+    void initializeSockets()
+    {
+#ifdef _WIN32
+        static std::once_flag initialized {};
+        std::call_once(initialized, [] ()
+        {
+            WSADATA data {};
+            WSAStartup(MAKEWORD(2, 2), &data);
+        });
+#endif
+    }
+
+    // Fills in a socket address for a path; returns false if the path is too long to fit.
+    bool makeAddress(const std::string& path, sockaddr_un& address)
+    {
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+
+        if (path.size() >= sizeof(address.sun_path))
+        {
+            ofLogError("LocalSocket") << "Socket path " << path << " is too long.";
+            return false;
+        }
+
+        std::memcpy(address.sun_path, path.c_str(), path.size());
+        return true;
+    }
+}
+
+LocalSocket::LocalSocket(intptr_t handle)
+    : handle { handle }
+{
+}
+
+LocalSocket::~LocalSocket()
+{
+    close();
+}
+
+LocalSocket::LocalSocket(LocalSocket&& other)
+    : handle { other.handle }
+{
+    other.handle = -1;
+}
+
+LocalSocket& LocalSocket::operator= (LocalSocket&& other)
+{
+    if (this != &other)
+    {
+        close();
+        handle = other.handle;
+        other.handle = -1;
+    }
+
+    return *this;
+}
+
+bool LocalSocket::listen(const std::string& path)
+{
+    close();
+    initializeSockets();
+
+    sockaddr_un address {};
+    if (!makeAddress(path, address))
+    {
+        return false;
+    }
+
+    NativeSocket socket { ::socket(AF_UNIX, SOCK_STREAM, 0) };
+    handle = static_cast<intptr_t>(socket);
+    if (!isOpen())
+    {
+        ofLogError("LocalSocket") << "Couldn't create a socket.";
+        return false;
+    }
+
+    // A socket file left behind by a previous run would make bind() fail.
+    std::remove(path.c_str());
+
+    if (::bind(socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || ::listen(socket, SOMAXCONN) != 0)
+    {
+        ofLogError("LocalSocket") << "Couldn't listen at " << path << ".";
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+LocalSocket LocalSocket::accept()
+{
+    NativeSocket connection { ::accept(toNative(handle), nullptr, nullptr) };
+    return LocalSocket(static_cast<intptr_t>(connection));
+}
+
+bool LocalSocket::connect(const std::string& path)
+{
+    close();
+    initializeSockets();
+
+    sockaddr_un address {};
+    if (!makeAddress(path, address))
+    {
+        return false;
+    }
+
+    NativeSocket socket { ::socket(AF_UNIX, SOCK_STREAM, 0) };
+    handle = static_cast<intptr_t>(socket);
+    if (!isOpen() || ::connect(socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        ofLogError("LocalSocket") << "Couldn't connect to " << path << ".";
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+bool LocalSocket::readAll(void* data, size_t size)
+{
+    char* bytes { static_cast<char*>(data) };
+
+    while (size > 0)
+    {
+        // Winsock takes an int length, so read in pieces that fit.
+        int chunk { static_cast<int>(std::min<size_t>(size, 1 << 30)) };
+        auto received = ::recv(toNative(handle), bytes, chunk, 0);
+
+        if (received <= 0)
+        {
+            return false;
+        }
+
+        bytes += received;
+        size -= static_cast<size_t>(received);
+    }
+
+    return true;
+}
+
+size_t LocalSocket::readSome(void* data, size_t size)
+{
+    int chunk { static_cast<int>(std::min<size_t>(size, 1 << 30)) };
+    auto received = ::recv(toNative(handle), static_cast<char*>(data), chunk, 0);
+    return received > 0 ? static_cast<size_t>(received) : 0;
+}
+
+bool LocalSocket::writeAll(const void* data, size_t size)
+{
+    const char* bytes { static_cast<const char*>(data) };
+
+    while (size > 0)
+    {
+        int chunk { static_cast<int>(std::min<size_t>(size, 1 << 30)) };
+        auto sent = ::send(toNative(handle), bytes, chunk, SEND_FLAGS);
+
+        if (sent <= 0)
+        {
+            return false;
+        }
+
+        bytes += sent;
+        size -= static_cast<size_t>(sent);
+    }
+
+    return true;
+}
+
+bool LocalSocket::waitForReadable(const std::vector<const LocalSocket*>& sockets, std::vector<char>& readable)
+{
+    std::vector<PollEntry> entries(sockets.size());
+    for (size_t i { 0 }; i < sockets.size(); i++)
+    {
+        entries[i].fd = toNative(sockets[i]->handle);
+        entries[i].events = POLLIN;
+    }
+
+    readable.assign(sockets.size(), 0);
+
+    if (pollSockets(entries.data(), entries.size()) < 0)
+    {
+        return wasInterrupted();
+    }
+
+    for (size_t i { 0 }; i < sockets.size(); i++)
+    {
+        readable[i] = (entries[i].revents & (POLLIN | POLLHUP | POLLERR)) != 0 ? 1 : 0;
+    }
+
+    return true;
+}
+
+void LocalSocket::shutdown()
+{
+    if (isOpen())
+    {
+        ::shutdown(toNative(handle), SHUTDOWN_BOTH);
+    }
+}
+
+void LocalSocket::close()
+{
+    if (isOpen())
+    {
+        closeNativeSocket(toNative(handle));
+        handle = -1;
+    }
+}
+
+bool LocalSocket::isOpen() const
+{
+    return handle != -1;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A Unix domain stream socket (AF_UNIX; Windows 10 and later support these too).
+// Sockets are moved rather than copied, and closed when destroyed.
+class LocalSocket
+{
+public:
+    LocalSocket() = default;
+    ~LocalSocket();
+
+    LocalSocket(LocalSocket&& other);
+    LocalSocket& operator= (LocalSocket&& other);
+
+    // Don't support copy constructor or copy assignment operator.
+    LocalSocket(const LocalSocket& s) = delete;
+    LocalSocket& operator= (const LocalSocket& s) = delete;
+
+    // Creates a socket listening at a path, replacing any stale socket file left there.  Returns false on failure.
+    bool listen(const std::string& path);
+
+    // Waits for a connection to a listening socket.  The result isn't open if the wait failed or the socket was shut down.
+    LocalSocket accept();
+
+    // Connects to a socket listening at a path.  Returns false on failure.
+    bool connect(const std::string& path);
+
+    // Reads exactly "size" bytes, blocking until they've all arrived.
+    // Returns false if the connection closed or failed first.
+    bool readAll(void* data, size_t size);
+
+    // Reads whatever has arrived, up to "size" bytes, blocking until there's at least one.
+    // Returns the number of bytes read, or 0 if the connection closed or failed.
+    size_t readSome(void* data, size_t size);
+
+    // Writes exactly "size" bytes.  Returns false if the connection closed or failed first.
+    bool writeAll(const void* data, size_t size);
+
+    // Waits until at least one of the sockets can be read from without blocking, setting a flag in "readable" for each
+    // one that can.  A listening socket is readable when a connection is waiting, and a closed connection is readable
+    // too (reading it fails).  Returns false if the wait failed.
+    static bool waitForReadable(const std::vector<const LocalSocket*>& sockets, std::vector<char>& readable);
+
+    // Wakes any thread blocked reading from or accepting on the socket, without closing it yet.
+    void shutdown();
+
+    void close();
+
+    bool isOpen() const;
+
+private:
+    // The native socket handle; -1 while closed.
+    intptr_t handle { -1 };
+
+    explicit LocalSocket(intptr_t handle);
+};
@@ -0,0 +1,74 @@
+#include "MemoryTracker.h"
+
+namespace
+{
+    std::string formatMegabytes(size_t bytes)
+    {
+        return ofToString(bytes / (1024.0 * 1024.0), 1);
+    }
+
+    bool isOver(size_t usage, size_t budget)
+    {
+        return budget != 0 && usage > budget;
+    }
+}
+
+size_t getMeshBytes(const ofMesh& mesh)
+{
+    return mesh.getNumVertices() * sizeof(glm::vec3)
+        + mesh.getNumNormals() * sizeof(glm::vec3)
+        + mesh.getNumColors() * sizeof(ofFloatColor)
+        + mesh.getNumTexCoords() * sizeof(glm::vec2)
+        + mesh.getNumIndices() * sizeof(ofIndexType);
+}
+
+void MemoryTracker::setUsage(const std::string& subsystem, MemoryUsage usage)
+{
+    entries[subsystem].usage = usage;
+}
+
+void MemoryTracker::setBudget(const std::string& subsystem, MemoryUsage budget)
+{
+    entries[subsystem].budget = budget;
+}
+
+bool MemoryTracker::isOverBudget(const std::string& subsystem) const
+{
+    auto found = entries.find(subsystem);
+
+    return found != entries.end()
+        && (isOver(found->second.usage.cpuBytes, found->second.budget.cpuBytes)
+            || isOver(found->second.usage.gpuBytes, found->second.budget.gpuBytes));
+}
+
+MemoryUsage MemoryTracker::getTotal() const
+{
+    MemoryUsage total {};
+
+    for (const auto& entry : entries)
+    {
+        total.cpuBytes += entry.second.usage.cpuBytes;
+        total.gpuBytes += entry.second.usage.gpuBytes;
+    }
+
+    return total;
+}
+
+std::string MemoryTracker::getReport() const
+{
+    std::stringstream report {};
+    report << "Memory (MB)  CPU / budget  GPU / budget\n";
+
+    for (const auto& entry : entries)
+    {
+        const Entry& e { entry.second };
+        report << entry.first << "  "
+            << formatMegabytes(e.usage.cpuBytes) << " / " << (e.budget.cpuBytes ? formatMegabytes(e.budget.cpuBytes) : "-") << "  "
+            << formatMegabytes(e.usage.gpuBytes) << " / " << (e.budget.gpuBytes ? formatMegabytes(e.budget.gpuBytes) : "-")
+            << (isOverBudget(entry.first) ? "  OVER" : "") << "\n";
+    }
+
+    MemoryUsage total { getTotal() };
+    report << "Total  " << formatMegabytes(total.cpuBytes) << "  " << formatMegabytes(total.gpuBytes) << "\n";
+    return report.str();
+}
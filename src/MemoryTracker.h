@@ -0,0 +1,42 @@
+#pragma once
+#include "ofMain.h"
+
+// An amount of memory on the CPU and GPU.
+struct MemoryUsage
+{
+    size_t cpuBytes { 0 };
+    size_t gpuBytes { 0 };
+};
+
+// Gets the CPU memory used by a mesh's vertex data and indices.
+size_t getMeshBytes(const ofMesh& mesh);
+
+// Keeps track of how much memory each subsystem uses, and how much each one is allowed.
+// Subsystems report their own usage; enforcing a budget is up to the subsystem (see CellManager::setMemoryBudget()).
+class MemoryTracker
+{
+public:
+    // Sets the current usage of a subsystem, adding it if it's new.
+    void setUsage(const std::string& subsystem, MemoryUsage usage);
+
+    // Sets a subsystem's budget.  A budget of 0 bytes means no limit.
+    void setBudget(const std::string& subsystem, MemoryUsage budget);
+
+    // Returns true if the subsystem uses more CPU or GPU memory than its budget allows.
+    bool isOverBudget(const std::string& subsystem) const;
+
+    // The total usage of every subsystem.
+    MemoryUsage getTotal() const;
+
+    // A table of every subsystem's usage and budget, in megabytes.
+    std::string getReport() const;
+
+private:
+    struct Entry
+    {
+        MemoryUsage usage {};
+        MemoryUsage budget {};
+    };
+
+    std::map<std::string, Entry> entries {};
+};
@@ -0,0 +1,218 @@
+#include "NoiseHeightSource.h"
+#include <cstdint>
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NOISE_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    // The hash constants; any large odd numbers will do.
+    const uint32_t HASH_X { 0x27d4eb2dU };
+    const uint32_t HASH_Y { 0x165667b1U };
+    const uint32_t HASH_MIX_1 { 0x2c1b3c6dU };
+    const uint32_t HASH_MIX_2 { 0x297a2d39U };
+    const uint32_t OCTAVE_SEED_STEP { 0x9e3779b9U };
+
+    // Lattice values use the low 24 bits of the hash so that they convert to float exactly.
+    const uint32_t VALUE_MASK { 0xffffffU };
+    const float VALUE_SCALE { 1.0f / 16777215.0f };
+
+    uint32_t hashLattice(int32_t x, int32_t y, uint32_t seed)
+    {
+        uint32_t h { (static_cast<uint32_t>(x) * HASH_X) ^ (static_cast<uint32_t>(y) * HASH_Y) ^ seed };
+        h ^= h >> 15;
+        h *= HASH_MIX_1;
+        h ^= h >> 12;
+        h *= HASH_MIX_2;
+        h ^= h >> 15;
+        return h;
+    }
+
+    float latticeValue(int32_t x, int32_t y, uint32_t seed)
+    {
+        return static_cast<float>(hashLattice(x, y, seed) & VALUE_MASK) * VALUE_SCALE;
+    }
+
+    // Quintic fade curve so that the noise has continuous slope (and normals) across lattice cells.
+    float fade(float t)
+    {
+        return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+    }
+
+    unsigned short toHeight(float noise, float contrast)
+    {
+        float height { (noise - 0.5f) * contrast + 0.5f };
+        height = std::min(std::max(height, 0.0f), 1.0f);
+        return static_cast<unsigned short>(height * USHRT_MAX + 0.5f);
+    }
+
+#ifdef NOISE_USE_SSE2
+    // 32-bit multiply keeping the low bits; SSE2 only has a 32 x 32 -> 64 bit multiply on alternate lanes.
+    __m128i multiplyLow(__m128i a, __m128i b)
+    {
+        __m128i evenProducts { _mm_mul_epu32(a, b) };
+        __m128i oddProducts { _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4)) };
+        return _mm_unpacklo_epi32(_mm_shuffle_epi32(evenProducts, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(oddProducts, _MM_SHUFFLE(0, 0, 2, 0)));
+    }
+
+    // Same as hashLattice() for four x coordinates and one y coordinate.
+    __m128i hashLattice4(__m128i x, int32_t y, uint32_t seed)
+    {
+        __m128i h { _mm_xor_si128(multiplyLow(x, _mm_set1_epi32(static_cast<int>(HASH_X))),
+            _mm_set1_epi32(static_cast<int>((static_cast<uint32_t>(y) * HASH_Y) ^ seed))) };
+        h = _mm_xor_si128(h, _mm_srli_epi32(h, 15));
+        h = multiplyLow(h, _mm_set1_epi32(static_cast<int>(HASH_MIX_1)));
+        h = _mm_xor_si128(h, _mm_srli_epi32(h, 12));
+        h = multiplyLow(h, _mm_set1_epi32(static_cast<int>(HASH_MIX_2)));
+        h = _mm_xor_si128(h, _mm_srli_epi32(h, 15));
+        return h;
+    }
+
+    __m128 latticeValue4(__m128i x, int32_t y, uint32_t seed)
+    {
+        __m128i masked { _mm_and_si128(hashLattice4(x, y, seed), _mm_set1_epi32(static_cast<int>(VALUE_MASK))) };
+        return _mm_mul_ps(_mm_cvtepi32_ps(masked), _mm_set1_ps(VALUE_SCALE));
+    }
+
+    __m128 fade4(__m128 t)
+    {
+        __m128 inner { _mm_add_ps(_mm_mul_ps(t, _mm_sub_ps(_mm_mul_ps(t, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f))), _mm_set1_ps(10.0f)) };
+        return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t, t), t), inner);
+    }
+
+    // SSE2 has no floor instruction; truncate and step down where that rounded up.
+    __m128 floor4(__m128 x)
+    {
+        __m128 truncated { _mm_cvtepi32_ps(_mm_cvttps_epi32(x)) };
+        return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, x), _mm_set1_ps(1.0f)));
+    }
+#endif
+}
+
+NoiseHeightSource::NoiseHeightSource(unsigned int seed, glm::ivec2 nominalSize)
+    : seed { seed }, nominalSize { nominalSize }
+{
+}
+
+bool NoiseHeightSource::isBounded() const
+{
+    return false;
+}
+
+glm::ivec2 NoiseHeightSource::getSize() const
+{
+    return nominalSize;
+}
+
+void NoiseHeightSource::sampleRowScalar(int y, int startX, int first, int last, unsigned short* heights) const
+{
+    for (int i { first }; i < last; i++)
+    {
+        float frequency { baseFrequency };
+        float amplitude { 1.0f };
+        float total { 0.0f };
+        float amplitudeSum { 0.0f };
+
+        for (unsigned int octave { 0 }; octave < octaves; octave++)
+        {
+            uint32_t octaveSeed { seed + octave * OCTAVE_SEED_STEP };
+
+            float px { static_cast<float>(startX + i) * frequency };
+            float py { static_cast<float>(y) * frequency };
+            float floorX { std::floor(px) };
+            float floorY { std::floor(py) };
+            int32_t ix { static_cast<int32_t>(floorX) };
+            int32_t iy { static_cast<int32_t>(floorY) };
+            float u { fade(px - floorX) };
+            float v { fade(py - floorY) };
+
+            float v00 { latticeValue(ix, iy, octaveSeed) };
+            float v10 { latticeValue(ix + 1, iy, octaveSeed) };
+            float v01 { latticeValue(ix, iy + 1, octaveSeed) };
+            float v11 { latticeValue(ix + 1, iy + 1, octaveSeed) };
+
+            float bottom { v00 + (v10 - v00) * u };
+            float top { v01 + (v11 - v01) * u };
+            total += (bottom + (top - bottom) * v) * amplitude;
+            amplitudeSum += amplitude;
+
+            frequency *= lacunarity;
+            amplitude *= gain;
+        }
+
+        heights[i] = toHeight(total / amplitudeSum, contrast);
+    }
+}
+
+void NoiseHeightSource::sampleHeightsScalar(glm::ivec2 start, glm::ivec2 size, unsigned short* heights) const
+{
+    for (int y { 0 }; y < size.y; y++)
+    {
+        sampleRowScalar(start.y + y, start.x, 0, size.x, heights + y * size.x);
+    }
+}
+
+void NoiseHeightSource::sampleHeights(glm::ivec2 start, glm::ivec2 size, unsigned short* heights) const
+{
+#ifdef NOISE_USE_SSE2
+    for (int y { 0 }; y < size.y; y++)
+    {
+        unsigned short* row { heights + y * size.x };
+        int vectorEnd { size.x - size.x % 4 };
+
+        for (int i { 0 }; i < vectorEnd; i += 4)
+        {
+            __m128 xs { _mm_add_ps(_mm_set1_ps(static_cast<float>(start.x + i)), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f)) };
+            float frequency { baseFrequency };
+            float amplitude { 1.0f };
+            __m128 total { _mm_setzero_ps() };
+            float amplitudeSum { 0.0f };
+
+            for (unsigned int octave { 0 }; octave < octaves; octave++)
+            {
+                uint32_t octaveSeed { seed + octave * OCTAVE_SEED_STEP };
+
+                // The y coordinate is the same across the row, so only x needs vectorizing.
+                __m128 px { _mm_mul_ps(xs, _mm_set1_ps(frequency)) };
+                float py { static_cast<float>(start.y + y) * frequency };
+                __m128 floorX { floor4(px) };
+                float floorY { std::floor(py) };
+                __m128i ix { _mm_cvttps_epi32(floorX) };
+                __m128i ixNext { _mm_add_epi32(ix, _mm_set1_epi32(1)) };
+                int32_t iy { static_cast<int32_t>(floorY) };
+                __m128 u { fade4(_mm_sub_ps(px, floorX)) };
+                __m128 v { _mm_set1_ps(fade(py - floorY)) };
+
+                __m128 v00 { latticeValue4(ix, iy, octaveSeed) };
+                __m128 v10 { latticeValue4(ixNext, iy, octaveSeed) };
+                __m128 v01 { latticeValue4(ix, iy + 1, octaveSeed) };
+                __m128 v11 { latticeValue4(ixNext, iy + 1, octaveSeed) };
+
+                __m128 bottom { _mm_add_ps(v00, _mm_mul_ps(_mm_sub_ps(v10, v00), u)) };
+                __m128 top { _mm_add_ps(v01, _mm_mul_ps(_mm_sub_ps(v11, v01), u)) };
+                __m128 noise { _mm_add_ps(bottom, _mm_mul_ps(_mm_sub_ps(top, bottom), v)) };
+                total = _mm_add_ps(total, _mm_mul_ps(noise, _mm_set1_ps(amplitude)));
+                amplitudeSum += amplitude;
+
+                frequency *= lacunarity;
+                amplitude *= gain;
+            }
+
+            alignas(16) float noise[4];
+            _mm_store_ps(noise, _mm_div_ps(total, _mm_set1_ps(amplitudeSum)));
+
+            for (int lane { 0 }; lane < 4; lane++)
+            {
+                row[i + lane] = toHeight(noise[lane], contrast);
+            }
+        }
+
+        // Finish the row with the scalar path.
+        sampleRowScalar(start.y + y, start.x, vectorEnd, size.x, row);
+    }
+#else
+    sampleHeightsScalar(start, size, heights);
+#endif
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "HeightSource.h"
+
+// An unbounded height source that generates terrain on demand from seeded multi-octave value noise (fractal Brownian motion).
+// Nothing is stored, so any number of cells can be generated anywhere without a heightmap in memory.
+// Rows of samples are generated four at a time with SSE2 where available.
+class NoiseHeightSource : public HeightSource
+{
+public:
+    // "nominalSize" is the area (in pixels) that World::dimensions is measured against; the terrain continues past it.
+    NoiseHeightSource(unsigned int seed, glm::ivec2 nominalSize = glm::ivec2(8192));
+
+    void sampleHeights(glm::ivec2 start, glm::ivec2 size, unsigned short* heights) const override;
+
+    // The same as sampleHeights(), but without vectorization.  Gives the same results; used for benchmarking.
+    void sampleHeightsScalar(glm::ivec2 start, glm::ivec2 size, unsigned short* heights) const;
+
+    bool isBounded() const override;
+    glm::ivec2 getSize() const override;
+
+    // The parameters below shouldn't be changed while cells are being generated.
+
+    // The number of layers of noise added together.
+    unsigned int octaves { 7 };
+
+    // The frequency of the first octave, in noise lattice cells per pixel.
+    float baseFrequency { 1.0f / 1024.0f };
+
+    // The frequency multiplier from one octave to the next.
+    float lacunarity { 2.0f };
+
+    // The amplitude multiplier from one octave to the next.
+    float gain { 0.5f };
+
+    // Stretches the heights away from the middle of the range; summed noise tends to cluster around the middle.
+    float contrast { 1.8f };
+
+private:
+    unsigned int seed;
+    glm::ivec2 nominalSize;
+
+    // Generates one row of samples with the scalar path, from "first" up to (but not including) "last".
+    void sampleRowScalar(int y, int startX, int first, int last, unsigned short* heights) const;
+};
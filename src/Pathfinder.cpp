@@ -0,0 +1,554 @@
+#include "Pathfinder.h"
+#include "TaskScheduler.h"
+#include <queue>
+
+using namespace glm;
+
+namespace
+{
+    // An entry in a search's open list: the priority and the index of the node.
+    using OpenEntry = std::pair<float, int>;
+    using OpenList = std::priority_queue<OpenEntry, std::vector<OpenEntry>, std::greater<OpenEntry>>;
+
+    const ivec2 NEIGHBOR_OFFSETS[8]
+    {
+        ivec2(-1, -1), ivec2(0, -1), ivec2(1, -1),
+        ivec2(-1,  0),               ivec2(1,  0),
+        ivec2(-1,  1), ivec2(0,  1), ivec2(1,  1),
+    };
+}
+
+Pathfinder::Pathfinder(const World& world, unsigned int clusterSize)
+    : world { world }, clusterSize { clusterSize }
+{
+    rebuild();
+}
+
+void Pathfinder::rebuild()
+{
+    nodes.clear();
+    clusters.clear();
+
+    if (world.heightmap)
+    {
+        gridSize = ivec2(world.heightmap->getWidth(), world.heightmap->getHeight());
+    }
+    else if (world.heightSource && world.heightSource->isBounded())
+    {
+        gridSize = world.heightSource->getSize();
+    }
+    else
+    {
+        // The cluster graph covers a fixed grid, so unbounded terrain can't be searched.
+        return;
+    }
+
+    clusterCount = (gridSize + static_cast<int>(clusterSize) - 1) / static_cast<int>(clusterSize);
+    pixelSpacing = vec2(world.dimensions.x, world.dimensions.z) / vec2(gridSize - 1);
+
+    for (int y { 0 }; y < clusterCount.y; y++)
+    {
+        for (int x { 0 }; x < clusterCount.x; x++)
+        {
+            std::unique_ptr<Cluster> cluster { new Cluster() };
+            cluster->min = ivec2(x, y) * static_cast<int>(clusterSize);
+            cluster->max = min(cluster->min + static_cast<int>(clusterSize) - 1, gridSize - 1);
+            clusters.push_back(std::move(cluster));
+        }
+    }
+
+    for (int y { 0 }; y < clusterCount.y; y++)
+    {
+        for (int x { 0 }; x < clusterCount.x; x++)
+        {
+            const Cluster& cluster { *clusters[y * clusterCount.x + x] };
+
+            // Border with the cluster to the right.
+            if (x + 1 < clusterCount.x)
+            {
+                addTransitions(ivec2(cluster.max.x, cluster.min.y), ivec2(0, 1), ivec2(1, 0), cluster.max.y - cluster.min.y + 1);
+            }
+
+            // Border with the cluster below.
+            if (y + 1 < clusterCount.y)
+            {
+                addTransitions(ivec2(cluster.min.x, cluster.max.y), ivec2(1, 0), ivec2(0, 1), cluster.max.x - cluster.min.x + 1);
+            }
+        }
+    }
+}
+
+int Pathfinder::getClusterIndex(ivec2 pixel) const
+{
+    ivec2 clusterIndices { pixel / static_cast<int>(clusterSize) };
+    return clusterIndices.y * clusterCount.x + clusterIndices.x;
+}
+
+float Pathfinder::getHeight(ivec2 pixel) const
+{
+    return world.getTerrainHeightAtPixel(pixel.x, pixel.y);
+}
+
+ivec2 Pathfinder::toPixel(const vec3& position) const
+{
+    // Same mapping as World::getTerrainHeightAtPosition().
+    vec2 pixelScaledPosition { vec2(position.x, position.z) / pixelSpacing };
+    return clamp(ivec2(round(pixelScaledPosition)), ivec2(0), gridSize - 1);
+}
+
+vec3 Pathfinder::toWorld(ivec2 pixel) const
+{
+    return vec3(pixel.x * pixelSpacing.x, getHeight(pixel), pixel.y * pixelSpacing.y);
+}
+
+float Pathfinder::getStepCost(ivec2 from, ivec2 to) const
+{
+    float run { length(vec2(to - from) * pixelSpacing) };
+    float toHeight { getHeight(to) };
+    float rise { abs(toHeight - getHeight(from)) };
+
+    if (rise > run * maxSlope)
+    {
+        // Too steep to walk.
+        return INFINITY;
+    }
+
+    float cost { run + rise * slopeCost };
+
+    if (toHeight < world.waterHeight)
+    {
+        cost *= waterCost;
+    }
+
+    return cost;
+}
+
+float Pathfinder::getHeuristic(ivec2 from, ivec2 to) const
+{
+    // Octile distance in world units; every step costs at least its horizontal length, so this never overestimates.
+    ivec2 delta { abs(to - from) };
+    int diagonalSteps { std::min(delta.x, delta.y) };
+    return diagonalSteps * length(pixelSpacing) + (delta.x - diagonalSteps) * pixelSpacing.x + (delta.y - diagonalSteps) * pixelSpacing.y;
+}
+
+void Pathfinder::addTransitions(ivec2 borderStart, ivec2 along, ivec2 across, int length)
+{
+    int runStart { -1 };
+
+    // Find each stretch of the border that can be crossed and place transitions along it.
+    // Loop one past the end so that a stretch reaching the end of the border is closed off.
+    for (int i { 0 }; i <= length; i++)
+    {
+        ivec2 pixel { borderStart + along * i };
+        bool crossable { i < length && getStepCost(pixel, pixel + across) < INFINITY };
+
+        if (crossable && runStart < 0)
+        {
+            runStart = i;
+        }
+        else if (!crossable && runStart >= 0)
+        {
+            int runEnd { i - 1 };
+
+            if (runEnd - runStart + 1 >= LONG_ENTRANCE_LENGTH)
+            {
+                addTransition(borderStart + along * runStart, across);
+                addTransition(borderStart + along * runEnd, across);
+            }
+            else
+            {
+                addTransition(borderStart + along * ((runStart + runEnd) / 2), across);
+            }
+
+            runStart = -1;
+        }
+    }
+}
+
+void Pathfinder::addTransition(ivec2 pixel, ivec2 across)
+{
+    int inside { addNode(pixel) };
+    int outside { addNode(pixel + across) };
+    nodes[inside].interEdges.push_back({ outside, getStepCost(pixel, pixel + across) });
+    nodes[outside].interEdges.push_back({ inside, getStepCost(pixel + across, pixel) });
+}
+
+int Pathfinder::addNode(ivec2 pixel)
+{
+    int id { static_cast<int>(nodes.size()) };
+    Cluster& cluster { *clusters[getClusterIndex(pixel)] };
+
+    Node node {};
+    node.pixel = pixel;
+    node.cluster = getClusterIndex(pixel);
+    node.localIndex = static_cast<int>(cluster.nodes.size());
+    nodes.push_back(node);
+    cluster.nodes.push_back(id);
+
+    return id;
+}
+
+void Pathfinder::buildIntraEdges(int clusterIndex) const
+{
+    Cluster& cluster { *clusters[clusterIndex] };
+
+    // Only the first query to reach this cluster builds its graph; any others wait for it to finish.
+    std::call_once(cluster.intraEdgesBuilt, [&] ()
+    {
+        std::vector<ivec2> targets {};
+        for (int id : cluster.nodes)
+        {
+            targets.push_back(nodes[id].pixel);
+        }
+
+        cluster.intraEdges.resize(cluster.nodes.size());
+        std::vector<float> costs {};
+
+        for (size_t i { 0 }; i < cluster.nodes.size(); i++)
+        {
+            searchGridToAll(targets[i], cluster.min, cluster.max, false, targets, costs);
+
+            for (size_t j { 0 }; j < cluster.nodes.size(); j++)
+            {
+                if (i != j && costs[j] < INFINITY)
+                {
+                    cluster.intraEdges[i].push_back({ cluster.nodes[j], costs[j] });
+                }
+            }
+        }
+    });
+}
+
+float Pathfinder::searchGrid(ivec2 start, ivec2 goal, ivec2 boundsMin, ivec2 boundsMax, std::vector<ivec2>* path) const
+{
+    ivec2 size { boundsMax - boundsMin + 1 };
+    auto getLocalIndex = [&] (ivec2 pixel) { return (pixel.y - boundsMin.y) * size.x + (pixel.x - boundsMin.x); };
+
+    std::vector<float> costSoFar(size.x * size.y, INFINITY);
+    std::vector<int> cameFrom(size.x * size.y, -1);
+    std::vector<char> closed(size.x * size.y, 0);
+    OpenList open {};
+
+    int startIndex { getLocalIndex(start) };
+    int goalIndex { getLocalIndex(goal) };
+    costSoFar[startIndex] = 0;
+    open.emplace(getHeuristic(start, goal), startIndex);
+
+    while (!open.empty())
+    {
+        int current { open.top().second };
+        open.pop();
+
+        if (closed[current])
+        {
+            continue;
+        }
+
+        closed[current] = 1;
+
+        if (current == goalIndex)
+        {
+            break;
+        }
+
+        ivec2 pixel { boundsMin + ivec2(current % size.x, current / size.x) };
+
+        for (ivec2 offset : NEIGHBOR_OFFSETS)
+        {
+            ivec2 neighbor { pixel + offset };
+
+            if (any(lessThan(neighbor, boundsMin)) || any(greaterThan(neighbor, boundsMax)))
+            {
+                continue;
+            }
+
+            int neighborIndex { getLocalIndex(neighbor) };
+            float newCost { costSoFar[current] + getStepCost(pixel, neighbor) };
+
+            if (newCost < costSoFar[neighborIndex])
+            {
+                costSoFar[neighborIndex] = newCost;
+                cameFrom[neighborIndex] = current;
+                open.emplace(newCost + getHeuristic(neighbor, goal), neighborIndex);
+            }
+        }
+    }
+
+    if (path && costSoFar[goalIndex] < INFINITY)
+    {
+        path->clear();
+
+        for (int index { goalIndex }; index != -1; index = cameFrom[index])
+        {
+            path->push_back(boundsMin + ivec2(index % size.x, index / size.x));
+        }
+
+        std::reverse(path->begin(), path->end());
+    }
+
+    return costSoFar[goalIndex];
+}
+
+void Pathfinder::searchGridToAll(ivec2 source, ivec2 boundsMin, ivec2 boundsMax, bool reverse,
+    const std::vector<ivec2>& targets, std::vector<float>& costs) const
+{
+    ivec2 size { boundsMax - boundsMin + 1 };
+    auto getLocalIndex = [&] (ivec2 pixel) { return (pixel.y - boundsMin.y) * size.x + (pixel.x - boundsMin.x); };
+
+    std::vector<float> costSoFar(size.x * size.y, INFINITY);
+    std::vector<char> closed(size.x * size.y, 0);
+    OpenList open {};
+
+    // Count how many distinct targets still need to be reached so that the search can stop early.
+    std::vector<char> isTarget(size.x * size.y, 0);
+    size_t targetsRemaining { 0 };
+    for (ivec2 target : targets)
+    {
+        if (!isTarget[getLocalIndex(target)])
+        {
+            isTarget[getLocalIndex(target)] = 1;
+            targetsRemaining++;
+        }
+    }
+
+    costSoFar[getLocalIndex(source)] = 0;
+    open.emplace(0.0f, getLocalIndex(source));
+
+    while (!open.empty() && targetsRemaining > 0)
+    {
+        int current { open.top().second };
+        open.pop();
+
+        if (closed[current])
+        {
+            continue;
+        }
+
+        closed[current] = 1;
+
+        if (isTarget[current])
+        {
+            targetsRemaining--;
+        }
+
+        ivec2 pixel { boundsMin + ivec2(current % size.x, current / size.x) };
+
+        for (ivec2 offset : NEIGHBOR_OFFSETS)
+        {
+            ivec2 neighbor { pixel + offset };
+
+            if (any(lessThan(neighbor, boundsMin)) || any(greaterThan(neighbor, boundsMax)))
+            {
+                continue;
+            }
+
+            int neighborIndex { getLocalIndex(neighbor) };
+            float stepCost { reverse ? getStepCost(neighbor, pixel) : getStepCost(pixel, neighbor) };
+            float newCost { costSoFar[current] + stepCost };
+
+            if (newCost < costSoFar[neighborIndex])
+            {
+                costSoFar[neighborIndex] = newCost;
+                open.emplace(newCost, neighborIndex);
+            }
+        }
+    }
+
+    costs.resize(targets.size());
+    for (size_t i { 0 }; i < targets.size(); i++)
+    {
+        costs[i] = costSoFar[getLocalIndex(targets[i])];
+    }
+}
+
+Path Pathfinder::findPath(const PathQuery& query) const
+{
+    Path result {};
+
+    if (clusters.empty())
+    {
+        return result;
+    }
+
+    ivec2 start { toPixel(query.start) };
+    ivec2 goal { toPixel(query.goal) };
+    int startCluster { getClusterIndex(start) };
+    int goalCluster { getClusterIndex(goal) };
+    std::vector<ivec2> pixels {};
+
+    if (startCluster == goalCluster)
+    {
+        // Try a direct search within the cluster first.
+        // If it fails, the path may still exist by leaving the cluster, so fall through to the abstract search.
+        const Cluster& cluster { *clusters[startCluster] };
+        float cost { searchGrid(start, goal, cluster.min, cluster.max, &pixels) };
+
+        if (cost < INFINITY)
+        {
+            result.found = true;
+            result.cost = cost;
+        }
+    }
+
+    if (!result.found)
+    {
+        const Cluster& startClusterRef { *clusters[startCluster] };
+        const Cluster& goalClusterRef { *clusters[goalCluster] };
+
+        // Connect the start and goal to the transitions of their clusters.
+        std::vector<ivec2> startTargets {};
+        for (int id : startClusterRef.nodes)
+        {
+            startTargets.push_back(nodes[id].pixel);
+        }
+
+        std::vector<ivec2> goalTargets {};
+        for (int id : goalClusterRef.nodes)
+        {
+            goalTargets.push_back(nodes[id].pixel);
+        }
+
+        std::vector<float> startCosts {};
+        std::vector<float> goalCosts {};
+        searchGridToAll(start, startClusterRef.min, startClusterRef.max, false, startTargets, startCosts);
+        searchGridToAll(goal, goalClusterRef.min, goalClusterRef.max, true, goalTargets, goalCosts);
+
+        // A* over the abstract graph; the start and goal get temporary ids after the transition nodes.
+        int startId { static_cast<int>(nodes.size()) };
+        int goalId { startId + 1 };
+        auto getPixel = [&] (int id) { return id == startId ? start : (id == goalId ? goal : nodes[id].pixel); };
+
+        std::vector<float> costSoFar(nodes.size() + 2, INFINITY);
+        std::vector<int> cameFrom(nodes.size() + 2, -1);
+        std::vector<char> closed(nodes.size() + 2, 0);
+        OpenList open {};
+
+        auto relax = [&] (int from, int to, float cost)
+        {
+            float newCost { costSoFar[from] + cost };
+            if (newCost < costSoFar[to])
+            {
+                costSoFar[to] = newCost;
+                cameFrom[to] = from;
+                open.emplace(newCost + getHeuristic(getPixel(to), goal), to);
+            }
+        };
+
+        costSoFar[startId] = 0;
+        open.emplace(getHeuristic(start, goal), startId);
+
+        while (!open.empty())
+        {
+            int current { open.top().second };
+            open.pop();
+
+            if (closed[current])
+            {
+                continue;
+            }
+
+            closed[current] = 1;
+
+            if (current == goalId)
+            {
+                break;
+            }
+            else if (current == startId)
+            {
+                for (size_t i { 0 }; i < startClusterRef.nodes.size(); i++)
+                {
+                    relax(startId, startClusterRef.nodes[i], startCosts[i]);
+                }
+            }
+            else
+            {
+                const Node& node { nodes[current] };
+
+                for (const Edge& edge : node.interEdges)
+                {
+                    relax(current, edge.target, edge.cost);
+                }
+
+                buildIntraEdges(node.cluster);
+                for (const Edge& edge : clusters[node.cluster]->intraEdges[node.localIndex])
+                {
+                    relax(current, edge.target, edge.cost);
+                }
+
+                if (node.cluster == goalCluster)
+                {
+                    relax(current, goalId, goalCosts[node.localIndex]);
+                }
+            }
+        }
+
+        if (costSoFar[goalId] == INFINITY)
+        {
+            return result;
+        }
+
+        std::vector<int> abstractPath {};
+        for (int id { goalId }; id != -1; id = cameFrom[id])
+        {
+            abstractPath.push_back(id);
+        }
+        std::reverse(abstractPath.begin(), abstractPath.end());
+
+        // Refine each abstract step into heightmap pixels.
+        // Steps within a cluster are searched again inside that cluster; steps across a border are a single pixel.
+        pixels = { start };
+        std::vector<ivec2> segment {};
+
+        for (size_t i { 1 }; i < abstractPath.size(); i++)
+        {
+            ivec2 from { getPixel(abstractPath[i - 1]) };
+            ivec2 to { getPixel(abstractPath[i]) };
+
+            if (from == to)
+            {
+                continue;
+            }
+            else if (getClusterIndex(from) != getClusterIndex(to))
+            {
+                pixels.push_back(to);
+            }
+            else
+            {
+                const Cluster& cluster { *clusters[getClusterIndex(from)] };
+                searchGrid(from, to, cluster.min, cluster.max, &segment);
+                pixels.insert(pixels.end(), segment.begin() + 1, segment.end());
+            }
+        }
+
+        result.found = true;
+        result.cost = costSoFar[goalId];
+    }
+
+    for (ivec2 pixel : pixels)
+    {
+        result.waypoints.push_back(toWorld(pixel));
+    }
+
+    return result;
+}
+
+std::vector<Path> Pathfinder::findPaths(const std::vector<PathQuery>& queries, unsigned int threadCount) const
+{
+    std::vector<Path> results(queries.size());
+
+    TaskScheduler::getShared().parallelFor(queries.size(), [&] (size_t i)
+    {
+        results[i] = findPath(queries[i]);
+    }, threadCount);
+
+    return results;
+}
+
+void Pathfinder::buildClusterGraphs(unsigned int threadCount) const
+{
+    // Clusters with more transitions take longer, so the threads claim them one at a time rather than in even shares.
+    TaskScheduler::getShared().parallelFor(clusters.size(), [&] (size_t i)
+    {
+        buildIntraEdges(static_cast<int>(i));
+    }, threadCount);
+}
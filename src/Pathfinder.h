@@ -0,0 +1,152 @@
+#pragma once
+#include "ofMain.h"
+#include "World.h"
+#include <memory>
+#include <mutex>
+
+// A request for a path between two positions in world space.
+struct PathQuery
+{
+    // The position the path starts from.
+    glm::vec3 start {};
+
+    // The position the path should reach.
+    glm::vec3 goal {};
+};
+
+// The result of a single path query.
+struct Path
+{
+    // Set to true if the goal could be reached from the start.
+    bool found { false };
+
+    // The total cost of the path (world-space distance, weighted for slope and water).
+    float cost { 0 };
+
+    // The waypoints of the path in world space, from the start to the goal.
+    std::vector<glm::vec3> waypoints {};
+};
+
+// A hierarchical (HPA*-style) pathfinder over the world heightmap.
+// The heightmap is divided into square clusters, and the transitions between neighbouring clusters form an abstract graph.
+// Queries search the abstract graph first and then only refine the clusters along the chosen route at full resolution,
+// so a query across the whole map never has to scan every pixel.
+class Pathfinder
+{
+public:
+    // Initializes the pathfinder for a world.  The world (and its heightmap) must outlive the pathfinder.
+    // "clusterSize" is the width of each cluster in heightmap pixels; usually the same as the CellManager's cell size.
+    Pathfinder(const World& world, unsigned int clusterSize);
+
+    // Don't support copy constructor or copy assignment operator.
+    Pathfinder(const Pathfinder& p) = delete;
+    Pathfinder& operator= (const Pathfinder& p) = delete;
+
+    // Finds a path between two positions.  This function can be called from several threads at once.
+    Path findPath(const PathQuery& query) const;
+
+    // Finds paths for a batch of queries, spreading them across the shared TaskScheduler.
+    // At most threadCount threads work on the batch at once; if it's zero, every worker may join in.
+    std::vector<Path> findPaths(const std::vector<PathQuery>& queries, unsigned int threadCount = 0) const;
+
+    // Builds the graph of every cluster up front, spread across the shared TaskScheduler, rather than leaving each one to
+    // the first query that passes through it (which can make a query across a fresh map take seconds).
+    // At most threadCount threads do the work at once; if it's zero, every worker may join in.
+    // This can be called while queries are running, but needs calling again after rebuild().
+    void buildClusterGraphs(unsigned int threadCount = 0) const;
+
+    // Discards all cached cluster graphs and rebuilds the transitions between clusters.
+    // This must be called after changing the heightmap or any of the cost parameters below,
+    // and must not be called while queries are running.
+    void rebuild();
+
+    // The steepest step (rise over run) that can be walked.
+    // 1 corresponds to the 45 degree limit used by CharacterPhysics::update().
+    float maxSlope { 1.0f };
+
+    // The extra cost per unit of height climbed or descended.
+    float slopeCost { 2.0f };
+
+    // The factor by which steps into terrain below the world's water height are more expensive.
+    float waterCost { 4.0f };
+
+private:
+    // An edge in the abstract graph.
+    struct Edge
+    {
+        int target;
+        float cost;
+    };
+
+    // A transition point on the border of a cluster.
+    struct Node
+    {
+        glm::ivec2 pixel;
+        int cluster;
+
+        // The index of the node within its cluster's node list.
+        int localIndex;
+
+        // Edges to the matching node on the other side of the cluster border.
+        std::vector<Edge> interEdges;
+    };
+
+    // A square region of the heightmap with its cached graph of transitions.
+    struct Cluster
+    {
+        // The inclusive pixel bounds of the cluster.
+        glm::ivec2 min;
+        glm::ivec2 max;
+
+        // The transition nodes on the border of this cluster.
+        std::vector<int> nodes {};
+
+        // Edges between the transition nodes within this cluster, parallel to "nodes".
+        // Only built the first time a query passes through the cluster, unless buildClusterGraphs() builds them all first.
+        std::vector<std::vector<Edge>> intraEdges {};
+        std::once_flag intraEdgesBuilt {};
+    };
+
+    // Borders that stay open for at least this many pixels get a transition at each end instead of one in the middle.
+    const static int LONG_ENTRANCE_LENGTH { 6 };
+
+    const World& world;
+    unsigned int clusterSize;
+
+    // The dimensions of the heightmap in pixels.
+    glm::ivec2 gridSize {};
+
+    // The number of clusters in each dimension.
+    glm::ivec2 clusterCount {};
+
+    // The world-space distance between neighbouring pixels.
+    glm::vec2 pixelSpacing {};
+
+    std::vector<Node> nodes {};
+    std::vector<std::unique_ptr<Cluster>> clusters {};
+
+    int getClusterIndex(glm::ivec2 pixel) const;
+    float getHeight(glm::ivec2 pixel) const;
+    glm::ivec2 toPixel(const glm::vec3& position) const;
+    glm::vec3 toWorld(glm::ivec2 pixel) const;
+
+    // The cost of stepping between two neighbouring pixels, or infinity if the step is too steep.
+    float getStepCost(glm::ivec2 from, glm::ivec2 to) const;
+
+    // An admissible estimate of the cost between two pixels.
+    float getHeuristic(glm::ivec2 from, glm::ivec2 to) const;
+
+    void addTransitions(glm::ivec2 borderStart, glm::ivec2 along, glm::ivec2 across, int length);
+    void addTransition(glm::ivec2 pixel, glm::ivec2 across);
+    int addNode(glm::ivec2 pixel);
+    void buildIntraEdges(int clusterIndex) const;
+
+    // A* search between two pixels, restricted to a rectangle of the heightmap.
+    // Returns the cost of the path (infinity if there is none) and optionally fills in the pixels along the way.
+    float searchGrid(glm::ivec2 start, glm::ivec2 goal, glm::ivec2 boundsMin, glm::ivec2 boundsMax, std::vector<glm::ivec2>* path) const;
+
+    // Dijkstra search from one pixel to each of a set of targets, restricted to a rectangle of the heightmap.
+    // If "reverse" is true, the costs are for travelling from each target to the source instead.
+    void searchGridToAll(glm::ivec2 source, glm::ivec2 boundsMin, glm::ivec2 boundsMax, bool reverse,
+        const std::vector<glm::ivec2>& targets, std::vector<float>& costs) const;
+};
@@ -0,0 +1,247 @@
+#include "Profiler.h"
+#include <fstream>
+#include <map>
+#include <mutex>
+
+std::atomic<bool> Profiler::detail::enabled { false };
+
+namespace
+{
+    enum class EventType
+    {
+        Zone,
+        Counter,
+    };
+
+    struct Event
+    {
+        const char* name;
+        EventType type;
+
+        // For zones, the start and end times; for counters, both are the time of the sample.
+        int64_t start;
+        int64_t end;
+
+        // Only used by counters.
+        double value;
+    };
+
+    // The events recorded by one thread.
+    struct ThreadBuffer
+    {
+        // Only ever contended while exporting or summarizing.
+        std::mutex mutex {};
+
+        std::vector<Event> events {};
+
+        // The total number of events ever written; the next event goes at written % size.
+        size_t written { 0 };
+
+        unsigned int threadId { 0 };
+        std::string threadName {};
+    };
+
+    // Every thread's buffer, kept alive after the thread exits so that its events can still be exported.
+    struct Registry
+    {
+        std::mutex mutex {};
+        std::vector<std::shared_ptr<ThreadBuffer>> buffers {};
+        unsigned int nextThreadId { 1 };
+        std::chrono::steady_clock::time_point epoch { std::chrono::steady_clock::now() };
+    };
+
+    Registry& getRegistry()
+    {
+        static Registry registry {};
+        return registry;
+    }
+
+    ThreadBuffer& getThreadBuffer()
+    {
+        thread_local std::shared_ptr<ThreadBuffer> buffer {};
+
+        if (!buffer)
+        {
+            buffer = std::make_shared<ThreadBuffer>();
+            buffer->events.resize(Profiler::EVENTS_PER_THREAD);
+
+            Registry& registry { getRegistry() };
+            std::lock_guard<std::mutex> lock { registry.mutex };
+            buffer->threadId = registry.nextThreadId++;
+            buffer->threadName = "Thread " + ofToString(buffer->threadId);
+            registry.buffers.push_back(buffer);
+        }
+
+        return *buffer;
+    }
+
+    void pushEvent(const Event& event)
+    {
+        ThreadBuffer& buffer { getThreadBuffer() };
+        std::lock_guard<std::mutex> lock { buffer.mutex };
+        buffer.events[buffer.written % buffer.events.size()] = event;
+        buffer.written++;
+    }
+
+    // Calls a function for every buffer, with the buffer locked, and its events oldest first.
+    template<typename Function>
+    void forEachBuffer(Function function)
+    {
+        std::vector<std::shared_ptr<ThreadBuffer>> buffers {};
+        {
+            Registry& registry { getRegistry() };
+            std::lock_guard<std::mutex> lock { registry.mutex };
+            buffers = registry.buffers;
+        }
+
+        for (const std::shared_ptr<ThreadBuffer>& buffer : buffers)
+        {
+            std::lock_guard<std::mutex> lock { buffer->mutex };
+            size_t size { buffer->events.size() };
+            size_t count { std::min(buffer->written, size) };
+            size_t first { buffer->written - count };
+
+            std::vector<Event> events {};
+            events.reserve(count);
+            for (size_t i { first }; i < buffer->written; i++)
+            {
+                events.push_back(buffer->events[i % size]);
+            }
+
+            function(*buffer, events);
+        }
+    }
+}
+
+void Profiler::setEnabled(bool enabled)
+{
+    detail::enabled = enabled;
+}
+
+void Profiler::setThreadName(const char* name)
+{
+    ThreadBuffer& buffer { getThreadBuffer() };
+    std::lock_guard<std::mutex> lock { buffer.mutex };
+    buffer.threadName = name;
+}
+
+int64_t Profiler::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - getRegistry().epoch).count();
+}
+
+void Profiler::recordZone(const char* name, int64_t start, int64_t end)
+{
+    pushEvent({ name, EventType::Zone, start, end, 0 });
+}
+
+void Profiler::recordCounter(const char* name, double value)
+{
+    int64_t time { now() };
+    pushEvent({ name, EventType::Counter, time, time, value });
+}
+
+void Profiler::clear()
+{
+    forEachBuffer([] (ThreadBuffer& buffer, const std::vector<Event>&)
+    {
+        buffer.written = 0;
+    });
+}
+
+bool Profiler::writeChromeTrace(const std::string& filePath)
+{
+    std::ofstream file { filePath };
+    file << "{\"traceEvents\":[\n";
+    file.precision(15);
+
+    bool first { true };
+    auto separator = [&] ()
+    {
+        file << (first ? "" : ",\n");
+        first = false;
+    };
+
+    forEachBuffer([&] (ThreadBuffer& buffer, const std::vector<Event>& events)
+    {
+        separator();
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer.threadId
+            << ",\"args\":{\"name\":\"" << buffer.threadName << "\"}}";
+
+        // Trace timestamps are in microseconds.
+        for (const Event& event : events)
+        {
+            separator();
+
+            if (event.type == EventType::Zone)
+            {
+                file << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer.threadId
+                    << ",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << (event.end - event.start) / 1000.0 << "}";
+            }
+            else
+            {
+                file << "{\"name\":\"" << event.name << "\",\"ph\":\"C\",\"pid\":1,\"tid\":" << buffer.threadId
+                    << ",\"ts\":" << event.start / 1000.0 << ",\"args\":{\"value\":" << event.value << "}}";
+            }
+        }
+    });
+
+    file << "\n]}\n";
+
+    if (!file)
+    {
+        ofLogError("Profiler") << "Couldn't write " << filePath << ".";
+        return false;
+    }
+
+    return true;
+}
+
+void Profiler::summarize(double windowSeconds, std::vector<ZoneSummary>& zones, std::vector<CounterSummary>& counters)
+{
+    int64_t cutoff { now() - static_cast<int64_t>(windowSeconds * 1e9) };
+    std::map<std::string, ZoneSummary> zonesByName {};
+    std::map<std::string, std::pair<int64_t, double>> countersByName {};
+
+    forEachBuffer([&] (ThreadBuffer&, const std::vector<Event>& events)
+    {
+        for (const Event& event : events)
+        {
+            if (event.type == EventType::Zone && event.end >= cutoff)
+            {
+                ZoneSummary& zone { zonesByName[event.name] };
+                double milliseconds { (event.end - event.start) / 1e6 };
+                zone.calls++;
+                zone.totalMilliseconds += milliseconds;
+                zone.maxMilliseconds = std::max(zone.maxMilliseconds, milliseconds);
+            }
+            else if (event.type == EventType::Counter)
+            {
+                // Keep the most recent sample from any thread.
+                auto found = countersByName.find(event.name);
+                if (found == countersByName.end() || found->second.first <= event.start)
+                {
+                    countersByName[event.name] = { event.start, event.value };
+                }
+            }
+        }
+    });
+
+    zones.clear();
+    for (auto& entry : zonesByName)
+    {
+        entry.second.name = entry.first;
+        zones.push_back(entry.second);
+    }
+
+    std::sort(zones.begin(), zones.end(), [] (const ZoneSummary& a, const ZoneSummary& b)
+    {
+        return a.totalMilliseconds > b.totalMilliseconds;
+    });
+
+    counters.clear();
+    for (const auto& entry : countersByName)
+    {
+        counters.push_back({ entry.first, entry.second.second });
+    }
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include "ofMain.h"
+#include <atomic>
+#include <cstdint>
+
+// A lightweight instrumentation layer for finding where frame time goes.
+// Code marks timed zones with PROFILE_ZONE("Name") and reports values with PROFILE_COUNTER("Name", value).
+// Each thread records into its own ring buffer, so recording never waits on another thread,
+// and when profiling is switched off a zone costs a single flag check.
+// Defining DISABLE_PROFILER compiles all of it out.
+// Names must be string literals (or otherwise live forever) since only the pointer is stored.
+namespace Profiler
+{
+    // The number of events kept per thread; older events are overwritten.
+    const size_t EVENTS_PER_THREAD { 1 << 16 };
+
+    // The timing and count of one zone over the summary window.
+    struct ZoneSummary
+    {
+        std::string name {};
+        unsigned int calls { 0 };
+        double totalMilliseconds { 0 };
+        double maxMilliseconds { 0 };
+    };
+
+    // The latest value of one counter.
+    struct CounterSummary
+    {
+        std::string name {};
+        double value { 0 };
+    };
+
+    namespace detail
+    {
+        extern std::atomic<bool> enabled;
+    }
+
+    // Switches recording on or off.  Off by default.
+    void setEnabled(bool enabled);
+
+    inline bool isEnabled()
+    {
+        return detail::enabled.load(std::memory_order_relaxed);
+    }
+
+    // Names the calling thread in exported traces.
+    void setThreadName(const char* name);
+
+    // The time in nanoseconds since the profiler started.
+    int64_t now();
+
+    // Records a finished zone on the calling thread.
+    void recordZone(const char* name, int64_t start, int64_t end);
+
+    // Records the value of a counter at the current time.
+    void recordCounter(const char* name, double value);
+
+    // Throws away everything recorded so far.
+    void clear();
+
+    // Writes every recorded event in the Chrome trace event format, which chrome://tracing and Perfetto can open.
+    bool writeChromeTrace(const std::string& filePath);
+
+    // Sums up the zones that finished within the last "windowSeconds", sorted by total time, and the latest counter values.
+    void summarize(double windowSeconds, std::vector<ZoneSummary>& zones, std::vector<CounterSummary>& counters);
+
+    // Times the scope it's declared in.
+    class Zone
+    {
+    public:
+        explicit Zone(const char* name)
+            : name { name }, start { isEnabled() ? now() : -1 }
+        {
+        }
+
+        ~Zone()
+        {
+            if (start >= 0)
+            {
+                recordZone(name, start, now());
+            }
+        }
+
+        Zone(const Zone& z) = delete;
+        Zone& operator= (const Zone& z) = delete;
+
+    private:
+        const char* name;
+        int64_t start;
+    };
+}
+
+#define PROFILER_CONCATENATE_INNER(a, b) a##b
+#define PROFILER_CONCATENATE(a, b) PROFILER_CONCATENATE_INNER(a, b)
+
+#ifndef DISABLE_PROFILER
+#define PROFILE_ZONE(name) Profiler::Zone PROFILER_CONCATENATE(profileZone, __LINE__) { name }
+#define PROFILE_COUNTER(name, value) do { if (Profiler::isEnabled()) Profiler::recordCounter(name, static_cast<double>(value)); } while (false)
+#else
+#define PROFILE_ZONE(name) do { } while (false)
+#define PROFILE_COUNTER(name, value) do { } while (false)
+#endif
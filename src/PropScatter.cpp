@@ -0,0 +1,196 @@
+#include "PropScatter.h"
+
+namespace
+{
+    // A small generator whose sequence is the same with every compiler, unlike the standard library's distributions.
+    class ScatterRandom
+    {
+    public:
+        ScatterRandom(uint64_t seed)
+            : state{ seed }
+        {
+        }
+
+        // Returns a number in [0, 1).
+        float next()
+        {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            return static_cast<float>(state >> 40) / static_cast<float>(1 << 24);
+        }
+
+    private:
+        uint64_t state;
+    };
+
+    // Mixes a cell's position and a prop type's index into a seed (splitmix64's finalizer).
+    uint64_t getCellSeed(glm::ivec2 startIndices, unsigned int typeIndex)
+    {
+        uint64_t seed { (static_cast<uint64_t>(static_cast<uint32_t>(startIndices.x)) << 32 | static_cast<uint32_t>(startIndices.y))
+            ^ (static_cast<uint64_t>(typeIndex) * 0x9E3779B97F4A7C15ULL) };
+
+        seed = (seed ^ (seed >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        seed = (seed ^ (seed >> 27)) * 0x94D049BB133111EBULL;
+        return seed ^ (seed >> 31);
+    }
+
+    float getTileHeight(const ofShortPixels& heightTile, int x, int y, float heightmapScale)
+    {
+        return heightTile.getData()[y * heightTile.getWidth() + x] / static_cast<float>(USHRT_MAX) * heightmapScale;
+    }
+
+    // Adds a triangle with its own vertices, facing away from a point inside the mesh.
+    void addFacet(ofMesh& mesh, glm::vec3 a, glm::vec3 b, glm::vec3 c, glm::vec3 inside)
+    {
+        glm::vec3 normal { glm::normalize(glm::cross(b - a, c - a)) };
+        if (glm::dot(normal, (a + b + c) / 3.0f - inside) < 0)
+        {
+            std::swap(b, c);
+            normal = -normal;
+        }
+
+        for (const glm::vec3& vertex : { a, b, c })
+        {
+            mesh.addIndex(static_cast<ofIndexType>(mesh.getNumVertices()));
+            mesh.addVertex(vertex);
+            mesh.addNormal(normal);
+        }
+    }
+
+    // Adds the sides of a pyramid or prism around the y axis, with "sides" faces from one ring to another.
+    void addRings(ofMesh& mesh, unsigned int sides, float bottomY, float bottomRadius, float topY, float topRadius)
+    {
+        glm::vec3 inside { 0, (bottomY + topY) / 2, 0 };
+
+        for (unsigned int i { 0 }; i < sides; i++)
+        {
+            float angle0 { TWO_PI * i / sides };
+            float angle1 { TWO_PI * (i + 1) / sides };
+            glm::vec3 bottom0 { std::cos(angle0) * bottomRadius, bottomY, std::sin(angle0) * bottomRadius };
+            glm::vec3 bottom1 { std::cos(angle1) * bottomRadius, bottomY, std::sin(angle1) * bottomRadius };
+            glm::vec3 top0 { std::cos(angle0) * topRadius, topY, std::sin(angle0) * topRadius };
+            glm::vec3 top1 { std::cos(angle1) * topRadius, topY, std::sin(angle1) * topRadius };
+
+            addFacet(mesh, bottom0, bottom1, top0, inside);
+            if (topRadius > 0)
+            {
+                addFacet(mesh, bottom1, top1, top0, inside);
+            }
+        }
+    }
+}
+
+unsigned int getPropCapacity(const PropType& type, unsigned int cellSize)
+{
+    if (type.spacing <= 0)
+    {
+        return 0;
+    }
+
+    unsigned int columns { static_cast<unsigned int>(std::ceil(cellSize / type.spacing)) };
+    return columns * columns;
+}
+
+void scatterProps(std::vector<glm::vec4>& instances, const PropType& type, unsigned int typeIndex, const ofShortPixels& heightTile,
+    glm::ivec2 startIndices, glm::ivec2 meshSize, float heightmapScale, float waterHeight)
+{
+    instances.clear();
+
+    if (type.spacing <= 0 || meshSize.x <= 0 || meshSize.y <= 0)
+    {
+        return;
+    }
+
+    ScatterRandom random { getCellSeed(startIndices, typeIndex) };
+    unsigned int columns { static_cast<unsigned int>(std::ceil(meshSize.x / type.spacing)) };
+    unsigned int rows { static_cast<unsigned int>(std::ceil(meshSize.y / type.spacing)) };
+    float minHeight { waterHeight + type.minHeightAboveWater };
+    float maxHeight { type.maxHeightAboveWater < std::numeric_limits<float>::max() ? waterHeight + type.maxHeightAboveWater : type.maxHeightAboveWater };
+
+    for (unsigned int row { 0 }; row < rows; row++)
+    {
+        for (unsigned int column { 0 }; column < columns; column++)
+        {
+            // Draw every number for every grid point, so the sequence doesn't depend on which points are kept.
+            glm::vec2 position { (column + random.next()) * type.spacing, (row + random.next()) * type.spacing };
+            float chance { random.next() };
+            float size { random.next() };
+
+            if (chance >= type.density || position.x >= meshSize.x || position.y >= meshSize.y)
+            {
+                continue;
+            }
+
+            // The tile has a one-sample border, so pixel (0, 0) of the cell is at (1, 1) in the tile.
+            glm::vec2 tilePosition { position + 1.0f };
+            glm::ivec2 corner { glm::floor(tilePosition) };
+            glm::vec2 blend { tilePosition - glm::vec2(corner) };
+
+            float height { glm::mix(
+                glm::mix(getTileHeight(heightTile, corner.x, corner.y, heightmapScale), getTileHeight(heightTile, corner.x + 1, corner.y, heightmapScale), blend.x),
+                glm::mix(getTileHeight(heightTile, corner.x, corner.y + 1, heightmapScale), getTileHeight(heightTile, corner.x + 1, corner.y + 1, heightmapScale), blend.x),
+                blend.y) };
+
+            if (height < minHeight || height > maxHeight)
+            {
+                continue;
+            }
+
+            // The slope from central differences around the nearest sample.
+            glm::ivec2 nearest { glm::round(tilePosition) };
+            glm::vec2 gradient {
+                getTileHeight(heightTile, nearest.x + 1, nearest.y, heightmapScale) - getTileHeight(heightTile, nearest.x - 1, nearest.y, heightmapScale),
+                getTileHeight(heightTile, nearest.x, nearest.y + 1, heightmapScale) - getTileHeight(heightTile, nearest.x, nearest.y - 1, heightmapScale) };
+
+            if (glm::length(gradient) * 0.5f > type.maxSlope)
+            {
+                continue;
+            }
+
+            instances.push_back(glm::vec4(startIndices.x + position.x, height, startIndices.y + position.y,
+                glm::mix(type.minScale, type.maxScale, size)));
+        }
+    }
+}
+
+void buildPropMesh(ofMesh& mesh, PropShape shape)
+{
+    mesh.clear();
+    mesh.setMode(OF_PRIMITIVE_TRIANGLES);
+
+    switch (shape)
+    {
+    case PropShape::Tree:
+        // The trunk starts below the origin so that trees on slopes don't float.
+        addRings(mesh, 4, -0.1f, 0.05f, 0.3f, 0.05f);
+        addRings(mesh, 8, 0.2f, 0.3f, 1, 0);
+
+        // Close the underside of the cone.
+        for (unsigned int i { 0 }; i < 8; i++)
+        {
+            float angle0 { TWO_PI * i / 8 };
+            float angle1 { TWO_PI * (i + 1) / 8 };
+            addFacet(mesh, glm::vec3(std::cos(angle0) * 0.3f, 0.2f, std::sin(angle0) * 0.3f), glm::vec3(std::cos(angle1) * 0.3f, 0.2f, std::sin(angle1) * 0.3f),
+                glm::vec3(0, 0.2f, 0), glm::vec3(0, 0.5f, 0));
+        }
+        break;
+
+    case PropShape::Rock:
+    {
+        glm::vec3 inside { 0, 0.3f, 0 };
+        glm::vec3 top { 0.1f, 1, -0.05f };
+        glm::vec3 bottom { 0, -0.3f, 0 };
+        glm::vec3 sides[] { { 0.9f, 0.3f, 0 }, { 0, 0.4f, 0.7f }, { -0.8f, 0.2f, 0 }, { 0, 0.3f, -0.75f } };
+
+        for (unsigned int i { 0 }; i < 4; i++)
+        {
+            addFacet(mesh, sides[i], sides[(i + 1) % 4], top, inside);
+            addFacet(mesh, sides[i], sides[(i + 1) % 4], bottom, inside);
+        }
+        break;
+    }
+
+    case PropShape::Tuft:
+        addRings(mesh, 3, -0.1f, 0.4f, 1, 0);
+        break;
+    }
+}
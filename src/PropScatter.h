@@ -0,0 +1,60 @@
+#pragma once
+#include "ofMain.h"
+
+// The meshes that props can be drawn with (see buildPropMesh()).
+enum class PropShape
+{
+    // A cone on a short trunk.
+    Tree,
+
+    // A squashed, lopsided octahedron.
+    Rock,
+
+    // A low pyramid, for grass and shrubs.
+    Tuft,
+};
+
+// A kind of prop scattered over the terrain cells.  Lengths and heights are in the space of the cell meshes,
+// where a pixel is one unit across.
+struct PropType
+{
+    PropShape shape { PropShape::Tree };
+
+    // The props' color, before lighting.
+    glm::vec3 color { 1 };
+
+    // Props are placed on a grid of this spacing (in pixels), each jittered by up to a grid square.
+    float spacing { 8 };
+
+    // The chance of a grid point getting a prop, before the slope and height are checked.
+    float density { 0.5f };
+
+    // The steepest terrain (rise over run) the props stand on.
+    float maxSlope { 1 };
+
+    // The range of heights above the water (see CellManager::setWaterHeight()) the props stand at.
+    float minHeightAboveWater { 0 };
+    float maxHeightAboveWater { std::numeric_limits<float>::max() };
+
+    // The range of sizes of the props, as scales of their unit-high mesh.
+    float minScale { 1 };
+    float maxScale { 1 };
+
+    // The props are drawn at full density out to the first distance, then thin out until there are none at the second.
+    float fullDensityDistance { 128 };
+    float drawDistance { 256 };
+};
+
+// The most props of a type that scatterProps() can place on a cell of a given size, one per grid point.
+unsigned int getPropCapacity(const PropType& type, unsigned int cellSize);
+
+// Scatters props of a type over a cell from its height tile (as sampled by CellManager, with a one-sample border),
+// writing each prop as (x, y, z, scale) in the space of the cell's mesh.  The grid points are jittered by a random
+// generator seeded from the cell's position and the type's index, so a cell always gets the same props however
+// often and on whichever thread it's loaded.  Props are left off slopes steeper than the type allows and off heights
+// outside its range above the water.
+void scatterProps(std::vector<glm::vec4>& instances, const PropType& type, unsigned int typeIndex, const ofShortPixels& heightTile,
+    glm::ivec2 startIndices, glm::ivec2 meshSize, float heightmapScale, float waterHeight);
+
+// Builds a prop's mesh, one unit high, standing on the origin, with flat normals and indices for instanced drawing.
+void buildPropMesh(ofMesh& mesh, PropShape shape);
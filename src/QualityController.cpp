@@ -0,0 +1,162 @@
+#include "QualityController.h"
+#include <algorithm>
+
+namespace
+{
+    // How much each frame counts towards the smoothed frame time.
+    const double SMOOTHING { 0.1 };
+
+    // The dead band: quality drops above this fraction of the target, and rises below this one.
+    const double LOWER_ABOVE { 1.1 };
+    const double RAISE_BELOW { 0.75 };
+
+    // Frames to wait after any change before judging it, so that the smoothed frame time catches up
+    // and cells rebuilt at a new level of detail have loaded.
+    const unsigned int SETTLE_FRAMES { 30 };
+
+    // Frames to wait after a step down before trying a step up, at first and at most.
+    const unsigned int MIN_RAISE_DELAY_FRAMES { 120 };
+    const unsigned int MAX_RAISE_DELAY_FRAMES { 3600 };
+
+    // A step down this soon after a step up means the step up was a mistake.
+    const unsigned int OSCILLATION_FRAMES { 300 };
+
+    // The quality doesn't rise while more cells than this are waiting to load.
+    const unsigned int BACKLOG_LIMIT { 4 };
+}
+
+QualityController::QualityController(double targetFrameMilliseconds, const QualityLimits& limits, const QualitySettings& initialSettings)
+    : targetFrameMilliseconds { targetFrameMilliseconds }, limits { limits }, settings { initialSettings }
+{
+    settings.activeCellPairs = std::max(limits.minActiveCellPairs, std::min(settings.activeCellPairs, limits.maxActiveCellPairs));
+    settings.meshLevelOfDetail = std::min(settings.meshLevelOfDetail, limits.maxMeshLevelOfDetail);
+    settings.highResDrawDistance = std::max(limits.minDrawDistance, std::min(settings.highResDrawDistance, getMaxDrawDistance()));
+    counters.raiseDelayFrames = MIN_RAISE_DELAY_FRAMES;
+    framesSinceStepUp = OSCILLATION_FRAMES;
+}
+
+void QualityController::setTargetFrameMilliseconds(double milliseconds)
+{
+    targetFrameMilliseconds = milliseconds;
+}
+
+double QualityController::getTargetFrameMilliseconds() const
+{
+    return targetFrameMilliseconds;
+}
+
+const QualitySettings& QualityController::getSettings() const
+{
+    return settings;
+}
+
+const QualityCounters& QualityController::getCounters() const
+{
+    return counters;
+}
+
+float QualityController::getMaxDrawDistance() const
+{
+    // An observer can be up to a cell off the center of its loaded square before the square moves.
+    float loadedDistance { (static_cast<float>(settings.activeCellPairs) - 1) * limits.cellSize };
+    return std::max(limits.minDrawDistance, std::min(limits.maxDrawDistance, loadedDistance));
+}
+
+bool QualityController::update(double cpuFrameMilliseconds, unsigned int pendingLoads)
+{
+    counters.averageFrameMilliseconds = counters.framesMeasured == 0 ? cpuFrameMilliseconds
+        : counters.averageFrameMilliseconds + (cpuFrameMilliseconds - counters.averageFrameMilliseconds) * SMOOTHING;
+    counters.framesMeasured++;
+    framesSinceChange++;
+    framesSinceStepUp = std::min(framesSinceStepUp + 1, OSCILLATION_FRAMES);
+
+    if (framesSinceChange < SETTLE_FRAMES)
+    {
+        return false;
+    }
+
+    if (counters.averageFrameMilliseconds > targetFrameMilliseconds * LOWER_ABOVE)
+    {
+        if (!stepDown())
+        {
+            return false;
+        }
+
+        if (framesSinceStepUp < OSCILLATION_FRAMES)
+        {
+            counters.oscillations++;
+            counters.raiseDelayFrames = std::min(counters.raiseDelayFrames * 2, MAX_RAISE_DELAY_FRAMES);
+        }
+
+        counters.stepsDown++;
+        framesSinceChange = 0;
+        return true;
+    }
+
+    if (counters.averageFrameMilliseconds < targetFrameMilliseconds * RAISE_BELOW && framesSinceChange >= counters.raiseDelayFrames)
+    {
+        if (pendingLoads > BACKLOG_LIMIT)
+        {
+            counters.heldForBacklog++;
+            return false;
+        }
+
+        if (!stepUp())
+        {
+            return false;
+        }
+
+        counters.stepsUp++;
+        framesSinceChange = 0;
+        framesSinceStepUp = 0;
+        return true;
+    }
+
+    return false;
+}
+
+bool QualityController::stepDown()
+{
+    if (settings.highResDrawDistance > limits.minDrawDistance)
+    {
+        settings.highResDrawDistance = std::max(limits.minDrawDistance, settings.highResDrawDistance - limits.drawDistanceStep);
+    }
+    else if (settings.meshLevelOfDetail < limits.maxMeshLevelOfDetail)
+    {
+        settings.meshLevelOfDetail++;
+    }
+    else if (settings.activeCellPairs > limits.minActiveCellPairs)
+    {
+        settings.activeCellPairs--;
+        settings.highResDrawDistance = std::min(settings.highResDrawDistance, getMaxDrawDistance());
+    }
+    else
+    {
+        // Already as low as it goes.
+        return false;
+    }
+
+    return true;
+}
+
+bool QualityController::stepUp()
+{
+    if (settings.activeCellPairs < limits.maxActiveCellPairs)
+    {
+        settings.activeCellPairs++;
+    }
+    else if (settings.meshLevelOfDetail > 0)
+    {
+        settings.meshLevelOfDetail--;
+    }
+    else if (settings.highResDrawDistance < getMaxDrawDistance())
+    {
+        settings.highResDrawDistance = std::min(getMaxDrawDistance(), settings.highResDrawDistance + limits.drawDistanceStep);
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <cstdint>
+
+// The quality settings that a QualityController adjusts.
+struct QualitySettings
+{
+    // How far away (in pixels) high res cells are drawn.
+    float highResDrawDistance { 480 };
+
+    // The cell mesh level of detail (see CellManager::setMeshLevelOfDetail()); higher is coarser.
+    unsigned int meshLevelOfDetail { 0 };
+
+    // The number of cell pairs loaded across each dimension around the camera (see CellManager::setActiveCellPairs()).
+    unsigned int activeCellPairs { 4 };
+};
+
+// The range a QualityController may move each setting within.
+struct QualityLimits
+{
+    float minDrawDistance { 256 };
+    float maxDrawDistance { 960 };
+
+    // How much the draw distance changes per step.
+    float drawDistanceStep { 64 };
+
+    unsigned int maxMeshLevelOfDetail { 2 };
+
+    unsigned int minActiveCellPairs { 2 };
+    unsigned int maxActiveCellPairs { 4 };
+
+    // The size (in pixels) of a cell, so that the draw distance never goes past the loaded cells.
+    float cellSize { 256 };
+};
+
+// What a QualityController has done, for display and logging.
+struct QualityCounters
+{
+    // The smoothed CPU frame time that decisions are based on.
+    double averageFrameMilliseconds { 0 };
+
+    uint64_t framesMeasured { 0 };
+
+    // Changes made to lower or raise the quality.
+    uint64_t stepsDown { 0 };
+    uint64_t stepsUp { 0 };
+
+    // Frames where the quality could have gone up but the loader was still behind.
+    uint64_t heldForBacklog { 0 };
+
+    // Times the quality went down soon after going up, each of which makes the controller wait longer before trying again.
+    uint64_t oscillations { 0 };
+
+    // The number of frames to wait after a step down before trying a step up.
+    unsigned int raiseDelayFrames { 0 };
+};
+
+// Adjusts the terrain's draw distance, mesh detail and loaded area at runtime to hold a target CPU frame time.
+//
+// The frame time is smoothed, and there's a dead band around the target: quality only drops when frames are well over
+// budget and only rises when they're well under, so it doesn't flip back and forth around the target.  After each change
+// the controller waits for the change to take effect before judging it.  If the quality has to drop again soon after
+// rising, it waits twice as long before its next attempt to rise.  The quality doesn't rise while the cell loader has a
+// backlog, since there'd be even more to load.
+//
+// Quality drops in order of how cheaply it comes back: first the draw distance (instant), then the mesh detail
+// (the cells are rebuilt), then the loaded area (cells are unloaded).  It rises in the reverse order.
+class QualityController
+{
+public:
+    QualityController(double targetFrameMilliseconds = 1000.0 / 60, const QualityLimits& limits = QualityLimits(),
+        const QualitySettings& initialSettings = QualitySettings());
+
+    void setTargetFrameMilliseconds(double milliseconds);
+    double getTargetFrameMilliseconds() const;
+
+    // Feeds in the CPU time of the frame just finished and the number of cells waiting to load.
+    // Returns true if the settings changed.
+    bool update(double cpuFrameMilliseconds, unsigned int pendingLoads);
+
+    const QualitySettings& getSettings() const;
+    const QualityCounters& getCounters() const;
+
+private:
+    double targetFrameMilliseconds;
+    QualityLimits limits;
+    QualitySettings settings {};
+    QualityCounters counters {};
+
+    // Frames since the settings last changed.
+    unsigned int framesSinceChange { 0 };
+
+    // Frames since the quality last rose, to spot oscillation.
+    unsigned int framesSinceStepUp { 0 };
+
+    bool stepDown();
+    bool stepUp();
+
+    // The furthest the high res cells can be drawn with the current loaded area.
+    float getMaxDrawDistance() const;
+};
@@ -0,0 +1,67 @@
+#include "Simulation.h"
+
+using namespace glm;
+
+Simulation::Simulation(const World& world, glm::vec3 cameraPosition)
+    : character { world }
+{
+    character.setCharacterHeight(4);
+    state.cameraPosition = cameraPosition;
+}
+
+const SimulationState& Simulation::getState() const
+{
+    return state;
+}
+
+void Simulation::step(const SimulationInput& input, float dt)
+{
+    if (input.teleportCount != lastTeleportCount)
+    {
+        lastTeleportCount = input.teleportCount;
+        state.cameraPosition = input.teleportPosition;
+    }
+
+    // The character starts wherever the camera was flying.
+    if (input.walking && !walking)
+    {
+        character.setPosition(state.cameraPosition);
+    }
+
+    walking = input.walking;
+
+    vec3 up { 0, 1, 0 };
+    vec3 right { normalize(cross(input.front, up)) };
+    float speedScale { input.sprint ? sprint : 1 };
+
+    if (walking)
+    {
+        // Walk along the ground in the direction the camera faces, however far up or down it's looking.
+        vec3 forward { normalize(cross(up, right)) };
+        vec3 direction { forward * input.movement.z + right * input.movement.x };
+
+        if (length(direction) > 1)
+        {
+            direction = normalize(direction);
+        }
+
+        character.setDesiredVelocity(direction * walkSpeed * speedScale);
+
+        if (input.jumpCount != lastJumpCount)
+        {
+            character.jump(jumpSpeed);
+        }
+
+        character.setPosition(state.cameraPosition);
+        character.update(dt);
+        state.cameraPosition = character.getPosition();
+    }
+    else
+    {
+        vec3 direction { input.front * input.movement.z + right * input.movement.x + up * input.movement.y };
+        state.cameraPosition += direction * flySpeed * speedScale * dt;
+    }
+
+    lastJumpCount = input.jumpCount;
+    state.tick++;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "ofMain.h"
+#include "World.h"
+#include "CharacterPhysics.h"
+
+// What the player is asking the simulation to do, sampled by the render thread from the keyboard and mouse.
+struct SimulationInput
+{
+    // Movement relative to the view, from -1 to 1 on each axis: x is right, y is up and z is forward.
+    glm::vec3 movement {};
+    bool sprint { false };
+
+    // The view direction, set straight from the mouse; flying moves along it.
+    glm::vec3 front { 0, 0, -1 };
+
+    // Walk on the terrain under gravity rather than flying.
+    bool walking { false };
+
+    // Incremented for every jump; the simulation jumps whenever it changes.
+    unsigned int jumpCount { 0 };
+
+    // Incremented whenever the camera is moved directly (e.g. at the end of a replay); the simulation then carries on
+    // from teleportPosition.
+    unsigned int teleportCount { 0 };
+    glm::vec3 teleportPosition {};
+};
+
+// The result of one tick of the simulation.
+struct SimulationState
+{
+    // The number of ticks simulated so far.
+    uint64_t tick { 0 };
+
+    // The camera's position in the World's space.
+    glm::vec3 cameraPosition {};
+};
+
+// Moves the camera, either flying freely or walking as a CharacterPhysics on the terrain.
+// The simulation knows nothing about timing; SimulationThread steps it on a fixed timestep.
+class Simulation
+{
+public:
+    Simulation(const World& world, glm::vec3 cameraPosition);
+
+    // Advances the simulation by dt seconds.
+    void step(const SimulationInput& input, float dt);
+
+    const SimulationState& getState() const;
+
+private:
+    CharacterPhysics character;
+    SimulationState state {};
+    bool walking { false };
+
+    // The counters from the last input, so that jumps and teleports only happen once each.
+    unsigned int lastJumpCount { 0 };
+    unsigned int lastTeleportCount { 0 };
+
+    // Speeds in world-space units per second.
+    const float flySpeed { 20 * 32 };
+    const float walkSpeed { 40 };
+    const float sprint { 5 };
+    const float jumpSpeed { 30 };
+};
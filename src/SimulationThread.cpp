@@ -0,0 +1,120 @@
+#include "SimulationThread.h"
+#include "Profiler.h"
+
+using namespace std::chrono;
+
+SimulationThread::SimulationThread(const World& world, double ticksPerSecond)
+    : world { world }, timestep { duration_cast<steady_clock::duration>(duration<double>(1 / ticksPerSecond)) }
+{
+}
+
+SimulationThread::~SimulationThread()
+{
+    stop();
+}
+
+void SimulationThread::start(glm::vec3 cameraPosition)
+{
+    stop();
+
+    simulation.reset(new Simulation(world, cameraPosition));
+
+    // Give the renderer something to draw before the first tick.
+    Snapshot& first { snapshots.getWriteBuffer() };
+    first.previous = simulation->getState();
+    first.current = simulation->getState();
+    first.time = steady_clock::now();
+    snapshots.publish();
+
+    stopping = false;
+    thread = std::thread { [this] () { run(); } };
+}
+
+void SimulationThread::stop()
+{
+    if (thread.joinable())
+    {
+        stopping = true;
+        thread.join();
+    }
+}
+
+void SimulationThread::setInput(const SimulationInput& input)
+{
+    this->input.write(input);
+}
+
+SimulationState SimulationThread::getInterpolatedState()
+{
+    const Snapshot& snapshot { snapshots.read() };
+
+    // Draw one tick behind, so that there's always a newer tick to interpolate towards.
+    double alpha { duration<double>(steady_clock::now() - snapshot.time) / duration<double>(timestep) };
+
+    SimulationState state { snapshot.current };
+    state.cameraPosition = glm::mix(snapshot.previous.cameraPosition, snapshot.current.cameraPosition, static_cast<float>(glm::clamp(alpha, 0.0, 1.0)));
+    return state;
+}
+
+SimulationStats SimulationThread::getStats() const
+{
+    SimulationStats stats {};
+    stats.ticks = ticks;
+    stats.droppedTicks = droppedTicks;
+    stats.averageTickMilliseconds = stats.ticks > 0 ? tickNanoseconds / 1e6 / stats.ticks : 0;
+    return stats;
+}
+
+double SimulationThread::getTimestep() const
+{
+    return duration<double>(timestep).count();
+}
+
+void SimulationThread::run()
+{
+    Profiler::setThreadName("Simulation");
+
+    // If the simulation falls this far behind (e.g. the process was paused), skip ahead rather than catching up.
+    const steady_clock::duration maxLag { timestep * 8 };
+    const float dt { static_cast<float>(getTimestep()) };
+
+    SimulationState previous { simulation->getState() };
+    steady_clock::time_point nextTick { steady_clock::now() + timestep };
+
+    while (!stopping)
+    {
+        std::this_thread::sleep_until(nextTick);
+
+        steady_clock::time_point tickStart { steady_clock::now() };
+        if (tickStart - nextTick > maxLag)
+        {
+            droppedTicks += (tickStart - nextTick) / timestep;
+            nextTick = tickStart;
+        }
+
+        {
+            PROFILE_ZONE("Simulation tick");
+
+            // Keep heightmap edits out for the whole tick, so every character sees the same terrain.
+            std::shared_lock<std::shared_timed_mutex> lock {};
+            if (world.heightmapMutex)
+            {
+                lock = std::shared_lock<std::shared_timed_mutex>(*world.heightmapMutex);
+            }
+
+            simulation->step(input.read(), dt);
+        }
+
+        Snapshot& snapshot { snapshots.getWriteBuffer() };
+        snapshot.previous = previous;
+        snapshot.current = simulation->getState();
+        snapshot.time = nextTick;
+        snapshots.publish();
+
+        previous = snapshot.current;
+        nextTick += timestep;
+
+        ticks++;
+        tickNanoseconds += duration_cast<nanoseconds>(steady_clock::now() - tickStart).count();
+    }
+}
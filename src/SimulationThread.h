@@ -0,0 +1,79 @@
+#pragma once
+#include "Simulation.h"
+#include "TripleBuffer.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+// How the simulation thread is keeping up, for display next to the frame rate.
+struct SimulationStats
+{
+    // Ticks simulated since the thread started.
+    uint64_t ticks { 0 };
+
+    // Ticks skipped because the simulation fell too far behind, rather than running them all back to back.
+    uint64_t droppedTicks { 0 };
+
+    // The average time spent simulating one tick, excluding the time spent waiting for the next one.
+    double averageTickMilliseconds { 0 };
+};
+
+// Runs a Simulation on its own thread at a fixed tick rate, so that slow frames don't stall the simulation
+// or change the timestep it sees.
+//
+// Input goes to the simulation, and snapshots of each tick come back, through lock-free triple buffers, so neither thread
+// ever waits for the other.  The renderer draws the state interpolated between the last two ticks, one tick behind,
+// so that motion is smooth whatever the frame rate.
+class SimulationThread
+{
+public:
+    SimulationThread(const World& world, double ticksPerSecond = 120);
+
+    // Stops the thread.
+    ~SimulationThread();
+
+    // Don't support copy constructor or copy assignment operator.
+    SimulationThread(const SimulationThread& s) = delete;
+    SimulationThread& operator= (const SimulationThread& s) = delete;
+
+    // Starts simulating, with the camera at a position in the World's space.  The World should be set up by now.
+    void start(glm::vec3 cameraPosition);
+
+    void stop();
+
+    // Sets the input for the coming ticks.  Only the render thread should call this.
+    void setInput(const SimulationInput& input);
+
+    // Gets the state at the present moment, interpolated between the last two ticks.
+    // Only the render thread should call this.
+    SimulationState getInterpolatedState();
+
+    SimulationStats getStats() const;
+
+    double getTimestep() const;
+
+private:
+    // The last two ticks, and when the newer one was due.
+    struct Snapshot
+    {
+        SimulationState previous {};
+        SimulationState current {};
+        std::chrono::steady_clock::time_point time {};
+    };
+
+    const World& world;
+    const std::chrono::steady_clock::duration timestep;
+
+    std::unique_ptr<Simulation> simulation {};
+    std::thread thread {};
+    std::atomic<bool> stopping { false };
+
+    TripleBuffer<SimulationInput> input {};
+    TripleBuffer<Snapshot> snapshots {};
+
+    std::atomic<uint64_t> ticks { 0 };
+    std::atomic<uint64_t> droppedTicks { 0 };
+    std::atomic<int64_t> tickNanoseconds { 0 };
+
+    void run();
+};
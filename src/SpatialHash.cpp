@@ -0,0 +1,145 @@
+#include "SpatialHash.h"
+#include "TaskScheduler.h"
+
+namespace
+{
+    // The number of points (or buckets) each thread takes at a time, so that threads don't contend over every index.
+    const size_t CHUNK_SIZE { 4096 };
+}
+
+SpatialHash::SpatialHash(float cellSize)
+    : cellSize { cellSize }
+{
+    // An empty table, so that queries before the first build find nothing.
+    bucketStarts.assign(2, 0);
+}
+
+glm::ivec2 SpatialHash::getGridCell(glm::vec3 position) const
+{
+    return glm::ivec2(glm::floor(glm::vec2(position.x, position.z) / cellSize));
+}
+
+float SpatialHash::getCellSize() const
+{
+    return cellSize;
+}
+
+size_t SpatialHash::getBucketCount() const
+{
+    return static_cast<size_t>(1) << (tableShift * 2);
+}
+
+const std::vector<uint32_t>& SpatialHash::getSortedIndices() const
+{
+    return sortedIndices;
+}
+
+uint32_t SpatialHash::getBucket(glm::ivec2 gridCell) const
+{
+    // Wrap the cell around the table; the bit masks work for negative coordinates too.
+    uint32_t mask { (1u << tableShift) - 1 };
+    return (static_cast<uint32_t>(gridCell.y) & mask) << tableShift | (static_cast<uint32_t>(gridCell.x) & mask);
+}
+
+void SpatialHash::build(const std::vector<glm::vec3>& positions, unsigned int threadCount)
+{
+    TaskScheduler& scheduler { TaskScheduler::getShared() };
+    size_t pointCount { positions.size() };
+
+    // At least twice as many buckets as points keeps the buckets short without wasting much memory.
+    tableShift = 2;
+    while ((static_cast<size_t>(1) << (tableShift * 2)) < pointCount * 2)
+    {
+        tableShift++;
+    }
+
+    size_t bucketCount { getBucketCount() };
+
+    if (bucketCountsSize != bucketCount)
+    {
+        bucketCounts.reset(new std::atomic<uint32_t>[bucketCount]);
+        bucketCountsSize = bucketCount;
+    }
+
+    pointBuckets.resize(pointCount);
+    bucketStarts.resize(bucketCount + 1);
+    sortedIndices.resize(pointCount);
+
+    scheduler.parallelFor(bucketCount, CHUNK_SIZE, [&] (size_t begin, size_t end)
+    {
+        for (size_t bucket { begin }; bucket < end; bucket++)
+        {
+            bucketCounts[bucket].store(0, std::memory_order_relaxed);
+        }
+    }, threadCount);
+
+    // Count the points in each bucket.
+    scheduler.parallelFor(pointCount, CHUNK_SIZE, [&] (size_t begin, size_t end)
+    {
+        for (size_t i { begin }; i < end; i++)
+        {
+            uint32_t bucket { getBucket(getGridCell(positions[i])) };
+            pointBuckets[i] = bucket;
+            bucketCounts[bucket].fetch_add(1, std::memory_order_relaxed);
+        }
+    }, threadCount);
+
+    // Lay the buckets out one after another: each chunk of buckets is totalled in parallel,
+    // the chunks are offset one after another, and then each chunk's buckets are offset in parallel.
+    size_t chunkCount { (bucketCount + CHUNK_SIZE - 1) / CHUNK_SIZE };
+    std::vector<uint32_t> chunkStarts(chunkCount + 1);
+
+    scheduler.parallelFor(bucketCount, CHUNK_SIZE, [&] (size_t begin, size_t end)
+    {
+        uint32_t total { 0 };
+        for (size_t bucket { begin }; bucket < end; bucket++)
+        {
+            total += bucketCounts[bucket].load(std::memory_order_relaxed);
+        }
+
+        chunkStarts[begin / CHUNK_SIZE + 1] = total;
+    }, threadCount);
+
+    for (size_t chunk { 0 }; chunk < chunkCount; chunk++)
+    {
+        chunkStarts[chunk + 1] += chunkStarts[chunk];
+    }
+
+    scheduler.parallelFor(bucketCount, CHUNK_SIZE, [&] (size_t begin, size_t end)
+    {
+        uint32_t start { chunkStarts[begin / CHUNK_SIZE] };
+        for (size_t bucket { begin }; bucket < end; bucket++)
+        {
+            uint32_t count { bucketCounts[bucket].load(std::memory_order_relaxed) };
+            bucketStarts[bucket] = start;
+
+            // From here on, the count is the next free place in the bucket.
+            bucketCounts[bucket].store(start, std::memory_order_relaxed);
+            start += count;
+        }
+    }, threadCount);
+
+    bucketStarts[bucketCount] = static_cast<uint32_t>(pointCount);
+
+    // Put each point in the next free place in its bucket.
+    scheduler.parallelFor(pointCount, CHUNK_SIZE, [&] (size_t begin, size_t end)
+    {
+        for (size_t i { begin }; i < end; i++)
+        {
+            sortedIndices[bucketCounts[pointBuckets[i]].fetch_add(1, std::memory_order_relaxed)] = static_cast<uint32_t>(i);
+        }
+    }, threadCount);
+
+    // The threads fill each bucket in no particular order; sort them so that queries (and anything summed from them)
+    // come out the same every time, whatever the thread count.
+    scheduler.parallelFor(bucketCount, CHUNK_SIZE, [&] (size_t begin, size_t end)
+    {
+        for (size_t bucket { begin }; bucket < end; bucket++)
+        {
+            if (bucketStarts[bucket + 1] - bucketStarts[bucket] > 1)
+            {
+                std::sort(sortedIndices.begin() + bucketStarts[bucket], sortedIndices.begin() + bucketStarts[bucket + 1]);
+            }
+        }
+    }, threadCount);
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include "ofMain.h"
+#include <atomic>
+#include <memory>
+
+// A uniform grid over the x-z plane for finding the points near a position, stored as a hash table of grid cells.
+// The table is itself a square grid of buckets that the world's grid cells wrap around, so neighbouring cells are
+// neighbouring buckets and only cells a whole table apart share one.  It's rebuilt from scratch each time the points move:
+// every point is put in a bucket, the buckets are counted and laid out row by row, and the points are sorted into them
+// (a counting sort), all in parallel on the shared TaskScheduler.  Points that are near each other end up near each other
+// in the sorted order, so callers should gather whatever they need about each point in that order (see getSortedIndices()).
+class SpatialHash
+{
+public:
+    // "cellSize" is the spacing of the grid.  It should be at least the largest distance at which points interact,
+    // so that every point within that distance of a position is in the same grid cell or one of the eight around it.
+    explicit SpatialHash(float cellSize);
+
+    // Don't support copy constructor or copy assignment operator.
+    SpatialHash(const SpatialHash& h) = delete;
+    SpatialHash& operator= (const SpatialHash& h) = delete;
+
+    // Rebuilds the table for a set of points (only x and z are used), with at most "threadCount" threads;
+    // 0 lets every worker join in.
+    void build(const std::vector<glm::vec3>& positions, unsigned int threadCount = 0);
+
+    // Calls "function(slot)" for every point in the grid cell containing a position and the eight around it,
+    // where "slot" is the point's place in getSortedIndices().  Points in cells a whole table away share the same buckets
+    // and are included too, so callers should still check the distance.
+    template<typename Function>
+    void forEachNearby(glm::vec3 position, Function function) const
+    {
+        glm::ivec2 center { getGridCell(position) };
+
+        // The table is at least 4 buckets wide, so the nine cells are always in different buckets.
+        for (int dz { -1 }; dz <= 1; dz++)
+        {
+            for (int dx { -1 }; dx <= 1; dx++)
+            {
+                uint32_t bucket { getBucket(center + glm::ivec2(dx, dz)) };
+
+                for (uint32_t slot { bucketStarts[bucket] }; slot < bucketStarts[bucket + 1]; slot++)
+                {
+                    function(slot);
+                }
+            }
+        }
+    }
+
+    // The indices of the points passed to build(), grouped by bucket.
+    const std::vector<uint32_t>& getSortedIndices() const;
+
+    // Gets the grid cell containing a position.
+    glm::ivec2 getGridCell(glm::vec3 position) const;
+
+    float getCellSize() const;
+
+    // The number of buckets in the table, which grows with the number of points.
+    size_t getBucketCount() const;
+
+private:
+    float cellSize;
+
+    // The table is (1 << tableShift) buckets on a side.
+    unsigned int tableShift { 0 };
+
+    // The bucket each point fell in.
+    std::vector<uint32_t> pointBuckets {};
+
+    // The number of points in each bucket while the table is being built, then the next free place in it.
+    std::unique_ptr<std::atomic<uint32_t>[]> bucketCounts {};
+    size_t bucketCountsSize { 0 };
+
+    // Where each bucket's points start in sortedIndices, with one extra entry for the end of the last bucket.
+    std::vector<uint32_t> bucketStarts {};
+
+    // The point indices, grouped by bucket.
+    std::vector<uint32_t> sortedIndices {};
+
+    uint32_t getBucket(glm::ivec2 gridCell) const;
+};
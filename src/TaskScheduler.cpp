@@ -0,0 +1,247 @@
+#include "TaskScheduler.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+namespace
+{
+    // The scheduler and worker index of the calling thread, if it's a worker.
+    thread_local const TaskScheduler* currentScheduler { nullptr };
+    thread_local int currentWorkerIndex { -1 };
+}
+
+TaskScheduler::TaskScheduler(unsigned int workerCount)
+{
+    if (workerCount == 0)
+    {
+        // Leave a core for the thread that submits the work, which helps out while it waits anyway.
+        // hardware_concurrency() may return 0 if it can't tell, so clamp before subtracting.
+        workerCount = std::max(2u, std::thread::hardware_concurrency()) - 1;
+    }
+
+    for (unsigned int i { 0 }; i < workerCount; i++)
+    {
+        workers.push_back(std::unique_ptr<Worker>(new Worker()));
+    }
+
+    // Start the threads once every worker exists, since they steal from each other.
+    for (unsigned int i { 0 }; i < workerCount; i++)
+    {
+        workers[i]->thread = std::thread { [this, i] () { runWorker(i); } };
+    }
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock { sleepMutex };
+        stopping = true;
+    }
+
+    workAvailable.notify_all();
+
+    for (std::unique_ptr<Worker>& worker : workers)
+    {
+        worker->thread.join();
+    }
+}
+
+TaskScheduler& TaskScheduler::getShared()
+{
+    static TaskScheduler shared {};
+    return shared;
+}
+
+unsigned int TaskScheduler::getWorkerCount() const
+{
+    return static_cast<unsigned int>(workers.size());
+}
+
+uint64_t TaskScheduler::getTasksRun() const
+{
+    return tasksRun;
+}
+
+uint64_t TaskScheduler::getTasksStolen() const
+{
+    return tasksStolen;
+}
+
+TaskHandle TaskScheduler::submit(std::function<void()> function, TaskPriority priority, const std::vector<TaskHandle>& dependencies)
+{
+    TaskHandle task { std::make_shared<Task>() };
+    task->function = std::move(function);
+    task->priority = priority;
+    task->remainingDependencies = static_cast<unsigned int>(dependencies.size()) + 1;
+
+    for (const TaskHandle& dependency : dependencies)
+    {
+        std::lock_guard<std::mutex> lock { dependency->mutex };
+
+        if (dependency->finished)
+        {
+            task->remainingDependencies--;
+        }
+        else
+        {
+            dependency->dependents.push_back(task);
+        }
+    }
+
+    // Drop the hold that stopped the task being queued while its dependencies were being registered.
+    if (--task->remainingDependencies == 0)
+    {
+        enqueue(task);
+    }
+
+    return task;
+}
+
+void TaskScheduler::wait(const TaskHandle& task)
+{
+    int workerIndex { getCurrentWorkerIndex() };
+
+    while (!task->finished)
+    {
+        TaskHandle other { takeTask(workerIndex) };
+
+        if (other)
+        {
+            run(other);
+        }
+        else
+        {
+            // Nothing to help with; sleep until the task finishes, checking for new work now and then.
+            std::unique_lock<std::mutex> lock { task->mutex };
+            task->finishedCondition.wait_for(lock, std::chrono::microseconds(200), [&] () { return task->finished.load(); });
+        }
+    }
+}
+
+int TaskScheduler::getCurrentWorkerIndex() const
+{
+    return currentScheduler == this ? currentWorkerIndex : -1;
+}
+
+void TaskScheduler::enqueue(const TaskHandle& task)
+{
+    int workerIndex { getCurrentWorkerIndex() };
+    unsigned int target { workerIndex >= 0 ? static_cast<unsigned int>(workerIndex) : nextWorker++ % getWorkerCount() };
+
+    {
+        std::lock_guard<std::mutex> lock { workers[target]->mutex };
+        workers[target]->queues[static_cast<int>(task->priority)].push_back(task);
+    }
+
+    // Take the sleep mutex so that a worker can't miss the notification between checking for work and going to sleep.
+    {
+        std::lock_guard<std::mutex> lock { sleepMutex };
+        queuedTasks++;
+    }
+
+    workAvailable.notify_one();
+}
+
+TaskHandle TaskScheduler::takeTask(int workerIndex)
+{
+    unsigned int workerCount { getWorkerCount() };
+
+    // Start stealing from the next worker along so that thieves spread out.
+    unsigned int firstVictim { workerIndex >= 0 ? static_cast<unsigned int>(workerIndex) + 1 : nextWorker.load() };
+
+    for (unsigned int priority { 0 }; priority < PRIORITY_COUNT; priority++)
+    {
+        if (workerIndex >= 0)
+        {
+            Worker& worker { *workers[workerIndex] };
+            std::lock_guard<std::mutex> lock { worker.mutex };
+            std::deque<TaskHandle>& queue { worker.queues[priority] };
+
+            if (!queue.empty())
+            {
+                TaskHandle task { std::move(queue.back()) };
+                queue.pop_back();
+                queuedTasks--;
+                return task;
+            }
+        }
+
+        for (unsigned int i { 0 }; i < workerCount; i++)
+        {
+            unsigned int victimIndex { (firstVictim + i) % workerCount };
+            if (static_cast<int>(victimIndex) == workerIndex)
+            {
+                continue;
+            }
+
+            Worker& victim { *workers[victimIndex] };
+            std::lock_guard<std::mutex> lock { victim.mutex };
+            std::deque<TaskHandle>& queue { victim.queues[priority] };
+
+            if (!queue.empty())
+            {
+                TaskHandle task { std::move(queue.front()) };
+                queue.pop_front();
+                queuedTasks--;
+                tasksStolen++;
+                return task;
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+void TaskScheduler::run(const TaskHandle& task)
+{
+    task->function();
+
+    // Free anything the function captured now rather than when the last handle goes.
+    task->function = nullptr;
+    tasksRun++;
+
+    std::vector<TaskHandle> dependents {};
+
+    {
+        std::lock_guard<std::mutex> lock { task->mutex };
+        task->finished = true;
+        std::swap(dependents, task->dependents);
+    }
+
+    task->finishedCondition.notify_all();
+
+    for (const TaskHandle& dependent : dependents)
+    {
+        if (--dependent->remainingDependencies == 0)
+        {
+            enqueue(dependent);
+        }
+    }
+}
+
+void TaskScheduler::runWorker(unsigned int index)
+{
+    currentScheduler = this;
+    currentWorkerIndex = static_cast<int>(index);
+    Profiler::setThreadName(("Task worker " + std::to_string(index)).c_str());
+
+    while (true)
+    {
+        TaskHandle task { takeTask(static_cast<int>(index)) };
+
+        if (task)
+        {
+            run(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock { sleepMutex };
+        workAvailable.wait(lock, [this] () { return stopping || queuedTasks > 0; });
+
+        if (stopping)
+        {
+            return;
+        }
+    }
+}
@@ -0,0 +1,181 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// How soon a task should run relative to others; workers always take the most urgent task they can find.
+enum class TaskPriority
+{
+    // Work something is waiting on right now, e.g. the helpers of parallelFor() or terrain edits.
+    High,
+
+    Normal,
+
+    // Background work that can wait, e.g. rebuilding cells at a new level of detail.
+    Low,
+};
+
+// A unit of work for a TaskScheduler.  Tasks are created by TaskScheduler::submit() and referred to by handle.
+class Task
+{
+public:
+    // True once the task's function has returned.  Safe to call from any thread.
+    bool isFinished() const
+    {
+        return finished;
+    }
+
+private:
+    friend class TaskScheduler;
+
+    std::function<void()> function {};
+    TaskPriority priority { TaskPriority::Normal };
+
+    // Dependencies that haven't finished yet, plus one while the task is being submitted.
+    std::atomic<unsigned int> remainingDependencies { 1 };
+
+    // Guards "dependents" and the transition to finished.
+    std::mutex mutex {};
+    std::condition_variable finishedCondition {};
+    std::vector<std::shared_ptr<Task>> dependents {};
+    std::atomic<bool> finished { false };
+};
+
+using TaskHandle = std::shared_ptr<Task>;
+
+// A pool of worker threads that run tasks, shared by all the terrain subsystems so that they don't each start their own threads.
+//
+// Each worker has its own deque of tasks per priority.  Tasks submitted from a worker go on the back of its own deque and
+// it takes work from the back (the most recently submitted, whose data is likely still in its cache); idle workers steal
+// from the front of the others' deques.  Tasks submitted from other threads are dealt out to the workers in turn.
+// A task can depend on other tasks, in which case it isn't queued until they've all finished, so that stages of work
+// (e.g. fetching a cell's heights, then building its mesh) can be chained without anything blocking.
+class TaskScheduler
+{
+public:
+    // If workerCount is zero, there's one worker per hardware core other than the calling thread's.
+    explicit TaskScheduler(unsigned int workerCount = 0);
+
+    // Runs whatever is already queued, then stops the workers.  Tasks still waiting on dependencies are dropped.
+    ~TaskScheduler();
+
+    // Don't support copy constructor or copy assignment operator.
+    TaskScheduler(const TaskScheduler& s) = delete;
+    TaskScheduler& operator= (const TaskScheduler& s) = delete;
+
+    // The scheduler used by the terrain subsystems, created the first time it's needed.
+    static TaskScheduler& getShared();
+
+    // Queues a function to run once all of its dependencies have finished.
+    TaskHandle submit(std::function<void()> function, TaskPriority priority = TaskPriority::Normal,
+        const std::vector<TaskHandle>& dependencies = {});
+
+    // Waits for a task to finish, running other queued tasks in the meantime rather than just blocking.
+    void wait(const TaskHandle& task);
+
+    // Runs "function(index)" for every index in [0, count), spread across at most maxThreads threads
+    // (including the calling thread, which does its share of the work).  If maxThreads is zero, every worker may join in.
+    template<typename Function>
+    void parallelFor(size_t count, Function function, unsigned int maxThreads = 0)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+
+        if (maxThreads == 0)
+        {
+            maxThreads = getWorkerCount() + 1;
+        }
+
+        // Each thread keeps pulling the next unclaimed index until there are none left.
+        std::atomic<size_t> nextIndex { 0 };
+        auto process = [&] ()
+        {
+            for (size_t i { nextIndex++ }; i < count; i = nextIndex++)
+            {
+                function(i);
+            }
+        };
+
+        std::vector<TaskHandle> helpers {};
+        size_t helperCount { std::min<size_t>(maxThreads, count) - 1 };
+        for (size_t i { 0 }; i < helperCount; i++)
+        {
+            helpers.push_back(submit(process, TaskPriority::High));
+        }
+
+        // The calling thread does its share of the work too; helpers that start late find nothing left and return.
+        process();
+
+        for (const TaskHandle& helper : helpers)
+        {
+            wait(helper);
+        }
+    }
+
+    // Runs "function(begin, end)" over [0, count) in chunks of chunkSize indices (the last may be shorter), spread across
+    // threads the same way as above, so that cheap loops don't have the threads contending over every index.
+    template<typename Function>
+    void parallelFor(size_t count, size_t chunkSize, Function function, unsigned int maxThreads = 0)
+    {
+        size_t chunkCount { (count + chunkSize - 1) / chunkSize };
+        parallelFor(chunkCount, [&] (size_t chunk)
+        {
+            function(chunk * chunkSize, std::min(count, (chunk + 1) * chunkSize));
+        }, maxThreads);
+    }
+
+    unsigned int getWorkerCount() const;
+
+    // The total number of tasks run, and how many of those were stolen from another worker's deque.
+    uint64_t getTasksRun() const;
+    uint64_t getTasksStolen() const;
+
+private:
+    const static unsigned int PRIORITY_COUNT { 3 };
+
+    struct Worker
+    {
+        std::mutex mutex {};
+        std::deque<TaskHandle> queues[PRIORITY_COUNT] {};
+        std::thread thread {};
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers {};
+
+    // The worker that the next task submitted from outside the pool goes to.
+    std::atomic<unsigned int> nextWorker { 0 };
+
+    // Workers with nothing to do sleep until a task is queued.
+    // Signed, since a task can be taken in the moment between being queued and being counted.
+    std::atomic<int> queuedTasks { 0 };
+    std::mutex sleepMutex {};
+    std::condition_variable workAvailable {};
+
+    std::atomic<bool> stopping { false };
+
+    std::atomic<uint64_t> tasksRun { 0 };
+    std::atomic<uint64_t> tasksStolen { 0 };
+
+    void runWorker(unsigned int index);
+
+    // Gets the index of the calling thread's worker in this scheduler, or -1 if it isn't one.
+    int getCurrentWorkerIndex() const;
+
+    // Puts a task whose dependencies have all finished on a worker's deque.
+    void enqueue(const TaskHandle& task);
+
+    // Takes the most urgent task available to a worker (or to an outside thread if workerIndex is -1),
+    // preferring the worker's own deque at each priority before stealing.  Returns nullptr if there are none.
+    TaskHandle takeTask(int workerIndex);
+
+    // Runs a task and queues any dependents that were only waiting for it.
+    void run(const TaskHandle& task);
+};
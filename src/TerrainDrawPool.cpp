@@ -0,0 +1,242 @@
+#include "TerrainDrawPool.h"
+
+static_assert(sizeof(ofIndexType) == sizeof(GLuint), "TerrainDrawPool assumes 32-bit mesh indices.");
+
+void TerrainDrawPool::allocate(unsigned int slotCount, unsigned int verticesPerSlot, unsigned int indicesPerSlot)
+{
+    release();
+
+    this->slotCount = slotCount;
+    this->verticesPerSlot = verticesPerSlot;
+    this->indicesPerSlot = indicesPerSlot;
+    slotIndexCounts.assign(slotCount, 0);
+
+    // Indirect multi-draw is core in GL 4.3; the app asks for 4.1, so only use it if the driver offers it anyway.
+    useIndirectDraw = GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect;
+
+    GLsizeiptr totalVertices { static_cast<GLsizeiptr>(slotCount) * verticesPerSlot };
+    GLsizeiptr totalIndices { static_cast<GLsizeiptr>(slotCount) * indicesPerSlot };
+
+    glGenVertexArrays(1, &vertexArray);
+    glBindVertexArray(vertexArray);
+
+    // Positions for every slot come first, followed by normals for every slot,
+    // so that a single attribute pointer of each kind covers the whole pool.
+    glGenBuffers(1, &vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, totalVertices * 2 * sizeof(glm::vec3), nullptr, GL_DYNAMIC_DRAW);
+
+    // Locations match shader.vert.
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), reinterpret_cast<const void*>(0));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), reinterpret_cast<const void*>(totalVertices * sizeof(glm::vec3)));
+
+    glGenBuffers(1, &indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, totalIndices * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    if (useIndirectDraw)
+    {
+        glGenBuffers(1, &indirectBuffer);
+    }
+}
+
+void TerrainDrawPool::release()
+{
+    if (isAllocated())
+    {
+        glDeleteVertexArrays(1, &vertexArray);
+        glDeleteBuffers(1, &vertexBuffer);
+        glDeleteBuffers(1, &indexBuffer);
+
+        if (indirectBuffer != 0)
+        {
+            glDeleteBuffers(1, &indirectBuffer);
+        }
+
+        vertexArray = vertexBuffer = indexBuffer = indirectBuffer = 0;
+    }
+
+    slotIndexCounts.clear();
+    commands.clear();
+}
+
+void TerrainDrawPool::grow(unsigned int newSlotCount)
+{
+    if (!isAllocated() || newSlotCount <= slotCount)
+    {
+        return;
+    }
+
+    GLsizeiptr oldTotalVertices { static_cast<GLsizeiptr>(slotCount) * verticesPerSlot };
+    GLsizeiptr oldTotalIndices { static_cast<GLsizeiptr>(slotCount) * indicesPerSlot };
+    GLsizeiptr newTotalVertices { static_cast<GLsizeiptr>(newSlotCount) * verticesPerSlot };
+    GLsizeiptr newTotalIndices { static_cast<GLsizeiptr>(newSlotCount) * indicesPerSlot };
+    GLsizeiptr positionBytes { oldTotalVertices * static_cast<GLsizeiptr>(sizeof(glm::vec3)) };
+
+    GLuint newVertexBuffer { 0 };
+    GLuint newIndexBuffer { 0 };
+    glGenBuffers(1, &newVertexBuffer);
+    glGenBuffers(1, &newIndexBuffer);
+
+    // Copy on the GPU; the normals move since they start after every slot's positions.
+    glBindBuffer(GL_COPY_READ_BUFFER, vertexBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, newVertexBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, newTotalVertices * 2 * sizeof(glm::vec3), nullptr, GL_DYNAMIC_DRAW);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, positionBytes);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, positionBytes, newTotalVertices * sizeof(glm::vec3), positionBytes);
+
+    glBindBuffer(GL_COPY_READ_BUFFER, indexBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, newIndexBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, newTotalIndices * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldTotalIndices * sizeof(GLuint));
+
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    // Point the VAO at the new buffers.
+    glBindVertexArray(vertexArray);
+    glBindBuffer(GL_ARRAY_BUFFER, newVertexBuffer);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), reinterpret_cast<const void*>(0));
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), reinterpret_cast<const void*>(newTotalVertices * sizeof(glm::vec3)));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, newIndexBuffer);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glDeleteBuffers(1, &vertexBuffer);
+    glDeleteBuffers(1, &indexBuffer);
+    vertexBuffer = newVertexBuffer;
+    indexBuffer = newIndexBuffer;
+
+    slotCount = newSlotCount;
+    slotIndexCounts.resize(slotCount, 0);
+}
+
+unsigned int TerrainDrawPool::getSlotCount() const
+{
+    return slotCount;
+}
+
+bool TerrainDrawPool::isAllocated() const
+{
+    return vertexArray != 0;
+}
+
+bool TerrainDrawPool::uploadMesh(unsigned int slot, const ofMesh& mesh)
+{
+    if (mesh.getNumVertices() > verticesPerSlot || mesh.getNumIndices() > indicesPerSlot || mesh.getNumNormals() != mesh.getNumVertices())
+    {
+        ofLogError("TerrainDrawPool") << "Mesh with " << mesh.getNumVertices() << " vertices and " << mesh.getNumIndices()
+            << " indices doesn't fit in a slot.";
+        slotIndexCounts[slot] = 0;
+        return false;
+    }
+
+    GLsizeiptr totalVertices { static_cast<GLsizeiptr>(slotCount) * verticesPerSlot };
+    GLintptr slotVertexOffset { static_cast<GLintptr>(slot) * verticesPerSlot * sizeof(glm::vec3) };
+    GLsizeiptr vertexBytes { static_cast<GLsizeiptr>(mesh.getNumVertices() * sizeof(glm::vec3)) };
+
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferSubData(GL_ARRAY_BUFFER, slotVertexOffset, vertexBytes, mesh.getVerticesPointer());
+    glBufferSubData(GL_ARRAY_BUFFER, totalVertices * sizeof(glm::vec3) + slotVertexOffset, vertexBytes, mesh.getNormalsPointer());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // The element array binding is part of the VAO state, so bind the VAO to upload indices.
+    glBindVertexArray(vertexArray);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLintptr>(slot) * indicesPerSlot * sizeof(GLuint),
+        mesh.getNumIndices() * sizeof(GLuint), mesh.getIndexPointer());
+    glBindVertexArray(0);
+
+    slotIndexCounts[slot] = static_cast<GLsizei>(mesh.getNumIndices());
+    return true;
+}
+
+void TerrainDrawPool::uploadVertexRange(unsigned int slot, const ofMesh& mesh, size_t firstVertex, size_t vertexCount)
+{
+    if (firstVertex + vertexCount > std::min<size_t>(mesh.getNumVertices(), verticesPerSlot))
+    {
+        ofLogError("TerrainDrawPool") << "Vertex range " << firstVertex << " + " << vertexCount << " is outside the mesh.";
+        return;
+    }
+
+    GLsizeiptr totalVertices { static_cast<GLsizeiptr>(slotCount) * verticesPerSlot };
+    GLintptr rangeOffset { static_cast<GLintptr>(static_cast<size_t>(slot) * verticesPerSlot + firstVertex) * static_cast<GLintptr>(sizeof(glm::vec3)) };
+    GLsizeiptr rangeBytes { static_cast<GLsizeiptr>(vertexCount * sizeof(glm::vec3)) };
+
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferSubData(GL_ARRAY_BUFFER, rangeOffset, rangeBytes, mesh.getVerticesPointer() + firstVertex);
+    glBufferSubData(GL_ARRAY_BUFFER, totalVertices * sizeof(glm::vec3) + rangeOffset, rangeBytes, mesh.getNormalsPointer() + firstVertex);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void TerrainDrawPool::clearDraws()
+{
+    commands.clear();
+}
+
+void TerrainDrawPool::addDraw(unsigned int slot)
+{
+    if (slotIndexCounts[slot] > 0)
+    {
+        // Indices are stored relative to their slot, so offset them by the slot's first vertex.
+        commands.push_back({ static_cast<GLuint>(slotIndexCounts[slot]), 1, slot * indicesPerSlot,
+            static_cast<GLint>(slot * verticesPerSlot), 0 });
+    }
+}
+
+void TerrainDrawPool::draw()
+{
+    if (commands.empty())
+    {
+        return;
+    }
+
+    glBindVertexArray(vertexArray);
+
+    if (useIndirectDraw)
+    {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STREAM_DRAW);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, static_cast<GLsizei>(commands.size()), 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+    else
+    {
+        fallbackCounts.clear();
+        fallbackOffsets.clear();
+        fallbackBaseVertices.clear();
+
+        for (const DrawElementsIndirectCommand& command : commands)
+        {
+            fallbackCounts.push_back(command.count);
+            fallbackOffsets.push_back(reinterpret_cast<void*>(static_cast<uintptr_t>(command.firstIndex) * sizeof(GLuint)));
+            fallbackBaseVertices.push_back(command.baseVertex);
+        }
+
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, fallbackCounts.data(), GL_UNSIGNED_INT,
+            fallbackOffsets.data(), static_cast<GLsizei>(commands.size()), fallbackBaseVertices.data());
+    }
+
+    glBindVertexArray(0);
+}
+
+size_t TerrainDrawPool::getDrawCount() const
+{
+    return commands.size();
+}
+
+size_t TerrainDrawPool::getAllocatedBytes() const
+{
+    if (!isAllocated())
+    {
+        return 0;
+    }
+
+    size_t totalVertices { static_cast<size_t>(slotCount) * verticesPerSlot };
+    size_t totalIndices { static_cast<size_t>(slotCount) * indicesPerSlot };
+    return totalVertices * 2 * sizeof(glm::vec3) + totalIndices * sizeof(GLuint);
+}
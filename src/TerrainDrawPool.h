@@ -0,0 +1,84 @@
+#pragma once
+#include "ofMain.h"
+
+// A pool of GPU vertex and index storage with one fixed-size slot per cell.
+// Every visible cell is drawn with a single multi-draw call instead of one bind and draw per cell,
+// so the CPU cost of submitting the terrain stays flat as the number of visible cells grows.
+class TerrainDrawPool
+{
+public:
+    TerrainDrawPool() = default;
+
+    // Don't support copy constructor or copy assignment operator.
+    TerrainDrawPool(const TerrainDrawPool& p) = delete;
+    TerrainDrawPool& operator= (const TerrainDrawPool& p) = delete;
+
+    // Creates the GPU buffers.  Must be called from the thread that owns the GL context.
+    void allocate(unsigned int slotCount, unsigned int verticesPerSlot, unsigned int indicesPerSlot);
+
+    // Destroys the GPU buffers.
+    void release();
+
+    // Adds slots to an allocated pool, keeping the contents of the existing slots.
+    void grow(unsigned int newSlotCount);
+
+    unsigned int getSlotCount() const;
+
+    bool isAllocated() const;
+
+    // Copies a mesh's positions, normals and indices into a slot, replacing whatever was there.
+    // Returns false (and leaves the slot empty) if the mesh is too big for a slot.
+    bool uploadMesh(unsigned int slot, const ofMesh& mesh);
+
+    // Copies part of a mesh's positions and normals into a slot that already holds a mesh with the same indices.
+    void uploadVertexRange(unsigned int slot, const ofMesh& mesh, size_t firstVertex, size_t vertexCount);
+
+    // Clears the list of slots to draw; call this before the culling pass each frame.
+    void clearDraws();
+
+    // Adds a slot to the list of slots to draw.
+    void addDraw(unsigned int slot);
+
+    // Draws every slot added since clearDraws() with a single multi-draw call.
+    void draw();
+
+    // The number of slots added since clearDraws().
+    size_t getDrawCount() const;
+
+    // The GPU memory used by the pool's buffers.
+    size_t getAllocatedBytes() const;
+
+private:
+    // The layout glMultiDrawElementsIndirect() expects for each command.
+    struct DrawElementsIndirectCommand
+    {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    GLuint vertexArray { 0 };
+    GLuint vertexBuffer { 0 };
+    GLuint indexBuffer { 0 };
+    GLuint indirectBuffer { 0 };
+
+    unsigned int slotCount { 0 };
+    unsigned int verticesPerSlot { 0 };
+    unsigned int indicesPerSlot { 0 };
+
+    // Set if the driver supports glMultiDrawElementsIndirect(); otherwise glMultiDrawElementsBaseVertex() is used.
+    bool useIndirectDraw { false };
+
+    // The number of indices currently stored in each slot.
+    std::vector<GLsizei> slotIndexCounts {};
+
+    // The draw list built by the culling pass.
+    std::vector<DrawElementsIndirectCommand> commands {};
+
+    // Scratch arrays for the glMultiDrawElementsBaseVertex() fallback.
+    std::vector<GLsizei> fallbackCounts {};
+    std::vector<void*> fallbackOffsets {};
+    std::vector<GLint> fallbackBaseVertices {};
+};
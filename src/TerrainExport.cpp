@@ -0,0 +1,185 @@
+#include "TerrainExport.h"
+#include "TaskScheduler.h"
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+namespace
+{
+    const uint32_t GLB_MAGIC { 0x46546C67 };
+    const uint32_t GLB_VERSION { 2 };
+    const uint32_t JSON_CHUNK { 0x4E4F534A };
+    const uint32_t BIN_CHUNK { 0x004E4942 };
+
+    // glTF component types and buffer view targets.
+    const unsigned int FLOAT { 5126 };
+    const unsigned int UNSIGNED_INT { 5125 };
+    const unsigned int ARRAY_BUFFER { 34962 };
+    const unsigned int ELEMENT_ARRAY_BUFFER { 34963 };
+
+    static_assert(sizeof(glm::vec3) == 12, "Vertices are written straight from the mesh as three packed floats.");
+    static_assert(sizeof(ofIndexType) == 4, "Indices are written straight from the mesh as 32-bit integers.");
+
+    void writeUint32(std::ostream& stream, uint32_t value)
+    {
+        stream.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    // Describes the tile's binary chunk: positions, then normals, then indices, one after another.
+    std::string getGltfJson(const ofMesh& mesh, const std::string& name)
+    {
+        const std::vector<glm::vec3>& vertices { mesh.getVertices() };
+        size_t vertexBytes { vertices.size() * sizeof(glm::vec3) };
+        size_t indexBytes { mesh.getNumIndices() * sizeof(ofIndexType) };
+
+        // The spec requires the bounds of the positions.
+        glm::vec3 minimum { std::numeric_limits<float>::max() };
+        glm::vec3 maximum { std::numeric_limits<float>::lowest() };
+        for (const glm::vec3& vertex : vertices)
+        {
+            minimum = glm::min(minimum, vertex);
+            maximum = glm::max(maximum, vertex);
+        }
+
+        // Flat-normal meshes may have no indices, in which case every three vertices are a triangle.
+        bool indexed { indexBytes > 0 };
+
+        std::ostringstream json {};
+        json.precision(std::numeric_limits<float>::max_digits10);
+        json << "{\"asset\":{\"version\":\"2.0\",\"generator\":\"cg-project-3 terrain export\"},"
+            << "\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0,\"name\":\"" << name << "\"}],"
+            << "\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":1}" << (indexed ? ",\"indices\":2" : "") << "}]}],"
+            << "\"buffers\":[{\"byteLength\":" << vertexBytes * 2 + indexBytes << "}],"
+            << "\"bufferViews\":["
+            << "{\"buffer\":0,\"byteOffset\":0,\"byteLength\":" << vertexBytes << ",\"target\":" << ARRAY_BUFFER << "},"
+            << "{\"buffer\":0,\"byteOffset\":" << vertexBytes << ",\"byteLength\":" << vertexBytes << ",\"target\":" << ARRAY_BUFFER << "}";
+
+        if (indexed)
+        {
+            json << ",{\"buffer\":0,\"byteOffset\":" << vertexBytes * 2 << ",\"byteLength\":" << indexBytes << ",\"target\":" << ELEMENT_ARRAY_BUFFER << "}";
+        }
+
+        json << "],\"accessors\":["
+            << "{\"bufferView\":0,\"componentType\":" << FLOAT << ",\"count\":" << vertices.size() << ",\"type\":\"VEC3\","
+            << "\"min\":[" << minimum.x << "," << minimum.y << "," << minimum.z << "],"
+            << "\"max\":[" << maximum.x << "," << maximum.y << "," << maximum.z << "]},"
+            << "{\"bufferView\":1,\"componentType\":" << FLOAT << ",\"count\":" << vertices.size() << ",\"type\":\"VEC3\"}";
+
+        if (indexed)
+        {
+            json << ",{\"bufferView\":2,\"componentType\":" << UNSIGNED_INT << ",\"count\":" << mesh.getNumIndices() << ",\"type\":\"SCALAR\"}";
+        }
+
+        json << "]}";
+
+        return json.str();
+    }
+
+    // Writes a mesh as a .glb file, returning the number of bytes written, or 0 if it couldn't be written.
+    uint64_t writeGlb(const ofMesh& mesh, const std::string& name, const std::string& filePath)
+    {
+        std::string json { getGltfJson(mesh, name) };
+
+        // Chunks must be a multiple of 4 bytes long; the JSON chunk is padded with spaces.
+        json.resize((json.size() + 3) / 4 * 4, ' ');
+
+        size_t vertexBytes { mesh.getNumVertices() * sizeof(glm::vec3) };
+        size_t indexBytes { mesh.getNumIndices() * sizeof(ofIndexType) };
+        uint64_t binBytes { vertexBytes * 2 + indexBytes };
+        uint64_t totalBytes { 12 + 8 + json.size() + 8 + binBytes };
+
+        std::ofstream file { filePath, std::ios::binary | std::ios::trunc };
+
+        writeUint32(file, GLB_MAGIC);
+        writeUint32(file, GLB_VERSION);
+        writeUint32(file, static_cast<uint32_t>(totalBytes));
+
+        writeUint32(file, static_cast<uint32_t>(json.size()));
+        writeUint32(file, JSON_CHUNK);
+        file.write(json.data(), json.size());
+
+        // The arrays go straight from the mesh to the file without being copied into a buffer first.
+        writeUint32(file, static_cast<uint32_t>(binBytes));
+        writeUint32(file, BIN_CHUNK);
+        file.write(reinterpret_cast<const char*>(mesh.getVerticesPointer()), vertexBytes);
+        file.write(reinterpret_cast<const char*>(mesh.getNormalsPointer()), vertexBytes);
+        if (indexBytes > 0)
+        {
+            file.write(reinterpret_cast<const char*>(mesh.getIndexPointer()), indexBytes);
+        }
+
+        return file ? totalBytes : 0;
+    }
+}
+
+double TerrainExportStats::getTilesPerSecond() const
+{
+    return seconds > 0 ? tiles / seconds : 0;
+}
+
+double TerrainExportStats::getMegabytesPerSecond() const
+{
+    return seconds > 0 ? bytes / (1024.0 * 1024.0) / seconds : 0;
+}
+
+bool exportTerrainTiles(const ofShortPixels& heightmap, const TerrainExportSettings& settings, TerrainExportStats& stats)
+{
+    stats = TerrainExportStats();
+
+    if (heightmap.getWidth() < 2 || heightmap.getHeight() < 2 || settings.tileSize == 0)
+    {
+        return false;
+    }
+
+    if (!ofDirectory::doesDirectoryExist(settings.directory, false) && !ofDirectory::createDirectory(settings.directory, false, true))
+    {
+        ofLogError("TerrainExport") << "Couldn't create " << settings.directory << ".";
+        return false;
+    }
+
+    // The heightmap has one more pixel than quads along each side.
+    unsigned int quadsX { static_cast<unsigned int>(heightmap.getWidth()) - 1 };
+    unsigned int quadsY { static_cast<unsigned int>(heightmap.getHeight()) - 1 };
+    unsigned int columns { (quadsX + settings.tileSize - 1) / settings.tileSize };
+    unsigned int rows { (quadsY + settings.tileSize - 1) / settings.tileSize };
+
+    std::atomic<unsigned int> failedTiles { 0 };
+    std::atomic<uint64_t> bytes { 0 };
+
+    auto start = std::chrono::steady_clock::now();
+
+    TaskScheduler::getShared().parallelFor(columns * rows, [&] (size_t tile)
+    {
+        unsigned int column { static_cast<unsigned int>(tile % columns) };
+        unsigned int row { static_cast<unsigned int>(tile / columns) };
+        unsigned int xStart { column * settings.tileSize };
+        unsigned int yStart { row * settings.tileSize };
+
+        ofMesh mesh {};
+        buildTerrainMesh(mesh, heightmap, xStart, yStart, std::min(xStart + settings.tileSize, quadsX),
+            std::min(yStart + settings.tileSize, quadsY), settings.scale, settings.meshOptions);
+
+        std::string name { "tile_" + std::to_string(column) + "_" + std::to_string(row) };
+        uint64_t written { writeGlb(mesh, name, ofFilePath::join(settings.directory, name + ".glb")) };
+
+        if (written == 0)
+        {
+            ofLogError("TerrainExport") << "Couldn't write " << name << ".glb.";
+            failedTiles++;
+        }
+
+        bytes += written;
+    }, settings.threadCount);
+
+    stats.tiles = columns * rows - failedTiles;
+    stats.failedTiles = failedTiles;
+    stats.bytes = bytes;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    ofLogNotice("TerrainExport") << stats.tiles << " tiles of " << settings.tileSize << " x " << settings.tileSize << " quads, "
+        << stats.bytes / (1024.0 * 1024.0) << " MB in " << stats.seconds << " s: " << stats.getTilesPerSecond() << " tiles/s, "
+        << stats.getMegabytesPerSecond() << " MB/s";
+
+    return failedTiles == 0;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "ofMain.h"
+#include "buildTerrainMesh.h"
+
+// Settings for exporting a heightmap as tiled meshes.
+struct TerrainExportSettings
+{
+    // The folder the tiles are written to; it's created if need be.
+    std::string directory {};
+
+    // The number of quads along each side of a tile; the tiles at the right and bottom edges may be narrower.
+    unsigned int tileSize { 256 };
+
+    // The same as for buildTerrainMesh(): a pixel (x, y) with height h becomes the vertex (x, h / USHRT_MAX, y) * scale.
+    glm::vec3 scale { 1 };
+
+    // Smooth normals with the triangles in cache-friendly blocks, which is what offline tools generally want.
+    TerrainMeshOptions meshOptions { true, TerrainIndexOrder::Blocks };
+
+    // The most threads building and writing tiles at once; 0 lets every worker of the shared TaskScheduler join in.
+    unsigned int threadCount { 0 };
+};
+
+// How an export went.
+struct TerrainExportStats
+{
+    unsigned int tiles { 0 };
+    unsigned int failedTiles { 0 };
+    uint64_t bytes { 0 };
+    double seconds { 0 };
+
+    double getTilesPerSecond() const;
+    double getMegabytesPerSecond() const;
+};
+
+// Exports the full-resolution terrain as one glTF binary (.glb) file per tile, named tile_<column>_<row>.glb,
+// with positions, normals and 32-bit indices.  Vertices are in heightmap space, so the tiles line up with each other
+// without any transforms, and the edges of neighbouring tiles share the same vertices.
+//
+// Tiles are built and written in parallel on the shared TaskScheduler.  Each tile's mesh is written straight to its file
+// and dropped before the thread moves on, so no more than one tile per thread is ever in memory, however big the heightmap.
+// Returns false if any tile couldn't be written.
+bool exportTerrainTiles(const ofShortPixels& heightmap, const TerrainExportSettings& settings, TerrainExportStats& stats);
@@ -0,0 +1,170 @@
+#include "TerrainOcclusion.h"
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    const unsigned int DIRECTION_COUNT { 8 };
+    const unsigned int STEP_COUNT { 6 };
+
+    // Unit steps in x and y; the diagonals cover more ground per step, which slopeFactors accounts for.
+    const int directions[DIRECTION_COUNT][2] { { 1, 0 }, { 1, 1 }, { 0, 1 }, { -1, 1 }, { -1, 0 }, { -1, -1 }, { 0, -1 }, { 1, -1 } };
+
+    // The number of steps taken along a direction for each sample; the last one reaches RADIUS.
+    const int stepDistances[STEP_COUNT] { 1, 2, 4, 8, 16, 32 };
+
+    static_assert(TerrainOcclusion::RADIUS == 32, "The last step distance should reach the radius.");
+
+    // Multipliers that turn a difference in samples into a slope (rise over run), per direction and step.
+    void getSlopeFactors(float heightScale, float slopeFactors[DIRECTION_COUNT][STEP_COUNT])
+    {
+        for (unsigned int direction { 0 }; direction < DIRECTION_COUNT; direction++)
+        {
+            float length { glm::length(glm::vec2(directions[direction][0], directions[direction][1])) };
+
+            for (unsigned int step { 0 }; step < STEP_COUNT; step++)
+            {
+                slopeFactors[direction][step] = heightScale / (stepDistances[step] * length);
+            }
+        }
+    }
+
+    // Bakes one pixel; "center" points at its height in the bordered block, whose rows are "stride" samples long.
+    float bakePixel(const unsigned short* center, int stride, const float slopeFactors[DIRECTION_COUNT][STEP_COUNT])
+    {
+        float centerHeight { static_cast<float>(*center) };
+        float occlusion { 0 };
+
+        for (unsigned int direction { 0 }; direction < DIRECTION_COUNT; direction++)
+        {
+            int offset { directions[direction][1] * stride + directions[direction][0] };
+            float maxSlope { 0 };
+
+            for (unsigned int step { 0 }; step < STEP_COUNT; step++)
+            {
+                float height { static_cast<float>(center[offset * stepDistances[step]]) };
+                maxSlope = std::max(maxSlope, (height - centerHeight) * slopeFactors[direction][step]);
+            }
+
+            // The sine of the horizon angle.
+            occlusion += maxSlope / std::sqrt(1.0f + maxSlope * maxSlope);
+        }
+
+        return std::max(TerrainOcclusion::MIN_VISIBILITY, 1.0f - occlusion * (1.0f / DIRECTION_COUNT));
+    }
+
+#ifdef OCCLUSION_USE_SSE2
+    // Loads four neighbouring samples as floats.
+    __m128 loadHeights4(const unsigned short* heights)
+    {
+        __m128i packed { _mm_loadl_epi64(reinterpret_cast<const __m128i*>(heights)) };
+        return _mm_cvtepi32_ps(_mm_unpacklo_epi16(packed, _mm_setzero_si128()));
+    }
+
+    // The same as bakePixel(), for four neighbouring pixels in a row.
+    void bakePixels4(const unsigned short* center, int stride, const float slopeFactors[DIRECTION_COUNT][STEP_COUNT], float* visibility)
+    {
+        __m128 centerHeights { loadHeights4(center) };
+        __m128 occlusion { _mm_setzero_ps() };
+        __m128 one { _mm_set1_ps(1.0f) };
+
+        for (unsigned int direction { 0 }; direction < DIRECTION_COUNT; direction++)
+        {
+            int offset { directions[direction][1] * stride + directions[direction][0] };
+            __m128 maxSlope { _mm_setzero_ps() };
+
+            for (unsigned int step { 0 }; step < STEP_COUNT; step++)
+            {
+                __m128 heights { loadHeights4(center + offset * stepDistances[step]) };
+                __m128 slope { _mm_mul_ps(_mm_sub_ps(heights, centerHeights), _mm_set1_ps(slopeFactors[direction][step])) };
+                maxSlope = _mm_max_ps(maxSlope, slope);
+            }
+
+            occlusion = _mm_add_ps(occlusion, _mm_div_ps(maxSlope, _mm_sqrt_ps(_mm_add_ps(one, _mm_mul_ps(maxSlope, maxSlope)))));
+        }
+
+        __m128 result { _mm_sub_ps(one, _mm_mul_ps(occlusion, _mm_set1_ps(1.0f / DIRECTION_COUNT))) };
+        _mm_storeu_ps(visibility, _mm_max_ps(_mm_set1_ps(TerrainOcclusion::MIN_VISIBILITY), result));
+    }
+#endif
+}
+
+void TerrainOcclusion::bake(const HeightSource& source, glm::ivec2 start, glm::ivec2 size, float heightScale, std::vector<float>& visibility)
+{
+    glm::ivec2 bordered { size + 1 + 2 * static_cast<int>(RADIUS) };
+    std::vector<unsigned short> heights(bordered.x * bordered.y);
+    source.sampleHeights(start - static_cast<int>(RADIUS), bordered, heights.data());
+    bakeFromHeights(heights.data(), size, heightScale, visibility);
+}
+
+void TerrainOcclusion::bakeFromHeights(const unsigned short* heights, glm::ivec2 size, float heightScale, std::vector<float>& visibility)
+{
+#ifdef OCCLUSION_USE_SSE2
+    float slopeFactors[DIRECTION_COUNT][STEP_COUNT];
+    getSlopeFactors(heightScale, slopeFactors);
+
+    int stride { size.x + 1 + 2 * static_cast<int>(RADIUS) };
+    int width { size.x + 1 };
+    visibility.resize(width * (size.y + 1));
+
+    for (int y { 0 }; y <= size.y; y++)
+    {
+        const unsigned short* row { heights + (y + RADIUS) * stride + RADIUS };
+        float* output { visibility.data() + y * width };
+        int x { 0 };
+
+        for (; x + 4 <= width; x += 4)
+        {
+            bakePixels4(row + x, stride, slopeFactors, output + x);
+        }
+
+        // The pixels left over at the end of the row.
+        for (; x < width; x++)
+        {
+            output[x] = bakePixel(row + x, stride, slopeFactors);
+        }
+    }
+#else
+    bakeFromHeightsScalar(heights, size, heightScale, visibility);
+#endif
+}
+
+void TerrainOcclusion::bakeFromHeightsScalar(const unsigned short* heights, glm::ivec2 size, float heightScale, std::vector<float>& visibility)
+{
+    float slopeFactors[DIRECTION_COUNT][STEP_COUNT];
+    getSlopeFactors(heightScale, slopeFactors);
+
+    int stride { size.x + 1 + 2 * static_cast<int>(RADIUS) };
+    int width { size.x + 1 };
+    visibility.resize(width * (size.y + 1));
+
+    for (int y { 0 }; y <= size.y; y++)
+    {
+        const unsigned short* row { heights + (y + RADIUS) * stride + RADIUS };
+
+        for (int x { 0 }; x < width; x++)
+        {
+            visibility[y * width + x] = bakePixel(row + x, stride, slopeFactors);
+        }
+    }
+}
+
+void TerrainOcclusion::apply(ofMesh& mesh, glm::ivec2 start, glm::ivec2 size, const std::vector<float>& visibility)
+{
+    if (mesh.getNumNormals() != mesh.getNumVertices() || visibility.size() != static_cast<size_t>((size.x + 1) * (size.y + 1)))
+    {
+        return;
+    }
+
+    const std::vector<glm::vec3>& vertices { mesh.getVertices() };
+    std::vector<glm::vec3>& normals { mesh.getNormals() };
+
+    for (size_t i { 0 }; i < vertices.size(); i++)
+    {
+        glm::ivec2 pixel { glm::clamp(glm::ivec2(glm::round(glm::vec2(vertices[i].x, vertices[i].z))) - start, glm::ivec2(0), size) };
+        normals[i] = glm::normalize(normals[i]) * visibility[pixel.y * (size.x + 1) + pixel.x];
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "ofMain.h"
+#include "HeightSource.h"
+
+// Baked horizon-based ambient occlusion for terrain.
+// For each pixel, the highest horizon is found along 8 directions by sampling the heights 1, 2, 4, ... 32 pixels away,
+// and the sky visibility is one minus the average sine of the horizon angles: 1 on open ground, lower in valleys and hollows.
+// The visibility is stored as the length of each vertex's normal, so it costs no extra vertex data;
+// shader.frag reads it back before normalizing.  Rows are baked four pixels at a time with SSE2 where available.
+namespace TerrainOcclusion
+{
+    // How far (in pixels) beyond a region the heights are needed.
+    const unsigned int RADIUS { 32 };
+
+    // The least visibility baked, so that normals never shrink to nothing.
+    const float MIN_VISIBILITY { 0.1f };
+
+    // Bakes the sky visibility of a (size.x + 1) x (size.y + 1) region of pixels starting at "start",
+    // row by row into "visibility".  The heights are sampled from the source with a border of RADIUS pixels.
+    // "heightScale" converts samples (0 to USHRT_MAX) into the same units as the one-unit spacing between pixels.
+    void bake(const HeightSource& source, glm::ivec2 start, glm::ivec2 size, float heightScale, std::vector<float>& visibility);
+
+    // Bakes the visibility of the same region from heights that have already been sampled (see bake()):
+    // a (size.x + 1 + 2 * RADIUS) x (size.y + 1 + 2 * RADIUS) block, row by row.
+    void bakeFromHeights(const unsigned short* heights, glm::ivec2 size, float heightScale, std::vector<float>& visibility);
+
+    // The same as bakeFromHeights(), but without vectorization.  Gives the same results to within rounding; used for benchmarking.
+    void bakeFromHeightsScalar(const unsigned short* heights, glm::ivec2 size, float heightScale, std::vector<float>& visibility);
+
+    // Scales the normals of a terrain mesh by the visibility baked for a region starting at pixel "start" with size "size".
+    // The mesh's vertices should be in pixel units (e.g. a cell mesh) so that each one lands on a baked pixel.
+    // Normals are renormalized first, so the visibility can be reapplied after part of the mesh changes.
+    void apply(ofMesh& mesh, glm::ivec2 start, glm::ivec2 size, const std::vector<float>& visibility);
+}
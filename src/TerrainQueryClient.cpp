@@ -0,0 +1,197 @@
+#include "TerrainQueryClient.h"
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+
+using namespace TerrainQueryProtocol;
+
+bool TerrainQueryClient::connect(const std::string& socketPath)
+{
+    return socket.connect(socketPath);
+}
+
+const void* TerrainQueryClient::query(QueryType type, const void* queries, uint32_t count)
+{
+    // Send the header and the queries in one write.
+    size_t queryBytes { getQuerySize(type) * count };
+    requestBuffer.resize(sizeof(Header) + queryBytes);
+
+    Header request { MAGIC, type, count, Status::Ok };
+    std::memcpy(requestBuffer.data(), &request, sizeof(request));
+    if (queryBytes > 0)
+    {
+        std::memcpy(requestBuffer.data() + sizeof(Header), queries, queryBytes);
+    }
+
+    Header response {};
+    if (!socket.writeAll(requestBuffer.data(), requestBuffer.size()) || !socket.readAll(&response, sizeof(response)))
+    {
+        return nullptr;
+    }
+
+    if (response.magic != MAGIC || response.status != Status::Ok)
+    {
+        ofLogError("TerrainQueryClient") << "The service rejected a batch of " << count << " queries.";
+        return nullptr;
+    }
+
+    resultBuffer.resize(getResultSize(type) * response.count);
+    if (!socket.readAll(resultBuffer.data(), resultBuffer.size()))
+    {
+        return nullptr;
+    }
+
+    return resultBuffer.data();
+}
+
+bool TerrainQueryClient::getInfo(InfoResult& info)
+{
+    const void* result { query(QueryType::Info, nullptr, 0) };
+
+    if (result == nullptr)
+    {
+        return false;
+    }
+
+    std::memcpy(&info, result, sizeof(info));
+    return true;
+}
+
+namespace
+{
+    const QueryType loadTestTypes[] { QueryType::Height, QueryType::Normal, QueryType::Slope, QueryType::Raycast };
+    const char* loadTestTypeNames[] { "height", "normal", "slope", "raycast" };
+    const unsigned int LOAD_TEST_TYPE_COUNT { 4 };
+
+    // Gets a percentile (0 to 100) of a set of samples, sorting them in place.
+    double getPercentile(std::vector<double>& samples, double percentile)
+    {
+        if (samples.empty())
+        {
+            return 0;
+        }
+
+        size_t index { static_cast<size_t>(percentile / 100 * (samples.size() - 1) + 0.5) };
+        std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+        return samples[index];
+    }
+}
+
+bool runTerrainQueryLoadTest(const std::string& socketPath, const TerrainQueryLoadSettings& settings)
+{
+    InfoResult info {};
+    {
+        TerrainQueryClient client {};
+        if (!client.connect(socketPath) || !client.getInfo(info))
+        {
+            ofLogError("TerrainQueryClient") << "No terrain query service at " << socketPath << ".";
+            return false;
+        }
+    }
+
+    // The batch latencies of each query type, per connection; merged once the threads finish.
+    std::vector<std::vector<std::vector<double>>> latencies(settings.connections, std::vector<std::vector<double>>(LOAD_TEST_TYPE_COUNT));
+    std::atomic<bool> failed { false };
+    std::vector<std::thread> threads {};
+
+    auto start = std::chrono::steady_clock::now();
+    auto end = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(settings.seconds));
+
+    for (unsigned int connection = 0; connection < settings.connections; connection++)
+    {
+        threads.emplace_back([&, connection] ()
+        {
+            TerrainQueryClient client {};
+            if (!client.connect(socketPath))
+            {
+                failed = true;
+                return;
+            }
+
+            std::mt19937 random { connection + 1 };
+            std::uniform_real_distribution<float> randomX { 0, info.dimensions[0] };
+            std::uniform_real_distribution<float> randomZ { 0, info.dimensions[2] };
+            std::uniform_real_distribution<float> randomAngle { 0, glm::two_pi<float>() };
+
+            std::vector<PointQuery> points(settings.batchSize);
+            std::vector<RayQuery> rays(settings.batchSize);
+
+            for (unsigned int batch = 0; std::chrono::steady_clock::now() < end; batch++)
+            {
+                unsigned int typeIndex = batch % LOAD_TEST_TYPE_COUNT;
+                QueryType type = loadTestTypes[typeIndex];
+                const void* queries;
+
+                if (type == QueryType::Raycast)
+                {
+                    // Rays from above the highest terrain, heading down at 45 degrees in a random direction.
+                    for (RayQuery& ray : rays)
+                    {
+                        float angle = randomAngle(random);
+                        ray = { { randomX(random), info.dimensions[1], randomZ(random) }, { std::cos(angle), -1, std::sin(angle) }, settings.rayLength };
+                    }
+
+                    queries = rays.data();
+                }
+                else
+                {
+                    for (PointQuery& point : points)
+                    {
+                        point = { randomX(random), randomZ(random) };
+                    }
+
+                    queries = points.data();
+                }
+
+                auto batchStart = std::chrono::steady_clock::now();
+                if (client.query(type, queries, settings.batchSize) == nullptr)
+                {
+                    failed = true;
+                    return;
+                }
+
+                std::chrono::duration<double, std::milli> latency = std::chrono::steady_clock::now() - batchStart;
+                latencies[connection][typeIndex].push_back(latency.count());
+            }
+        });
+    }
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    if (failed)
+    {
+        ofLogError("TerrainQueryClient") << "The load test lost its connection to the service.";
+        return false;
+    }
+
+    ofLogNotice("TerrainQueryClient") << "Terrain query load test, " << settings.connections << " connections, "
+        << settings.batchSize << " queries per batch, " << ofToString(elapsed.count(), 1) << " s:";
+
+    size_t totalQueries = 0;
+
+    for (unsigned int typeIndex = 0; typeIndex < LOAD_TEST_TYPE_COUNT; typeIndex++)
+    {
+        std::vector<double> typeLatencies;
+        for (const std::vector<std::vector<double>>& connectionLatencies : latencies)
+        {
+            typeLatencies.insert(typeLatencies.end(), connectionLatencies[typeIndex].begin(), connectionLatencies[typeIndex].end());
+        }
+
+        size_t queries = typeLatencies.size() * settings.batchSize;
+        totalQueries += queries;
+
+        ofLogNotice("TerrainQueryClient") << "  " << loadTestTypeNames[typeIndex] << ": "
+            << ofToString(queries / elapsed.count(), 0) << " queries/s, batch latency p50 "
+            << ofToString(getPercentile(typeLatencies, 50), 3) << " ms, p99 "
+            << ofToString(getPercentile(typeLatencies, 99), 3) << " ms";
+    }
+
+    ofLogNotice("TerrainQueryClient") << "  total: " << ofToString(totalQueries / elapsed.count(), 0) << " queries/s";
+    return true;
+}
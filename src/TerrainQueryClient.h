@@ -0,0 +1,49 @@
+#pragma once
+#include "ofMain.h"
+#include "LocalSocket.h"
+#include "TerrainQueryProtocol.h"
+
+// A connection to a TerrainQueryService.  Each client should only be used by one thread at a time;
+// open one connection per thread to query in parallel.
+class TerrainQueryClient
+{
+public:
+    // Returns false if there's no service listening at the path.
+    bool connect(const std::string& socketPath);
+
+    // Sends a batch of queries (getQuerySize(type) bytes each) and waits for the answers.
+    // Returns a pointer to the getResultCount(type, count) results, which stays valid until the next query,
+    // or nullptr if the service rejected the batch or the connection failed.
+    const void* query(TerrainQueryProtocol::QueryType type, const void* queries, uint32_t count);
+
+    // Asks the service for the size of its terrain.  Returns false on failure.
+    bool getInfo(TerrainQueryProtocol::InfoResult& info);
+
+private:
+    LocalSocket socket {};
+
+    // Reused between queries so that a steady stream of batches doesn't allocate.
+    std::vector<char> requestBuffer {};
+    std::vector<char> resultBuffer {};
+};
+
+// Settings for runTerrainQueryLoadTest().
+struct TerrainQueryLoadSettings
+{
+    // The number of connections, each driven by its own thread.
+    unsigned int connections { 4 };
+
+    // The number of queries in each request.
+    unsigned int batchSize { 256 };
+
+    // How long to keep sending requests for.
+    double seconds { 5 };
+
+    // The length of each ray-cast query, in world-space units.
+    float rayLength { 2048 };
+};
+
+// Drives a running TerrainQueryService with random batches of every query type (cycling through the types),
+// then logs the queries per second and the p50 / p99 latency of a batch for each type.
+// Returns false if it couldn't connect.
+bool runTerrainQueryLoadTest(const std::string& socketPath, const TerrainQueryLoadSettings& settings = TerrainQueryLoadSettings());
@@ -0,0 +1,150 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// The binary messages exchanged with TerrainQueryService.
+// A request is a header followed by "count" query records of the header's type, and the response is a header
+// followed by one result record per query, in the same order.  Both ends are on the same machine,
+// so everything is in native byte order, and positions and distances are in the service's world space.
+namespace TerrainQueryProtocol
+{
+    // The first four bytes of every message ("TRQ1").
+    const uint32_t MAGIC { 0x31515254 };
+
+    // The most queries accepted in a single request.
+    const uint32_t MAX_BATCH_SIZE { 1 << 20 };
+
+    enum class QueryType : uint32_t
+    {
+        // No query records; the response has a single InfoResult.
+        Info = 0,
+
+        // PointQuery -> HeightResult.
+        Height = 1,
+
+        // PointQuery -> NormalResult.
+        Normal = 2,
+
+        // PointQuery -> SlopeResult.
+        Slope = 3,
+
+        // RayQuery -> RaycastResult.
+        Raycast = 4,
+    };
+
+    enum class Status : uint32_t
+    {
+        Ok = 0,
+
+        // The request had an unknown query type or too many queries; the response has no results.
+        BadRequest = 1,
+    };
+
+    struct Header
+    {
+        uint32_t magic;
+        QueryType type;
+        uint32_t count;
+
+        // Only used in responses.
+        Status status;
+    };
+
+    // A position on the terrain, in x and z.
+    struct PointQuery
+    {
+        float x;
+        float z;
+    };
+
+    struct RayQuery
+    {
+        float origin[3];
+
+        // Doesn't need to be normalized.
+        float direction[3];
+
+        float maxDistance;
+    };
+
+    struct InfoResult
+    {
+        // The size of the terrain (see World::dimensions).
+        float dimensions[3];
+
+        float waterHeight;
+    };
+
+    struct HeightResult
+    {
+        float height;
+    };
+
+    struct NormalResult
+    {
+        float normal[3];
+    };
+
+    struct SlopeResult
+    {
+        // Rise over run.
+        float slope;
+
+        // 1 if a character could walk up or down the slope (see CharacterPhysics), otherwise 0.
+        uint32_t walkable;
+    };
+
+    struct RaycastResult
+    {
+        // 1 if the ray hit the terrain within its maximum distance, otherwise 0 (and the rest is undefined).
+        uint32_t hit;
+
+        float distance;
+        float point[3];
+    };
+
+    static_assert(sizeof(Header) == 16 && sizeof(PointQuery) == 8 && sizeof(RayQuery) == 28, "Unexpected padding in query records.");
+    static_assert(sizeof(InfoResult) == 16 && sizeof(SlopeResult) == 8 && sizeof(RaycastResult) == 20, "Unexpected padding in result records.");
+
+    // The size of each query record of a type, or 0 for types without any.
+    inline size_t getQuerySize(QueryType type)
+    {
+        switch (type)
+        {
+        case QueryType::Height:
+        case QueryType::Normal:
+        case QueryType::Slope:
+            return sizeof(PointQuery);
+        case QueryType::Raycast:
+            return sizeof(RayQuery);
+        default:
+            return 0;
+        }
+    }
+
+    // The size of each result record of a type, or 0 if the type is unknown.
+    inline size_t getResultSize(QueryType type)
+    {
+        switch (type)
+        {
+        case QueryType::Info:
+            return sizeof(InfoResult);
+        case QueryType::Height:
+            return sizeof(HeightResult);
+        case QueryType::Normal:
+            return sizeof(NormalResult);
+        case QueryType::Slope:
+            return sizeof(SlopeResult);
+        case QueryType::Raycast:
+            return sizeof(RaycastResult);
+        default:
+            return 0;
+        }
+    }
+
+    // The number of result records in the response to a request for "count" queries.
+    inline uint32_t getResultCount(QueryType type, uint32_t count)
+    {
+        return type == QueryType::Info ? 1 : count;
+    }
+}
@@ -0,0 +1,381 @@
+#include "TerrainQueryService.h"
+
+using namespace glm;
+using namespace TerrainQueryProtocol;
+
+TerrainQueryService::TerrainQueryService(const World& world)
+    : world { world }
+{
+}
+
+TerrainQueryService::~TerrainQueryService()
+{
+    stop();
+}
+
+bool TerrainQueryService::start(const std::string& socketPath, unsigned int threadCount)
+{
+    stop();
+
+    if (!listenSocket.listen(socketPath))
+    {
+        return false;
+    }
+
+    // Connect to ourselves before the workers start, so that the first connection waiting is the wake connection.
+    if (!wakeSender.connect(socketPath) || !(wakeReceiver = listenSocket.accept()).isOpen())
+    {
+        ofLogError("TerrainQueryService") << "Couldn't connect to " << socketPath << " to wake the poll thread.";
+        wakeSender.close();
+        listenSocket.close();
+        std::remove(socketPath.c_str());
+        return false;
+    }
+
+    if (threadCount == 0)
+    {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    this->socketPath = socketPath;
+    stopping = false;
+    queriesAnswered = 0;
+
+    for (unsigned int i { 0 }; i < threadCount; i++)
+    {
+        workers.emplace_back([this] () { runWorker(); });
+    }
+
+    pollThread = std::thread { [this] () { pollConnections(); } };
+
+    ofLogNotice("TerrainQueryService") << "Listening at " << socketPath << " with " << threadCount << " worker threads.";
+    return true;
+}
+
+void TerrainQueryService::stop()
+{
+    if (!pollThread.joinable())
+    {
+        return;
+    }
+
+    stopping = true;
+    wakePollThread();
+    pollThread.join();
+
+    {
+        // Wake workers waiting for a request or blocked reading one.
+        std::lock_guard<std::mutex> lock { connectionMutex };
+        readyConnections.clear();
+
+        for (const std::unique_ptr<Connection>& connection : connections)
+        {
+            connection->socket.shutdown();
+        }
+    }
+
+    connectionReady.notify_all();
+
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+
+    workers.clear();
+    connections.clear();
+    wakeSender.close();
+    wakeReceiver.close();
+    listenSocket.close();
+    std::remove(socketPath.c_str());
+}
+
+bool TerrainQueryService::isRunning() const
+{
+    return pollThread.joinable() && !stopping;
+}
+
+uint64_t TerrainQueryService::getQueriesAnswered() const
+{
+    return queriesAnswered;
+}
+
+void TerrainQueryService::wakePollThread()
+{
+    char wake { 0 };
+    wakeSender.writeAll(&wake, sizeof(wake));
+}
+
+void TerrainQueryService::pollConnections()
+{
+    std::vector<const LocalSocket*> sockets {};
+    std::vector<Connection*> watched {};
+    std::vector<char> readable {};
+
+    while (!stopping)
+    {
+        // Watch for new connections, wake-ups, and requests on every connection that isn't with a worker.
+        // Only this thread adds connections and workers only remove busy ones, so the idle ones stay put during the wait.
+        sockets = { &listenSocket, &wakeReceiver };
+        watched.clear();
+
+        {
+            std::lock_guard<std::mutex> lock { connectionMutex };
+
+            for (const std::unique_ptr<Connection>& connection : connections)
+            {
+                if (!connection->busy)
+                {
+                    sockets.push_back(&connection->socket);
+                    watched.push_back(connection.get());
+                }
+            }
+        }
+
+        if (!LocalSocket::waitForReadable(sockets, readable))
+        {
+            ofLogError("TerrainQueryService") << "Couldn't wait for requests.";
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+
+        if (readable[1])
+        {
+            char wakes[64];
+            wakeReceiver.readSome(wakes, sizeof(wakes));
+        }
+
+        if (stopping)
+        {
+            return;
+        }
+
+        if (readable[0])
+        {
+            LocalSocket socket { listenSocket.accept() };
+
+            if (socket.isOpen())
+            {
+                std::unique_ptr<Connection> connection { new Connection() };
+                connection->socket = std::move(socket);
+
+                std::lock_guard<std::mutex> lock { connectionMutex };
+                connections.push_back(std::move(connection));
+            }
+            else
+            {
+                // Most likely out of file handles; don't spin.
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        }
+
+        // Hand the connections with a request waiting to the workers.
+        size_t readyCount { 0 };
+
+        {
+            std::lock_guard<std::mutex> lock { connectionMutex };
+
+            for (size_t i { 0 }; i < watched.size(); i++)
+            {
+                if (readable[i + 2])
+                {
+                    watched[i]->busy = true;
+                    readyConnections.push_back(watched[i]);
+                    readyCount++;
+                }
+            }
+        }
+
+        for (size_t i { 0 }; i < readyCount; i++)
+        {
+            connectionReady.notify_one();
+        }
+    }
+}
+
+void TerrainQueryService::runWorker()
+{
+    while (true)
+    {
+        Connection* connection { nullptr };
+
+        {
+            std::unique_lock<std::mutex> lock { connectionMutex };
+            connectionReady.wait(lock, [this] () { return stopping || !readyConnections.empty(); });
+
+            if (stopping)
+            {
+                return;
+            }
+
+            connection = readyConnections.front();
+            readyConnections.pop_front();
+        }
+
+        bool keepOpen { serveRequest(*connection) };
+
+        {
+            std::lock_guard<std::mutex> lock { connectionMutex };
+
+            if (keepOpen)
+            {
+                connection->busy = false;
+            }
+            else
+            {
+                connections.erase(std::find_if(connections.begin(), connections.end(),
+                    [connection] (const std::unique_ptr<Connection>& c) { return c.get() == connection; }));
+            }
+        }
+
+        // Have the poll thread watch the connection for its next request.
+        if (keepOpen)
+        {
+            wakePollThread();
+        }
+    }
+}
+
+bool TerrainQueryService::serveRequest(Connection& connection)
+{
+    Header request {};
+
+    // A closed connection also polls as readable, and ends here.
+    if (!connection.socket.readAll(&request, sizeof(request)))
+    {
+        return false;
+    }
+
+    if (request.magic != MAGIC)
+    {
+        ofLogWarning("TerrainQueryService") << "Closing a connection that sent a bad message.";
+        return false;
+    }
+
+    size_t querySize { getQuerySize(request.type) };
+    size_t resultSize { getResultSize(request.type) };
+
+    // Without a known query size there's no way to skip the rest of the request and stay in step with the client,
+    // so reply and end the connection.
+    if (resultSize == 0 || request.count > MAX_BATCH_SIZE)
+    {
+        Header response { MAGIC, request.type, 0, Status::BadRequest };
+        connection.socket.writeAll(&response, sizeof(response));
+        return false;
+    }
+
+    size_t queryBytes { querySize * request.count };
+    if (connection.requestBuffer.size() < queryBytes)
+    {
+        connection.requestBuffer.resize(queryBytes);
+    }
+
+    if (!connection.socket.readAll(connection.requestBuffer.data(), queryBytes))
+    {
+        return false;
+    }
+
+    // Write the header and the results into one buffer so that the response goes out in a single write.
+    uint32_t resultCount { getResultCount(request.type, request.count) };
+    size_t responseBytes { sizeof(Header) + resultSize * resultCount };
+    if (connection.responseBuffer.size() < responseBytes)
+    {
+        connection.responseBuffer.resize(responseBytes);
+    }
+
+    Header response { MAGIC, request.type, resultCount, Status::Ok };
+    std::memcpy(connection.responseBuffer.data(), &response, sizeof(response));
+    answer(request.type, connection.requestBuffer.data(), request.count, connection.responseBuffer.data() + sizeof(Header));
+
+    if (!connection.socket.writeAll(connection.responseBuffer.data(), responseBytes))
+    {
+        return false;
+    }
+
+    queriesAnswered += request.count;
+    return true;
+}
+
+void TerrainQueryService::answer(QueryType type, const void* queries, uint32_t count, void* results) const
+{
+    // The buffers come from std::vector<char>, whose storage is aligned for any of the records.
+    const PointQuery* points { static_cast<const PointQuery*>(queries) };
+
+    switch (type)
+    {
+    case QueryType::Info:
+    {
+        InfoResult& info { *static_cast<InfoResult*>(results) };
+        info.dimensions[0] = world.dimensions.x;
+        info.dimensions[1] = world.dimensions.y;
+        info.dimensions[2] = world.dimensions.z;
+        info.waterHeight = world.waterHeight;
+        break;
+    }
+    case QueryType::Height:
+    {
+        HeightResult* heights { static_cast<HeightResult*>(results) };
+
+        for (uint32_t i { 0 }; i < count; i++)
+        {
+            heights[i].height = world.getTerrainHeightAtPosition(vec3(points[i].x, 0, points[i].z));
+        }
+
+        break;
+    }
+    case QueryType::Normal:
+    {
+        NormalResult* normals { static_cast<NormalResult*>(results) };
+
+        for (uint32_t i { 0 }; i < count; i++)
+        {
+            vec3 normal { world.getTerrainNormalAtPosition(vec3(points[i].x, 0, points[i].z)) };
+            normals[i].normal[0] = normal.x;
+            normals[i].normal[1] = normal.y;
+            normals[i].normal[2] = normal.z;
+        }
+
+        break;
+    }
+    case QueryType::Slope:
+    {
+        SlopeResult* slopes { static_cast<SlopeResult*>(results) };
+
+        for (uint32_t i { 0 }; i < count; i++)
+        {
+            // CharacterPhysics keeps characters on the ground down to a 45 degree slope (rise over run of 1).
+            float slope { world.getTerrainSlopeAtPosition(vec3(points[i].x, 0, points[i].z)) };
+            slopes[i].slope = slope;
+            slopes[i].walkable = slope <= 1.0f ? 1 : 0;
+        }
+
+        break;
+    }
+    case QueryType::Raycast:
+    {
+        const RayQuery* rays { static_cast<const RayQuery*>(queries) };
+        RaycastResult* hits { static_cast<RaycastResult*>(results) };
+
+        for (uint32_t i { 0 }; i < count; i++)
+        {
+            vec3 origin { rays[i].origin[0], rays[i].origin[1], rays[i].origin[2] };
+            vec3 direction { rays[i].direction[0], rays[i].direction[1], rays[i].direction[2] };
+            float distance { 0 };
+
+            // The rays come from clients, so check them before marching.
+            bool valid { std::isfinite(origin.x) && std::isfinite(origin.y) && std::isfinite(origin.z)
+                && std::isfinite(direction.x) && std::isfinite(direction.y) && std::isfinite(direction.z)
+                && direction != vec3(0) && std::isfinite(rays[i].maxDistance) && rays[i].maxDistance >= 0 };
+
+            hits[i].hit = valid && world.raycastTerrain(origin, direction, rays[i].maxDistance, distance) ? 1 : 0;
+            hits[i].distance = distance;
+
+            vec3 point { hits[i].hit ? origin + normalize(direction) * distance : origin };
+            hits[i].point[0] = point.x;
+            hits[i].point[1] = point.y;
+            hits[i].point[2] = point.z;
+        }
+
+        break;
+    }
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include "ofMain.h"
+#include "World.h"
+#include "LocalSocket.h"
+#include "TerrainQueryProtocol.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Answers batched terrain queries (heights, normals, slopes and ray-casts against a World) over a local socket,
+// so that game servers and tools can share one terrain process instead of each loading the heightmap.
+// See TerrainQueryProtocol.h for the messages, and TerrainQueryClient for the other end.
+//
+// A poll thread accepts connections and watches the idle ones, handing each connection with a request waiting to a pool
+// of worker threads.  A worker answers that one request and gives the connection back, so any number of clients share
+// the workers a batch at a time rather than each holding a thread for as long as it stays connected.
+// Requests are read straight into a buffer owned by the connection and answered from there in place,
+// so a batch costs two reads and one write whatever its size, with no per-query allocation.
+class TerrainQueryService
+{
+public:
+    // The world (and its heightmap) must outlive the service, and mustn't be edited while it's running.
+    TerrainQueryService(const World& world);
+    ~TerrainQueryService();
+
+    // Don't support copy constructor or copy assignment operator.
+    TerrainQueryService(const TerrainQueryService& s) = delete;
+    TerrainQueryService& operator= (const TerrainQueryService& s) = delete;
+
+    // Starts listening at a socket path.  If threadCount is zero, one worker thread per hardware core is used,
+    // which is also the number of requests answered at once; requests on other connections wait for a free worker.
+    // Returns false if the socket couldn't be opened.
+    bool start(const std::string& socketPath, unsigned int threadCount = 0);
+
+    // Closes the socket and every connection, and waits for the threads to finish.
+    void stop();
+
+    bool isRunning() const;
+
+    // Answers a batch of queries of one type, writing getResultCount() results of getResultSize() bytes each.
+    // This is what the workers run for each request; it can be called from several threads at once.
+    void answer(TerrainQueryProtocol::QueryType type, const void* queries, uint32_t count, void* results) const;
+
+    // The total number of queries answered since the service started.
+    uint64_t getQueriesAnswered() const;
+
+private:
+    const World& world;
+
+    // A client's connection, with buffers that are reused for every request on it,
+    // so that they only grow to the largest batch seen.
+    struct Connection
+    {
+        LocalSocket socket {};
+        std::vector<char> requestBuffer {};
+        std::vector<char> responseBuffer {};
+
+        // Set while a worker has the connection (or it's waiting for one), so that the poll thread leaves it alone.
+        bool busy { false };
+    };
+
+    LocalSocket listenSocket {};
+    std::string socketPath {};
+    std::thread pollThread {};
+    std::vector<std::thread> workers {};
+    std::atomic<bool> stopping { false };
+
+    // A connection to the service's own socket, which the workers and stop() write a byte to
+    // to wake the poll thread when there's a connection to watch again or it's time to stop.
+    LocalSocket wakeSender {};
+    LocalSocket wakeReceiver {};
+
+    // Every open connection, and the ones with a request waiting for a worker.
+    std::vector<std::unique_ptr<Connection>> connections {};
+    std::deque<Connection*> readyConnections {};
+    std::mutex connectionMutex {};
+    std::condition_variable connectionReady {};
+
+    std::atomic<uint64_t> queriesAnswered { 0 };
+
+    void pollConnections();
+    void runWorker();
+    void wakePollThread();
+
+    // Answers the request waiting on a connection.  Returns false if the connection should be closed.
+    bool serveRequest(Connection& connection);
+};
@@ -0,0 +1,63 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Hands values from one writing thread to one reading thread without locks or waiting.
+// The writer and the reader each own one of three buffers; the third sits in the middle.  Publishing swaps the writer's
+// buffer with the middle one, and the reader swaps the middle one for its own only when something new was published,
+// so the reader always sees the latest complete value and neither thread ever waits for the other.
+template<typename T>
+class TripleBuffer
+{
+public:
+    // Gets the writer's buffer to fill in.  Only the writing thread should call this.
+    T& getWriteBuffer()
+    {
+        return buffers[writeIndex];
+    }
+
+    // Makes the writer's buffer the latest value, and gives the writer the middle buffer to fill in next.
+    // The new write buffer holds an older value, so overwrite all of it.
+    void publish()
+    {
+        uint8_t previous { middle.exchange(static_cast<uint8_t>(writeIndex | FRESH), std::memory_order_acq_rel) };
+        writeIndex = previous & INDEX_MASK;
+    }
+
+    // Writes a whole value and publishes it.
+    void write(const T& value)
+    {
+        getWriteBuffer() = value;
+        publish();
+    }
+
+    // Gets the latest value published, which stays put until the next call.  Only the reading thread should call this.
+    // If nothing new has been published since the last read, it's the same value as last time.
+    const T& read()
+    {
+        if (middle.load(std::memory_order_relaxed) & FRESH)
+        {
+            uint8_t previous { middle.exchange(readIndex, std::memory_order_acq_rel) };
+            readIndex = previous & INDEX_MASK;
+        }
+
+        return buffers[readIndex];
+    }
+
+    // True if a value has been published that read() hasn't returned yet.
+    bool hasNewValue() const
+    {
+        return (middle.load(std::memory_order_relaxed) & FRESH) != 0;
+    }
+
+private:
+    const static uint8_t INDEX_MASK { 3 };
+    const static uint8_t FRESH { 4 };
+
+    T buffers[3] {};
+    uint8_t writeIndex { 0 };
+    uint8_t readIndex { 1 };
+
+    // The index of the middle buffer, plus FRESH if it holds a value that hasn't been read.
+    std::atomic<uint8_t> middle { 2 };
+};
@@ -5,7 +5,21 @@ using namespace glm;
 
 float World::getTerrainHeightAtPosition(const glm::vec3& position) const
 {
-    if (!heightmap)
+    if (!heightmap && heightSource)
+    {
+        // Remap to the nominal resolution of the height source; unbounded sources can go past the edges.
+        vec2 pixelScaledPosition { vec2(position.x / dimensions.x, position.z / dimensions.z) * vec2(heightSource->getSize() - 1) };
+        ivec2 baseIndices { floor(pixelScaledPosition) };
+
+        // Row by row: (x, y), (x + 1, y), (x, y + 1), (x + 1, y + 1).
+        unsigned short heights[4];
+        heightSource->sampleHeights(baseIndices, ivec2(2), heights);
+        vec2 st { pixelScaledPosition - vec2(baseIndices) };
+
+        return (mix(mix(static_cast<float>(heights[0]), static_cast<float>(heights[2]), st[1]),
+            mix(static_cast<float>(heights[1]), static_cast<float>(heights[3]), st[1]), st[0]) / USHRT_MAX) * dimensions.y;
+    }
+    else if (!heightmap)
     {
         return 0.0f;
     }
@@ -30,4 +44,170 @@ float World::getTerrainHeightAtPosition(const glm::vec3& position) const
         // Linearly interpolate and apply the correct scale to the height being returned.
         return (mix(mix(height00, height01, st[1]), mix(height10, height11, st[1]), st[0]) / USHRT_MAX) * dimensions.y; 
     }
-}
\ No newline at end of file
+}
+
+float World::getTerrainHeightAtPixel(unsigned int x, unsigned int y) const
+{
+    if (!heightmap && heightSource)
+    {
+        return (heightSource->sampleHeight(ivec2(x, y)) / static_cast<float>(USHRT_MAX)) * dimensions.y;
+    }
+    else if (!heightmap)
+    {
+        return 0.0f;
+    }
+    else
+    {
+        // Read the first channel directly rather than going through getColor() since this is called in tight loops.
+        return (heightmap->getData()[heightmap->getPixelIndex(x, y)] / static_cast<float>(USHRT_MAX)) * dimensions.y;
+    }
+}
+
+glm::vec2 World::getPixelSpacing() const
+{
+    ivec2 size { 2 };
+
+    if (heightmap)
+    {
+        size = ivec2(heightmap->getWidth(), heightmap->getHeight());
+    }
+    else if (heightSource)
+    {
+        size = heightSource->getSize();
+    }
+
+    return vec2(dimensions.x, dimensions.z) / vec2(max(size - 1, ivec2(1)));
+}
+
+glm::vec2 World::getTerrainGradientAtPosition(const glm::vec3& position) const
+{
+    vec2 spacing { getPixelSpacing() };
+    float left { getTerrainHeightAtPosition(position - vec3(spacing.x, 0, 0)) };
+    float right { getTerrainHeightAtPosition(position + vec3(spacing.x, 0, 0)) };
+    float back { getTerrainHeightAtPosition(position - vec3(0, 0, spacing.y)) };
+    float front { getTerrainHeightAtPosition(position + vec3(0, 0, spacing.y)) };
+
+    return vec2((right - left) / (2 * spacing.x), (front - back) / (2 * spacing.y));
+}
+
+glm::vec3 World::getTerrainNormalAtPosition(const glm::vec3& position) const
+{
+    vec2 gradient { getTerrainGradientAtPosition(position) };
+    return normalize(vec3(-gradient.x, 1, -gradient.y));
+}
+
+float World::getTerrainSlopeAtPosition(const glm::vec3& position) const
+{
+    return length(getTerrainGradientAtPosition(position));
+}
+
+bool World::raycastTerrain(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& hitDistance) const
+{
+    auto isFinite = [] (const vec3& v) { return std::isfinite(v.x) && std::isfinite(v.y) && std::isfinite(v.z); };
+
+    if (!isFinite(origin) || !isFinite(direction) || direction == vec3(0) || std::isnan(maxDistance) || maxDistance < 0)
+    {
+        return false;
+    }
+
+    vec3 unitDirection { normalize(direction) };
+
+    // Tiny directions can underflow when they're normalized.
+    if (!isFinite(unitDirection) || unitDirection == vec3(0))
+    {
+        return false;
+    }
+
+    // The height of the ray above the terrain at a distance along it.
+    auto getClearance = [&] (float distance)
+    {
+        vec3 point { origin + unitDirection * distance };
+        return point.y - getTerrainHeightAtPosition(point);
+    };
+
+    if (getClearance(0) <= 0)
+    {
+        hitDistance = 0;
+        return true;
+    }
+
+    // Only march the part of the ray inside the terrain's bounding box.  Heights are between 0 and dimensions.y,
+    // and a bounded heightmap or source covers (0, 0) to (dimensions.x, dimensions.z).
+    float nearDistance { 0 };
+    float farDistance { maxDistance };
+
+    auto clipToSlab = [&] (float start, float delta, float low, float high)
+    {
+        if (delta == 0)
+        {
+            if (start < low || start > high)
+            {
+                farDistance = -1;
+            }
+            return;
+        }
+
+        float lowDistance { (low - start) / delta };
+        float highDistance { (high - start) / delta };
+        nearDistance = std::max(nearDistance, std::min(lowDistance, highDistance));
+        farDistance = std::min(farDistance, std::max(lowDistance, highDistance));
+    };
+
+    clipToSlab(origin.y, unitDirection.y, 0, dimensions.y);
+    if (heightmap || (heightSource && heightSource->isBounded()))
+    {
+        clipToSlab(origin.x, unitDirection.x, 0, dimensions.x);
+        clipToSlab(origin.z, unitDirection.z, 0, dimensions.z);
+    }
+
+    // An unbounded source with a level ray and no maximum distance would never end.
+    if (nearDistance > farDistance || !std::isfinite(farDistance))
+    {
+        return false;
+    }
+
+    vec2 spacing { getPixelSpacing() };
+    float step { 0.5f * std::min(spacing.x, spacing.y) };
+
+    if (!(step > 0))
+    {
+        return false;
+    }
+
+    // Count the steps rather than adding them up, since adding a step to a large enough distance doesn't change it.
+    uint64_t stepCount { static_cast<uint64_t>(std::ceil((farDistance - nearDistance) / step)) };
+    float previousDistance { nearDistance };
+
+    for (uint64_t stepIndex { 1 }; stepIndex <= stepCount; stepIndex++)
+    {
+        float distance { std::min(nearDistance + stepIndex * step, farDistance) };
+
+        if (getClearance(distance) <= 0)
+        {
+            // Bisect between the last point above the terrain and the first point below it.
+            float above { previousDistance };
+            float below { distance };
+
+            for (int i { 0 }; i < 12; i++)
+            {
+                float middle { 0.5f * (above + below) };
+
+                if (getClearance(middle) <= 0)
+                {
+                    below = middle;
+                }
+                else
+                {
+                    above = middle;
+                }
+            }
+
+            hitDistance = below;
+            return true;
+        }
+
+        previousDistance = distance;
+    }
+
+    return false;
+}
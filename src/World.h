@@ -1,5 +1,7 @@
 #pragma once
 #include "ofMain.h"
+#include "HeightSource.h"
+#include <shared_mutex>
 
 struct World
 {
@@ -7,6 +9,14 @@ public:
     // The pixel array containing the world heightmap.
     const ofShortPixels* heightmap { nullptr };
 
+    // Where heights come from if there's no heightmap, e.g. procedural terrain.
+    // "dimensions" is measured against the source's nominal size.
+    const HeightSource* heightSource { nullptr };
+
+    // Set if the heightmap is edited while the world is in use (see HeightmapEditor).
+    // Threads reading the world, like SimulationThread, hold it shared while they do.
+    std::shared_timed_mutex* heightmapMutex { nullptr };
+
     // The desired x,y,z scale for the height map. 
     // The terrain will span from (0,0,0) to these dimensions, in world space coordinates
     // In other words, this field represents width, height, and depth of the world's terrain.
@@ -23,4 +33,26 @@ public:
 
     // Gets the height of the terrain at a particular position in world space.
     float getTerrainHeightAtPosition(const glm::vec3& position) const;
+
+    // Gets the height of the terrain in world space at a particular pixel of the heightmap (no interpolation).
+    float getTerrainHeightAtPixel(unsigned int x, unsigned int y) const;
+
+    // Gets the world-space distance between neighbouring heightmap pixels in x and z.
+    glm::vec2 getPixelSpacing() const;
+
+    // Gets the upward-facing unit normal of the terrain at a position, from the height one pixel either side in x and z.
+    glm::vec3 getTerrainNormalAtPosition(const glm::vec3& position) const;
+
+    // Gets the steepness of the terrain at a position as rise over run, so 1 is the 45 degree limit of CharacterPhysics.
+    float getTerrainSlopeAtPosition(const glm::vec3& position) const;
+
+    // Finds where a ray first meets the terrain, marching half a pixel at a time and then refining the crossing.
+    // Returns false if there's no hit within maxDistance; otherwise hitDistance is the distance along the (normalized) direction.
+    // A ray starting below the terrain hits at distance 0.  Only the part of the ray inside the terrain's bounding box is marched,
+    // and rays with non-finite values or no direction never hit.
+    bool raycastTerrain(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& hitDistance) const;
+
+private:
+    // The height gradient (rise per unit of x and z) at a position, by central differences.
+    glm::vec2 getTerrainGradientAtPosition(const glm::vec3& position) const;
 };
\ No newline at end of file
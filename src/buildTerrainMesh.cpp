@@ -1,7 +1,11 @@
-#include "ofMain.h"
+#include "buildTerrainMesh.h"
+#include <map>
+#include <mutex>
+#include <tuple>
 
 void buildTerrainMesh(ofMesh& terrainMesh, const ofShortPixels& heightmap,
-    unsigned int xStart, unsigned int yStart, unsigned int xEnd, unsigned int yEnd, glm::vec3 scale)
+    unsigned int xStart, unsigned int yStart, unsigned int xEnd, unsigned int yEnd, glm::vec3 scale,
+    const TerrainMeshOptions& options)
 {
     using namespace glm;
 
@@ -14,44 +18,288 @@ void buildTerrainMesh(ofMesh& terrainMesh, const ofShortPixels& heightmap,
         }
     }
 
-    int imageHeight = (yEnd - yStart) + 1; // +1 because it fixes missing edge quads or connecting edge triangles (idk why).
-    int thisX;
-    int thisY;
-    int nextX;
-    int nextY;
+    if (options.smoothNormals)
+    {
+        for (int x = xStart; x <= xEnd; x++)
+        {
+            for (int y = yStart; y <= yEnd; y++)
+            {
+                terrainMesh.addNormal(calculateTerrainNormal(heightmap, x, y, scale));
+            }
+        }
+    }
+
+    addTerrainGridIndices(terrainMesh, xEnd - xStart + 1, yEnd - yStart + 1, options);
+
+    if (!options.smoothNormals)
+    {
+        terrainMesh.flatNormals();
+
+        // Flip normals.
+        for (int n = 0; n < terrainMesh.getNumNormals(); n++)
+        {
+            terrainMesh.setNormal(n, -terrainMesh.getNormal(n));
+        }
+    }
+}
+
+glm::vec3 calculateTerrainNormal(const ofShortPixels& heightmap, int x, int y, glm::vec3 scale)
+{
+    // Central differences, reaching outside the mesh where possible so that neighbouring meshes match at the seams.
+    int maxX = heightmap.getWidth() - 1;
+    int maxY = heightmap.getHeight() - 1;
+    auto heightAt = [&] (int x, int y)
+    {
+        return heightmap.getColor(std::min(std::max(x, 0), maxX), std::min(std::max(y, 0), maxY)).r / static_cast<float>(USHRT_MAX) * scale.y;
+    };
+
+    float slopeX = (heightAt(x + 1, y) - heightAt(x - 1, y)) / (2 * scale.x);
+    float slopeZ = (heightAt(x, y + 1) - heightAt(x, y - 1)) / (2 * scale.z);
+    return glm::normalize(glm::vec3(-slopeX, 1, -slopeZ));
+}
+
+std::pair<size_t, size_t> updateTerrainMeshRegion(ofMesh& terrainMesh, const ofShortPixels& heightmap,
+    unsigned int xStart, unsigned int yStart, unsigned int xEnd, unsigned int yEnd, glm::vec3 scale,
+    glm::ivec2 regionMin, glm::ivec2 regionMax)
+{
+    using namespace glm;
+
+    ivec2 updateMin = max(regionMin, ivec2(xStart, yStart));
+    ivec2 updateMax = min(regionMax, ivec2(xEnd, yEnd));
+
+    if (updateMin.x > updateMax.x || updateMin.y > updateMax.y)
+    {
+        return { 0, 0 };
+    }
+
+    int rows = (yEnd - yStart) + 1;
+
+    for (int x = updateMin.x; x <= updateMax.x; x++)
+    {
+        for (int y = updateMin.y; y <= updateMax.y; y++)
+        {
+            // Vertices are laid out column by column.
+            size_t index = (x - xStart) * rows + (y - yStart);
+            vec3 vertex = terrainMesh.getVertex(index);
+            vertex.y = scale.y * heightmap.getColor(x, y).r / static_cast<float>(USHRT_MAX);
+            terrainMesh.setVertex(index, vertex);
+            terrainMesh.setNormal(index, calculateTerrainNormal(heightmap, x, y, scale));
+        }
+    }
+
+    // The changed columns are contiguous, so one range covers them all.
+    size_t first = (updateMin.x - xStart) * rows + (updateMin.y - yStart);
+    size_t last = (updateMax.x - xStart) * rows + (updateMax.y - yStart) + 1;
+    return { first, last };
+}
+
+std::shared_ptr<const std::vector<ofIndexType>> getTerrainGridIndices(unsigned int columns, unsigned int rows, const TerrainMeshOptions& options)
+{
+    // Cell meshes are built on the task scheduler's workers, so the cache needs a lock.
+    static std::map<std::tuple<unsigned int, unsigned int, TerrainIndexOrder, unsigned int>, std::shared_ptr<const std::vector<ofIndexType>>> cache;
+    static std::mutex cacheMutex;
+
+    auto key = std::make_tuple(columns, rows, options.indexOrder, options.vertexCacheSize);
+    std::lock_guard<std::mutex> lock(cacheMutex);
+
+    auto cached = cache.find(key);
+    if (cached != cache.end())
+    {
+        return cached->second;
+    }
+
+    std::shared_ptr<std::vector<ofIndexType>> indices = std::make_shared<std::vector<ofIndexType>>();
+    indices->reserve(6 * (columns - 1) * (rows - 1));
+
+    int imageHeight = rows;
+    auto addQuad = [&] (int thisX, int thisY)
+    {
+        int nextX = thisX + 1;
+        int nextY = thisY + 1;
+
+        // 0 is this XY
+        // 2 is next XY
+        //
+        //    0 -- 3
+        //    |  / |
+        //    | /  |
+        //    1 -- 2
+
+        indices->push_back(thisX * imageHeight + thisY); // 0 Top-left.
+        indices->push_back(thisX * imageHeight + nextY); // 1 Bottom-left.
+        indices->push_back(nextX * imageHeight + thisY); // 3 Top-right.
+
+        indices->push_back(nextX * imageHeight + thisY); // 3 Top-right.
+        indices->push_back(thisX * imageHeight + nextY); // 1 Bottom-left.
+        indices->push_back(nextX * imageHeight + nextY); // 2 Bottom-right.
+    };
+
+    // A strip of quads this wide loads (width + 1) vertices per row, and the previous row's vertices need to survive
+    // another (width + 1) loads before they're reused, so it has to be a bit less than half the cache.
+    int blockWidth = options.indexOrder == TerrainIndexOrder::Blocks
+        ? std::max(1, static_cast<int>(options.vertexCacheSize) / 2 - 1)
+        : static_cast<int>(columns) - 1;
+
+    for (int blockStart = 0; blockStart < static_cast<int>(columns) - 1; blockStart += blockWidth)
+    {
+        int blockEnd = std::min(blockStart + blockWidth, static_cast<int>(columns) - 1);
+
+        if (options.indexOrder == TerrainIndexOrder::Blocks)
+        {
+            // Sweep across the strip one row at a time.
+            for (int y = 0; y < static_cast<int>(rows) - 1; y++)
+            {
+                for (int x = blockStart; x < blockEnd; x++)
+                {
+                    addQuad(x, y);
+                }
+            }
+        }
+        else
+        {
+            for (int x = blockStart; x < blockEnd; x++)
+            {
+                for (int y = 0; y < static_cast<int>(rows) - 1; y++)
+                {
+                    addQuad(x, y);
+                }
+            }
+        }
+    }
+
+    cache[key] = indices;
+    return indices;
+}
+
+void addTerrainGridIndices(ofMesh& mesh, unsigned int columns, unsigned int rows, const TerrainMeshOptions& options)
+{
+    mesh.addIndices(*getTerrainGridIndices(columns, rows, options));
+}
 
-    for (int x = xStart; x <= xEnd - 1; x++)
+void buildTerrainGridPatch(ofMesh& gridMesh, unsigned int size, const TerrainMeshOptions& options)
+{
+    using namespace glm;
+
+    // Same vertex order as buildTerrainMesh() so that the same indices can be used.
+    for (unsigned int x = 0; x <= size; x++)
     {
-        for (int y = yStart; y <= yEnd - 1; y++)
+        for (unsigned int y = 0; y <= size; y++)
         {
-            thisX = x - xStart;
-            thisY = y - yStart;
-            nextX = thisX + 1;
-            nextY = thisY + 1;
+            gridMesh.addVertex(vec3(x, 0, y));
+        }
+    }
+
+    addTerrainGridIndices(gridMesh, size + 1, size + 1, options);
+}
 
-            // 0 is this XY
-            // 2 is next XY
-            // 
-            //    0 -- 3
-            //    |  / |
-            //    | /  |
-            //    1 -- 2
+void buildWaterMesh(ofMesh& waterMesh, const ofShortPixels& heightmap,
+    unsigned int xStart, unsigned int yStart, unsigned int xEnd, unsigned int yEnd, glm::vec3 scale,
+    float waterHeight, unsigned int blockSize)
+{
+    using namespace glm;
 
-            terrainMesh.addIndex(thisX * imageHeight + thisY); // 0 Top-left.
-            terrainMesh.addIndex(thisX * imageHeight + nextY); // 1 Bottom-left.
-            terrainMesh.addIndex(nextX * imageHeight + thisY); // 3 Top-right.
+    if (waterHeight <= 0)
+    {
+        return;
+    }
+
+    // Compare raw samples rather than scaling every one.
+    float threshold = waterHeight / scale.y * USHRT_MAX;
 
-            terrainMesh.addIndex(nextX * imageHeight + thisY); // 3 Top-right.
-            terrainMesh.addIndex(thisX * imageHeight + nextY); // 1 Bottom-left.
-            terrainMesh.addIndex(nextX * imageHeight + nextY); // 2 Bottom-right.
+    auto isBlockWet = [&] (unsigned int blockX, unsigned int blockY, unsigned int blockEndX, unsigned int blockEndY)
+    {
+        for (unsigned int y = blockY; y <= blockEndY; y++)
+        {
+            for (unsigned int x = blockX; x <= blockEndX; x++)
+            {
+                if (heightmap.getColor(x, y).r < threshold)
+                {
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    };
+
+    auto addQuad = [&] (unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1)
+    {
+        ofIndexType first = waterMesh.getNumVertices();
+
+        // The same corners and winding as the terrain's quads, so the surface faces up.
+        waterMesh.addVertex(vec3(x0 * scale.x, waterHeight, y0 * scale.z));
+        waterMesh.addVertex(vec3(x0 * scale.x, waterHeight, y1 * scale.z));
+        waterMesh.addVertex(vec3(x1 * scale.x, waterHeight, y0 * scale.z));
+        waterMesh.addVertex(vec3(x1 * scale.x, waterHeight, y1 * scale.z));
+
+        for (int i = 0; i < 4; i++)
+        {
+            waterMesh.addNormal(vec3(0, 1, 0));
+        }
+
+        ofIndexType indices[6] = { first, first + 1, first + 2, first + 2, first + 1, first + 3 };
+        waterMesh.addIndices(indices, 6);
+    };
+
+    for (unsigned int blockY = yStart; blockY < yEnd; blockY += blockSize)
+    {
+        unsigned int blockEndY = std::min(blockY + blockSize, yEnd);
+
+        // The start of the current run of wet blocks, if there is one.
+        bool inRun = false;
+        unsigned int runStart = xStart;
+
+        for (unsigned int blockX = xStart; blockX < xEnd; blockX += blockSize)
+        {
+            unsigned int blockEndX = std::min(blockX + blockSize, xEnd);
+            bool wet = isBlockWet(blockX, blockY, blockEndX, blockEndY);
+
+            if (wet && !inRun)
+            {
+                runStart = blockX;
+                inRun = true;
+            }
+            else if (!wet && inRun)
+            {
+                addQuad(runStart, blockY, blockX, blockEndY);
+                inRun = false;
+            }
+        }
+
+        if (inRun)
+        {
+            addQuad(runStart, blockY, xEnd, blockEndY);
         }
     }
+}
+
+float calculateACMR(const std::vector<ofIndexType>& indices, unsigned int cacheSize)
+{
+    if (indices.size() < 3)
+    {
+        return 0;
+    }
+
+    // With a FIFO cache, a vertex is still cached if fewer than cacheSize misses have happened since it was loaded.
+    std::vector<size_t> loadedAtMiss {};
+    std::vector<bool> everLoaded {};
+    size_t misses = 0;
 
-    terrainMesh.flatNormals();
-    
-    // Flip normals.
-    for (int n = 0; n < terrainMesh.getNumNormals(); n++)
+    for (ofIndexType index : indices)
     {
-        terrainMesh.setNormal(n, -terrainMesh.getNormal(n));
+        if (index >= everLoaded.size())
+        {
+            everLoaded.resize(index + 1, false);
+            loadedAtMiss.resize(index + 1, 0);
+        }
+
+        if (!everLoaded[index] || misses - loadedAtMiss[index] >= cacheSize)
+        {
+            everLoaded[index] = true;
+            loadedAtMiss[index] = misses;
+            misses++;
+        }
     }
+
+    return static_cast<float>(misses) / (indices.size() / 3);
 }
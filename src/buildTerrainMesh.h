@@ -1,5 +1,31 @@
 #pragma once
 #include "ofMain.h"
+#include <memory>
+
+// The order in which the triangles of a terrain grid are emitted.
+enum class TerrainIndexOrder
+{
+    // Column by column across the full height of the grid.
+    // Neighbouring columns are far apart in the index stream, so almost every vertex is shaded twice.
+    Columns,
+
+    // Strips of columns narrow enough that the previous row of vertices is still in the post-transform cache.
+    Blocks,
+};
+
+// Options controlling the layout of a terrain mesh.
+struct TerrainMeshOptions
+{
+    // If true, vertices are shared between triangles and normals come from the heightmap gradient.
+    // If false, every triangle gets its own three vertices and a flat normal.
+    bool smoothNormals { false };
+
+    // The order in which triangles are emitted.
+    TerrainIndexOrder indexOrder { TerrainIndexOrder::Columns };
+
+    // The post-transform cache size (in vertices) that TerrainIndexOrder::Blocks is tuned for, assuming a FIFO cache.
+    unsigned int vertexCacheSize { 16 };
+};
 
 // A function that should contain the logic of assembling the terrain mesh.
 // "terrainMesh" is a reference to the mesh that needs to be initialized.
@@ -9,5 +35,89 @@
 // If the indices of a pixel are (x, y) -- integers ranging from (xStart, yStart) to (xEnd, yEnd) --
 // and the value stored in the heightmap at that location is h -- an integer ranging from 0 to SHRT_MAX (2^16 - 1)
 // -- then the position of the vertex in object space should be (x, h / SHRT_MAX (using floating-point division), y) * scale.
+// "options" controls the normals and triangle order.
 void buildTerrainMesh(ofMesh& terrainMesh, const ofShortPixels& heightmap,
-    unsigned int xStart, unsigned int yStart, unsigned int xEnd, unsigned int yEnd, glm::vec3 scale);
+    unsigned int xStart, unsigned int yStart, unsigned int xEnd, unsigned int yEnd, glm::vec3 scale,
+    const TerrainMeshOptions& options = TerrainMeshOptions());
+
+// Calculates the smooth normal of the terrain at a pixel of the heightmap from the heights of its neighbours,
+// with the same scale as buildTerrainMesh().
+glm::vec3 calculateTerrainNormal(const ofShortPixels& heightmap, int x, int y, glm::vec3 scale);
+
+// Updates the heights and normals of a smooth-normal mesh built by buildTerrainMesh() after the heightmap has changed.
+// "xStart", "yStart", "xEnd", and "yEnd" must be the same as when the mesh was built;
+// only the pixels between "regionMin" and "regionMax" (inclusive, clamped to the mesh) are updated.
+// Returns the range of vertex indices that changed as [first, last), or an empty range if nothing overlapped.
+std::pair<size_t, size_t> updateTerrainMeshRegion(ofMesh& terrainMesh, const ofShortPixels& heightmap,
+    unsigned int xStart, unsigned int yStart, unsigned int xEnd, unsigned int yEnd, glm::vec3 scale,
+    glm::ivec2 regionMin, glm::ivec2 regionMax);
+
+// Gets the indices for a grid of vertices laid out the way buildTerrainMesh() lays them out:
+// column by column, with "rows" vertices in each of the "columns" columns.
+// Each ordering is computed once per grid size and shared from then on.
+std::shared_ptr<const std::vector<ofIndexType>> getTerrainGridIndices(unsigned int columns, unsigned int rows,
+    const TerrainMeshOptions& options = TerrainMeshOptions());
+
+// Adds the indices from getTerrainGridIndices() to a mesh.
+void addTerrainGridIndices(ofMesh& mesh, unsigned int columns, unsigned int rows,
+    const TerrainMeshOptions& options = TerrainMeshOptions());
+
+// Builds the mesh of a square terrain cell of QUADS x QUADS quads with smooth normals, the same as buildTerrainMesh() would
+// over the inside of a height tile: "tile" is (QUADS + 3) x (QUADS + 3) samples, row by row, with a one-sample border.
+// Vertex (x, y) of the cell sits at ((x + 1) * scale.x, height * scale.y, (y + 1) * scale.z) + offset.
+// With the size known at compile time, every loop bound and index is a constant, the neighbouring samples for the normals
+// never need clamping, and the vertex and normal arrays are sized once and filled in place.
+template<unsigned int QUADS>
+void buildTerrainCellMesh(ofMesh& terrainMesh, const unsigned short* tile, glm::vec3 scale, glm::vec3 offset,
+    const TerrainMeshOptions& options = TerrainMeshOptions())
+{
+    const unsigned int TILE_SIZE = QUADS + 3;
+    const unsigned int VERTICES_PER_SIDE = QUADS + 1;
+
+    std::vector<glm::vec3>& vertices = terrainMesh.getVertices();
+    std::vector<glm::vec3>& normals = terrainMesh.getNormals();
+    vertices.resize(VERTICES_PER_SIDE * VERTICES_PER_SIDE);
+    normals.resize(VERTICES_PER_SIDE * VERTICES_PER_SIDE);
+
+    // The same arithmetic as buildTerrainMesh() and calculateTerrainNormal(), so the results match exactly.
+    auto heightAt = [&] (unsigned int index)
+    {
+        return tile[index] / static_cast<float>(USHRT_MAX) * scale.y;
+    };
+
+    // Column by column, like buildTerrainMesh(), so that the same indices work.
+    for (unsigned int x = 0; x < VERTICES_PER_SIDE; x++)
+    {
+        for (unsigned int y = 0; y < VERTICES_PER_SIDE; y++)
+        {
+            unsigned int index = (y + 1) * TILE_SIZE + (x + 1);
+            glm::vec3& vertex = vertices[x * VERTICES_PER_SIDE + y];
+
+            vertex = glm::vec3((x + 1) * scale.x, scale.y * (tile[index] / static_cast<float>(USHRT_MAX)), (y + 1) * scale.z);
+            vertex += offset;
+
+            float slopeX = (heightAt(index + 1) - heightAt(index - 1)) / (2 * scale.x);
+            float slopeZ = (heightAt(index + TILE_SIZE) - heightAt(index - TILE_SIZE)) / (2 * scale.z);
+            normals[x * VERTICES_PER_SIDE + y] = glm::normalize(glm::vec3(-slopeX, 1, -slopeZ));
+        }
+    }
+
+    terrainMesh.clearIndices();
+    addTerrainGridIndices(terrainMesh, VERTICES_PER_SIDE, VERTICES_PER_SIDE, options);
+}
+
+// Builds a flat grid of (size + 1) x (size + 1) vertices spanning (0, 0, 0) to (size, 0, size),
+// to be displaced in the vertex shader by a height tile.
+void buildTerrainGridPatch(ofMesh& gridMesh, unsigned int size, const TerrainMeshOptions& options = TerrainMeshOptions());
+
+// Builds a flat water surface at "waterHeight" over the parts of a rectangle of the heightmap that are below it.
+// The rectangle is split into square blocks of "blockSize" quads, and only blocks whose lowest sample is below the water
+// get a surface, so dry land has none; neighbouring wet blocks in a row share one quad.
+// The rectangle and scale are the same as for buildTerrainMesh(), and "waterHeight" is in the same space as the scaled heights.
+void buildWaterMesh(ofMesh& waterMesh, const ofShortPixels& heightmap,
+    unsigned int xStart, unsigned int yStart, unsigned int xEnd, unsigned int yEnd, glm::vec3 scale,
+    float waterHeight, unsigned int blockSize);
+
+// Calculates the average cache miss ratio (vertices shaded per triangle) of a triangle list, simulating a FIFO
+// post-transform cache of the given size.  0.5 is the best possible for a large grid; 3 means no reuse at all.
+float calculateACMR(const std::vector<ofIndexType>& indices, unsigned int cacheSize);
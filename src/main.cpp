@@ -1,18 +1,136 @@
 #include "ofMain.h"
 #include "ofApp.h"
+#include "ofAppNoWindow.h"
+#include "TerrainQueryService.h"
+#include "TerrainQueryClient.h"
+#include "TerrainExport.h"
 
 //========================================================================
-int main()
+// Serves terrain queries on a local socket until the process is killed, without opening a window.
+static int runTerrainQueryService(const std::string& socketPath, unsigned int threadCount)
 {
-	ofGLWindowSettings glSettings;
-	glSettings.setSize(1024, 768);
-	glSettings.windowMode = OF_WINDOW;
-	glSettings.setGLVersion(4, 1);
-	ofCreateWindow(glSettings);
+	ofShortImage heightmap;
+	heightmap.setUseTexture(false);
+	if (!heightmap.load("TamrielHighRes.png"))
+		return 1;
+
+	// The same scale as the high res terrain in ofApp (one unit per pixel), but without moving it down below zero.
+	World world;
+	world.heightmap = &heightmap.getPixels();
+	world.dimensions = glm::vec3(heightmap.getWidth() - 1, 1600 * 32 / 50, heightmap.getHeight() - 1);
+	world.waterHeight = 32 * (32 - 18);
+
+	TerrainQueryService service(world);
+	if (!service.start(socketPath, threadCount))
+		return 1;
+
+	while (true)
+	{
+		std::this_thread::sleep_for(std::chrono::seconds(10));
+		ofLogNotice("main") << service.getQueriesAnswered() << " terrain queries answered.";
+	}
+}
+
+//========================================================================
+// Writes the full-resolution terrain out as tiled meshes, then exits.
+static int runTerrainExport(const std::string& directory, unsigned int tileSize, unsigned int threadCount)
+{
+	ofShortImage heightmap;
+	heightmap.setUseTexture(false);
+	if (!heightmap.load("TamrielHighRes.png"))
+		return 1;
+
+	// The same scale as the World in runTerrainQueryService(), so the tiles line up with query results.
+	TerrainExportSettings settings;
+	settings.directory = ofToDataPath(directory);
+	settings.tileSize = tileSize;
+	settings.scale = glm::vec3(1, 1600 * 32 / 50, 1);
+	settings.threadCount = threadCount;
+
+	TerrainExportStats stats;
+	return exportTerrainTiles(heightmap.getPixels(), settings, stats) ? 0 : 1;
+}
+
+//========================================================================
+int main(int argc, char* argv[])
+{
+	// Command line options for automated performance runs:
+	//   --replay <file>   replay a camera path recorded with the 'p' key (relative to the data folder)
+	//   --sprint-route    replay the generated sprint stress route
+	//   --headless        run without a window; only streaming and culling are measured
+	//   --stats <name>    write the stats to <name>.csv and <name>.json in the data folder
+	// Terrain query service (see TerrainQueryService):
+	//   --serve <socket>       answer terrain queries on a Unix domain socket instead of running the app
+	//   --query-load <socket>  run the load generator against a service, then exit
+	//   --threads <n>          worker threads for --serve, or connections for --query-load
+	//   --batch <n>            queries per request for --query-load
+	// Terrain export (see TerrainExport):
+	//   --export <folder>      write the full-resolution terrain as .glb tiles (relative to the data folder), then exit
+	//   --tile-size <n>        quads along each side of an exported tile (default 256); --threads limits the threads used
+	ReplaySettings replaySettings;
+	std::string serveSocket;
+	std::string loadTestSocket;
+	unsigned int threadCount = 0;
+	std::string exportDirectory;
+	unsigned int exportTileSize = 256;
+	TerrainQueryLoadSettings loadSettings;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string argument = argv[i];
+
+		if (argument == "--replay" && i + 1 < argc)
+			replaySettings.cameraPathFile = argv[++i];
+		else if (argument == "--sprint-route")
+			replaySettings.sprintRoute = true;
+		else if (argument == "--headless")
+			replaySettings.headless = true;
+		else if (argument == "--stats" && i + 1 < argc)
+			replaySettings.statsPath = argv[++i];
+		else if (argument == "--serve" && i + 1 < argc)
+			serveSocket = argv[++i];
+		else if (argument == "--query-load" && i + 1 < argc)
+			loadTestSocket = argv[++i];
+		else if (argument == "--threads" && i + 1 < argc)
+			threadCount = ofToInt(argv[++i]);
+		else if (argument == "--batch" && i + 1 < argc)
+			loadSettings.batchSize = ofToInt(argv[++i]);
+		else if (argument == "--export" && i + 1 < argc)
+			exportDirectory = argv[++i];
+		else if (argument == "--tile-size" && i + 1 < argc)
+			exportTileSize = ofToInt(argv[++i]);
+		else
+			ofLogWarning("main") << "Unknown argument " << argument;
+	}
+
+	if (!serveSocket.empty())
+		return runTerrainQueryService(serveSocket, threadCount);
+
+	if (!exportDirectory.empty())
+		return runTerrainExport(exportDirectory, exportTileSize, threadCount);
+
+	if (!loadTestSocket.empty())
+	{
+		if (threadCount > 0)
+			loadSettings.connections = threadCount;
+		return runTerrainQueryLoadTest(loadTestSocket, loadSettings) ? 0 : 1;
+	}
+
+	if (replaySettings.headless)
+	{
+		ofSetupOpenGL(std::make_shared<ofAppNoWindow>(), 1024, 768, OF_WINDOW);
+	}
+	else
+	{
+		ofGLWindowSettings glSettings;
+		glSettings.setSize(1024, 768);
+		glSettings.windowMode = OF_WINDOW;
+		glSettings.setGLVersion(4, 1);
+		ofCreateWindow(glSettings);
+	}
 
 	// this kicks off the running of my app
 	// can be OF_WINDOW or OF_FULLSCREEN
 	// pass in width and height too:
-	ofRunApp(new ofApp());
+	ofRunApp(new ofApp(replaySettings));
 
 }
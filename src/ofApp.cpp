@@ -1,42 +1,207 @@
 #include "ofApp.h"
+#include "Benchmarks.h"
 #include <vector>
 #include <random>
 
+//--------------------------------------------------------------
+ofApp::ofApp(const ReplaySettings& replaySettings)
+	: replaySettings(replaySettings)
+{
+}
+
 //--------------------------------------------------------------
 void ofApp::setup()
 {
-	ofDisableArbTex();
+	Profiler::setThreadName("Main");
 
-	ofEnableDepthTest();
-	glEnable(GL_CULL_FACE);
+	// Headless replays have no GL context, so skip everything that touches the GPU.
+	const bool headless = replaySettings.headless;
 
-	ofSetBackgroundColor(135, 205, 235, 255);
+	if (!headless)
+	{
+		ofDisableArbTex();
+
+		ofEnableDepthTest();
+		glEnable(GL_CULL_FACE);
 
-	// Low resolution terrain setup.
-	heightmapLowRes.setUseTexture(false);
-	heightmapLowRes.load("TamrielLowRes.png");
-	assert(heightmapLowRes.getWidth() != 0 && heightmapLowRes.getHeight() != 0);
+		ofSetBackgroundColor(135, 205, 235, 255);
+	}
 
 	// High resolution terrain setup.
 	heightmapHighRes.setUseTexture(false);
 	heightmapHighRes.load("TamrielHighRes.png");
 	assert(heightmapHighRes.getWidth() != 0 && heightmapHighRes.getHeight() != 0);
 
+	// Low resolution terrain setup; downsampled from the high res heightmap and cached after the first run.
+	heightmapPyramid.buildWithCache(heightmapHighRes.getPixels(), ofToDataPath("TamrielHighRes.pyramid"));
+	const ofShortPixels& heightmapLowRes = heightmapPyramid.getLevel(heightmapPyramid.getLevelForSpacing(resolutionRatio));
+
 	// Build terrain mesh and VBO.
 	buildTerrainMesh(terrainMesh, heightmapLowRes, 0, 0, heightmapLowRes.getWidth() - 1, heightmapLowRes.getHeight() - 1, glm::vec3(1, heightScale, 1));
-	terrainVBO.setMesh(terrainMesh, GL_STATIC_DRAW);
+	if (!headless)
+		terrainVBO.setMesh(terrainMesh, GL_STATIC_DRAW);
+	lowResTerrainBytes = getMeshBytes(terrainMesh);
+	if (!headless && discardMeshesAfterUpload)
+		terrainMesh = ofMesh();
+
+	// The simulation sees the high res terrain the same way the terrain query service does.
+	world.heightmap = &heightmapHighRes.getPixels();
+	world.heightmapMutex = &heightmapMutex;
+	world.dimensions = glm::vec3(heightmapHighRes.getWidth() - 1, 1600 * heightScale / 50, heightmapHighRes.getHeight() - 1);
+	world.waterHeight = heightScale * (32 - 18);
+	world.gravity = -98;
+
+	// Water over the parts of the low res terrain below the water height, in the low res mesh's space.
+	buildWaterMesh(waterMesh, heightmapLowRes, 0, 0, heightmapLowRes.getWidth() - 1, heightmapLowRes.getHeight() - 1,
+		glm::vec3(1, heightScale, 1), world.waterHeight / resolutionRatio, 4);
+	if (!headless)
+		waterVBO.setMesh(waterMesh, GL_STATIC_DRAW);
 
 	// Setup cell manager.
 	cameraPosition = glm::vec3(heightmapHighRes.getWidth() / 2, 0, heightmapHighRes.getHeight() / 2);
+	TerrainMeshOptions cellMeshOptions {};
+	cellMeshOptions.smoothNormals = true;
+	cellMeshOptions.indexOrder = TerrainIndexOrder::Blocks;
+	cellManager.setMeshOptions(cellMeshOptions);
+	cellManager.setBakeOcclusion(true);
+	cellManager.setDiscardAfterUpload(discardMeshesAfterUpload);
+	cellManager.setMemoryBudget(cellMemoryBudget);
+	// The cell meshes are 1600 units high where the world is 1600 * heightScale / 50.
+	cellManager.setWaterHeight(world.waterHeight * 50 / heightScale);
+	cellManager.setPropTypes(makePropTypes());
+	memoryTracker.setBudget("Terrain cells", cellMemoryBudget);
 	cellManager.initializeForPosition(cameraPosition);
+	simulation.start(cameraPosition - worldOrigin);
+
+	if (!headless)
+		reloadShaders();
+
+	// Start a replay if one was asked for on the command line.
+	if (replaySettings.sprintRoute)
+	{
+		exitAfterReplay = true;
+		startReplay(makeSprintRoute());
+	}
+	else if (!replaySettings.cameraPathFile.empty())
+	{
+		CameraPath path;
+		exitAfterReplay = true;
+		if (path.load(ofToDataPath(replaySettings.cameraPathFile)))
+			startReplay(path);
+		else
+			ofExit(1);
+	}
+}
+
+//--------------------------------------------------------------
+std::vector<PropType> ofApp::makePropTypes() const
+{
+	// Heights and sizes are in the cell meshes' space, where the water is at 700 and the land rises to 1600.
+	// Trees on the gentler slopes between the shore and the peaks.
+	PropType trees;
+	trees.shape = PropShape::Tree;
+	trees.color = glm::vec3(30, 70, 25) / 256.0f;
+	trees.spacing = 6;
+	trees.density = 0.6f;
+	trees.maxSlope = 1.5f;
+	trees.minHeightAboveWater = 10;
+	trees.maxHeightAboveWater = 500;
+	trees.minScale = 8;
+	trees.maxScale = 16;
+	trees.fullDensityDistance = 192;
+	trees.drawDistance = 384;
+
+	// Rocks anywhere above the water, steep or not.
+	PropType rocks;
+	rocks.shape = PropShape::Rock;
+	rocks.color = glm::vec3(110, 105, 100) / 256.0f;
+	rocks.spacing = 16;
+	rocks.density = 0.4f;
+	rocks.maxSlope = 4;
+	rocks.minScale = 1.5f;
+	rocks.maxScale = 4;
+	rocks.fullDensityDistance = 128;
+	rocks.drawDistance = 256;
+
+	// Dense grass on flat ground, only drawn close by.
+	PropType grass;
+	grass.shape = PropShape::Tuft;
+	grass.color = glm::vec3(110, 150, 40) / 256.0f;
+	grass.spacing = 3;
+	grass.density = 0.7f;
+	grass.maxSlope = 1;
+	grass.minHeightAboveWater = 5;
+	grass.maxHeightAboveWater = 300;
+	grass.minScale = 1;
+	grass.maxScale = 2;
+	grass.fullDensityDistance = 48;
+	grass.drawDistance = 128;
+
+	return { trees, rocks, grass };
+}
+
+//--------------------------------------------------------------
+CameraPath ofApp::makeSprintRoute() const
+{
+	// The same speed as holding a sprint key; laps wide enough to keep leaving the loaded cells behind.
+	const float sprintSpeed = 20 * 32 * 5;
+	glm::vec3 center = glm::vec3(heightmapHighRes.getWidth() / 2, 0, heightmapHighRes.getHeight() / 2);
+	return CameraPath::makeSprintRoute(center, 4096, sprintSpeed, 2);
+}
+
+//--------------------------------------------------------------
+void ofApp::startReplay(const CameraPath& path)
+{
+	if (path.isEmpty())
+	{
+		ofLogWarning("ofApp") << "Nothing to replay.";
+		return;
+	}
+
+	recordingCamera = false;
+	cameraReplay = path;
+	replayingCamera = true;
+	replayTime = 0;
+	replayFrame = 0;
+	replayStats.clear();
+	ofLogNotice("ofApp") << "Replaying " << path.getDuration() << " s camera path.";
+}
+
+//--------------------------------------------------------------
+void ofApp::recordReplayFrame()
+{
+	FrameStats stats;
+	stats.frame = replayFrame++;
+	stats.time = replayTime;
+	stats.frameMilliseconds = ofGetLastFrameTime() * 1000;
+	stats.cpuMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - replayFrameStart).count();
+	stats.cameraPosition = cameraPosition;
+	stats.culling = mainViewCulling;
+	stats.streaming = cellManager.getStreamingStats();
+	replayStats.add(stats);
+
+	if (replayTime >= cameraReplay.getDuration())
+	{
+		finishReplay();
+	}
+}
+
+//--------------------------------------------------------------
+void ofApp::finishReplay()
+{
+	replayingCamera = false;
+
+	// Carry on from wherever the replay left the camera.
+	teleportSimulation(cameraPosition);
 
-	// Setup water mesh.
-	ofMesh waterMesh;
-	//buildMesh(waterMesh, cameraPosition, 1600.0, 1600.0);
-	buildCube(waterVBO);
-	waterVBO.setMesh(waterMesh, GL_STATIC_DRAW);
+	replayStats.writeCSV(ofToDataPath(replaySettings.statsPath + ".csv"));
+	replayStats.writeJSON(ofToDataPath(replaySettings.statsPath + ".json"));
+	replayStats.logSummary();
 
-	reloadShaders();
+	if (exitAfterReplay)
+	{
+		ofExit();
+	}
 }
 
 //--------------------------------------------------------------
@@ -54,24 +219,156 @@ void ofApp::reloadShaders()
 //--------------------------------------------------------------
 void ofApp::update()
 {
-	reloadShaders();
+	PROFILE_ZONE("ofApp::update");
+	frameStart = std::chrono::steady_clock::now();
+
+	if (!replaySettings.headless)
+		reloadShaders();
+
+	// Replays follow their path on a fixed timestep; recordings sample the camera every frame.
+	if (replayingCamera)
+	{
+		replayFrameStart = std::chrono::steady_clock::now();
+		replayTime += replayTimestep;
+		CameraKeyframe keyframe = cameraReplay.sample(replayTime);
+		cameraPosition = keyframe.position;
+		cameraFront = keyframe.front;
+	}
+	else
+	{
+		updateSimulationInput();
+		cameraPosition = simulation.getInterpolatedState().cameraPosition + worldOrigin;
+
+		if (recordingCamera)
+			cameraRecording.addKeyframe(ofGetElapsedTimef() - recordingStartTime, cameraPosition, cameraFront);
+	}
 
 	cellManager.optimizeForPosition(cameraPosition);
+	if (spectatorObserver >= 0)
+		cellManager.setObserverPosition(spectatorObserver, spectatorPosition);
+
+	// Uploads and memory budget steps happen once per frame, however many views are drawn.
+	if (!replaySettings.headless)
+		cellManager.update();
+
+	updateMemoryTracker();
+
+	// Rebuild only the parts of the terrain that were edited this frame.
+	for (const HeightmapRegion& region : heightmapEditor.takeDirtyRegions())
+	{
+		cellManager.refreshRegion(region);
+	}
+}
+
+//--------------------------------------------------------------
+void ofApp::updateSimulationInput()
+{
+	// Sample the held keys rather than moving on key repeats, so that movement doesn't depend on the repeat rate.
+	auto isHeld = [] (int key) { return ofGetKeyPressed(key) || ofGetKeyPressed(toupper(key)); };
+	auto axis = [&] (int positiveKey, int negativeKey) { return (isHeld(positiveKey) ? 1.0f : 0.0f) - (isHeld(negativeKey) ? 1.0f : 0.0f); };
+
+	simulationInput.movement = glm::vec3(axis('d', 'a'), axis('q', 'e'), axis('w', 's'));
+	simulationInput.sprint = ofGetKeyPressed(OF_KEY_SHIFT);
+	simulationInput.front = cameraFront;
+	simulation.setInput(simulationInput);
+}
+
+//--------------------------------------------------------------
+void ofApp::teleportSimulation(glm::vec3 position)
+{
+	simulationInput.teleportCount++;
+	simulationInput.teleportPosition = position - worldOrigin;
+	simulation.setInput(simulationInput);
 }
 
 //--------------------------------------------------------------
 void ofApp::draw()
+{
+	PROFILE_ZONE("ofApp::draw");
+
+	float aspectRatio = static_cast<float>(ofGetViewportWidth()) / static_cast<float>(ofGetViewportHeight());
+	drawScene(cameraPosition, cameraFront, aspectRatio);
+	mainViewCulling = cellManager.getCullingStats();
+
+	if (replaySettings.headless)
+	{
+		if (replayingCamera)
+			recordReplayFrame();
+		return;
+	}
+
+	// Draw the spectator's view into the bottom right corner, over the main view.
+	if (spectatorObserver >= 0)
+	{
+		const int width = ofGetViewportWidth() / 3;
+		const int height = ofGetViewportHeight() / 3;
+		const int x = ofGetViewportWidth() - width;
+
+		glEnable(GL_SCISSOR_TEST);
+		glScissor(x, 0, width, height);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		glDisable(GL_SCISSOR_TEST);
+
+		glViewport(x, 0, width, height);
+		drawScene(spectatorPosition, spectatorFront, static_cast<float>(width) / static_cast<float>(height));
+		glViewport(0, 0, ofGetViewportWidth(), ofGetViewportHeight());
+	}
+
+	if (showProfiler)
+		drawProfilerSummary();
+
+	if (showMemory)
+	{
+		ofDisableDepthTest();
+		ofDrawBitmapStringHighlight(memoryTracker.getReport(), 10, ofGetViewportHeight() - 120);
+		ofEnableDepthTest();
+	}
+
+	if (replayingCamera)
+		recordReplayFrame();
+	else
+		updateQuality();
+}
+
+//--------------------------------------------------------------
+void ofApp::updateQuality()
+{
+	if (!adaptiveQuality)
+		return;
+
+	// The CPU time from the start of update() to here, which doesn't include waiting for vsync.
+	double cpuMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+
+	if (qualityController.update(cpuMilliseconds, cellManager.getStreamingStats().pendingLoads))
+		applyQualitySettings(qualityController.getSettings());
+
+	const QualityCounters& counters = qualityController.getCounters();
+	PROFILE_COUNTER("Quality steps down", counters.stepsDown);
+	PROFILE_COUNTER("Quality steps up", counters.stepsUp);
+	PROFILE_COUNTER("Quality held for backlog", counters.heldForBacklog);
+	PROFILE_COUNTER("High res draw distance", highResDrawDistance);
+}
+
+//--------------------------------------------------------------
+void ofApp::applyQualitySettings(const QualitySettings& settings)
+{
+	highResDrawDistance = settings.highResDrawDistance;
+	// The cell manager won't go finer than its memory budget allows, whatever the controller asks for.
+	cellManager.setMeshLevelOfDetail(settings.meshLevelOfDetail);
+	cellManager.setActiveCellPairs(settings.activeCellPairs);
+}
+
+//--------------------------------------------------------------
+void ofApp::drawScene(glm::vec3 eyePosition, glm::vec3 eyeFront, float aspectRatio)
 {
 	// Camera settings.
 	const float nearClip = 15;
 	const float farClip = 200 * 10 * 32;
-	const float farClipHighRes = farClip * 0.0075;
+	const float farClipHighRes = highResDrawDistance;
 
 	const float startFade = farClip * 0.7;
 	const float endFade = farClip * 0.9;
 
-	float aspectRatio = static_cast<float>(ofGetViewportWidth()) / static_cast<float>(ofGetViewportHeight());
-
 	// Movel-view-projection.
 	glm::mat4 modelLowRes = (
 		glm::translate(glm::vec3(0, -heightScale * 32, 0))
@@ -81,16 +378,21 @@ void ofApp::draw()
 		glm::translate(glm::vec3(0, -heightScale * 32, 0))
 		* glm::scale(glm::vec3(1, heightScale / 50, 1))
 		);
-	
-	glm::mat4 modelWater = (
-		glm::translate(glm::vec3(1600 * 30, -heightScale * 18, 1600 * 30))
-		* glm::scale(glm::vec3(1600 * 32, 1, 1600 * 32))
-		);
 
-	glm::mat4 view = glm::lookAt(cameraPosition, cameraPosition + cameraFront, cameraUp);
+	glm::mat4 view = glm::lookAt(eyePosition, eyePosition + eyeFront, cameraUp);
 	glm::mat4 projection = glm::perspective(glm::radians(90.0f), aspectRatio, nearClip, farClip);
 	glm::mat4 projectionHighRes = glm::perspective(glm::radians(90.0f), aspectRatio, nearClip, farClipHighRes);
 
+	// The cell manager culls in the space of the cell meshes, before the model transform.
+	glm::vec3 cameraPositionHighRes = glm::inverse(modelHighRes) * glm::vec4(eyePosition, 1);
+
+	if (replaySettings.headless)
+	{
+		// Nothing to draw to; just do the culling so that it's measured.
+		cellManager.updateVisibleCells(cameraPositionHighRes, farClipHighRes);
+		return;
+	}
+
 	// Shader drawing.
 	shader.begin();
 
@@ -98,42 +400,84 @@ void ofApp::draw()
 	shader.setUniform3f("lightColor", glm::vec3(1, 1, 0.9));
 	shader.setUniform3f("ambientColor", glm::vec3(0.1));
 
-	shader.setUniform3f("cameraPosition", cameraPosition);
+	shader.setUniform3f("cameraPosition", eyePosition);
 	shader.setUniform1f("startFade", startFade);
 	shader.setUniform1f("endFade", endFade);
 
-	// Draw water.
-	shader.setUniform1i("isWater", 1);
-	shader.setUniformMatrix4f("m", modelWater);
-	shader.setUniformMatrix4f("mvp", projection * view * modelWater);
-	waterVBO.drawElements(GL_TRIANGLES, waterVBO.getNumIndices());
-	shader.setUniform1i("isWater", 0);
-
 	// Draw low res terrain.
 	shader.setUniformMatrix4f("m", modelLowRes);
 	shader.setUniformMatrix4f("mvp", projection * view * modelLowRes);
 	terrainVBO.drawElements(GL_TRIANGLES, terrainVBO.getNumIndices());
 
-	glClear(GL_DEPTH_BUFFER_BIT);
-
-	// Draw water.
+	// Draw water after the terrain so that water under the land fails the depth test instead of being shaded.
 	shader.setUniform1i("isWater", 1);
-	shader.setUniformMatrix4f("m", modelWater);
-	shader.setUniformMatrix4f("mvp", projectionHighRes * view * modelWater);
 	waterVBO.drawElements(GL_TRIANGLES, waterVBO.getNumIndices());
 	shader.setUniform1i("isWater", 0);
 
-	// Draw high res terrain.
+	glClear(GL_DEPTH_BUFFER_BIT);
+
+	// Draw high res terrain; cells that are entirely underwater only draw their water.
 	shader.setUniformMatrix4f("m", modelHighRes);
 	shader.setUniformMatrix4f("mvp", projectionHighRes * view * modelHighRes);
-	cellManager.drawActiveCells(cameraPosition, farClipHighRes);
+	cellManager.drawActiveCells(cameraPositionHighRes, farClipHighRes, shader);
+
+	// Props stand above the water, so they go before it like the terrain.
+	cellManager.drawProps(cameraPositionHighRes, shader);
+
+	shader.setUniform1i("isWater", 1);
+	cellManager.drawWater();
+	shader.setUniform1i("isWater", 0);
 
 	shader.end();
 }
 
+//--------------------------------------------------------------
+void ofApp::updateMemoryTracker()
+{
+	memoryTracker.setUsage("High res heightmap", { heightmapHighRes.getPixels().getTotalBytes(), 0 });
+	memoryTracker.setUsage("Heightmap pyramid", { heightmapPyramid.getMemoryBytes(), 0 });
+	// The low res VBO holds the same data as the mesh, which may have been discarded.
+	memoryTracker.setUsage("Low res terrain", { getMeshBytes(terrainMesh), replaySettings.headless ? 0 : lowResTerrainBytes });
+	memoryTracker.setUsage("Low res water", { getMeshBytes(waterMesh), replaySettings.headless ? 0 : getMeshBytes(waterMesh) });
+	memoryTracker.setUsage("Terrain cells", cellManager.getMemoryUsage());
+}
+
+//--------------------------------------------------------------
+void ofApp::drawProfilerSummary()
+{
+	std::vector<Profiler::ZoneSummary> zones;
+	std::vector<Profiler::CounterSummary> counters;
+	Profiler::summarize(1.0, zones, counters);
+
+	// Per-second totals, so that zones called every frame read as time per second of frames.
+	std::stringstream text;
+	text << "Profiler (last second)  total ms / calls / max ms\n";
+	for (const Profiler::ZoneSummary& zone : zones)
+		text << zone.name << "  " << ofToString(zone.totalMilliseconds, 2) << " / " << zone.calls << " / " << ofToString(zone.maxMilliseconds, 2) << "\n";
+	for (const Profiler::CounterSummary& counter : counters)
+		text << counter.name << " = " << counter.value << "\n";
+
+	// The simulation's own cost, separate from the frame time.
+	SimulationStats simulationStats = simulation.getStats();
+	text << "Simulation  " << ofToString(1 / simulation.getTimestep(), 0) << " ticks/s, " << ofToString(simulationStats.averageTickMilliseconds, 3)
+		<< " ms/tick, " << simulationStats.droppedTicks << " dropped\n";
+
+	const QualitySettings& quality = qualityController.getSettings();
+	const QualityCounters& qualityCounters = qualityController.getCounters();
+	text << "Quality " << (adaptiveQuality ? "" : "(fixed) ") << "target " << ofToString(qualityController.getTargetFrameMilliseconds(), 1)
+		<< " ms, average " << ofToString(qualityCounters.averageFrameMilliseconds, 2) << " ms: draw distance " << quality.highResDrawDistance
+		<< ", detail " << quality.meshLevelOfDetail << ", cell pairs " << quality.activeCellPairs << "; " << qualityCounters.stepsDown << " down, "
+		<< qualityCounters.stepsUp << " up, " << qualityCounters.heldForBacklog << " held for backlog, " << qualityCounters.oscillations << " oscillations\n";
+
+	ofDisableDepthTest();
+	ofDrawBitmapStringHighlight(text.str(), 10, 20);
+	ofEnableDepthTest();
+}
+
 //--------------------------------------------------------------
 void ofApp::exit()
 {
+	simulation.stop();
 	cellManager.stop();
 }
 
@@ -145,39 +489,105 @@ void ofApp::keyPressed(int key)
 		needsShaderReload = true;
 	}
 
-	const float cameraSpeed = 20 * 32;
-	const float sprint = 5;
-	const float dt = ofGetLastFrameTime();
-
-	// Forward / backward.
-	if (key == 'w')
-		cameraPosition += cameraFront * cameraSpeed * dt;
-	else if (key == 'W')
-		cameraPosition += cameraFront * cameraSpeed * sprint * dt;
-	if (key == 's')
-		cameraPosition -= cameraFront * cameraSpeed * dt;
-	else if (key == 'S')
-		cameraPosition -= cameraFront * cameraSpeed * sprint * dt;
-
-	// Left / right.
-	if (key == 'a')
-		cameraPosition -= glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed * dt;
-	else if (key == 'A')
-		cameraPosition -= glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed * sprint * dt;
-	if (key == 'd')
-		cameraPosition += glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed * dt;
-	else if (key == 'D')
-		cameraPosition += glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed * sprint * dt;
-
-	// Up / down.
-	if (key == 'q')
-		cameraPosition += cameraUp * cameraSpeed * dt;
-	else if (key == 'Q')
-		cameraPosition += cameraUp * cameraSpeed * sprint * dt;
-	if (key == 'e')
-		cameraPosition -= cameraUp * cameraSpeed * dt;
-	else if (key == 'E')
-		cameraPosition -= cameraUp * cameraSpeed * sprint * dt;
+	if (key == 'b')
+	{
+		runTerrainMeshBenchmark(heightmapHighRes.getPixels(), 256);
+		runNoiseBenchmark(noiseHeightSource, 256);
+		runTaskSchedulerBenchmark(heightmapHighRes.getPixels(), 256);
+		runSimulationBenchmark(world);
+		runOcclusionBenchmark(heightSourceHighRes, 256, 1600);
+		runCellSizeSpecializationBenchmark(heightmapHighRes.getPixels());
+		runCrowdBenchmark(world, 256);
+		runPathfinderBenchmark(world, 256);
+	}
+
+	if (key == 'm')
+	{
+		showMemory = !showMemory;
+		ofLogNotice("ofApp") << memoryTracker.getReport();
+	}
+
+	// Profiling.
+	if (key == 'z')
+	{
+		showProfiler = !showProfiler;
+		Profiler::setEnabled(showProfiler);
+	}
+	if (key == 't')
+	{
+		Profiler::writeChromeTrace(ofToDataPath("trace.json"));
+		ofLogNotice("ofApp") << "Wrote trace.json; open it in chrome://tracing or ui.perfetto.dev.";
+	}
+
+	// Spectator camera; it stays where the camera was, keeping that terrain loaded as the camera moves away.
+	if (key == 'v')
+	{
+		if (spectatorObserver >= 0)
+		{
+			cellManager.removeObserver(spectatorObserver);
+			spectatorObserver = -1;
+		}
+		else
+		{
+			spectatorPosition = cameraPosition;
+			spectatorFront = cameraFront;
+			spectatorObserver = cellManager.addObserver(spectatorPosition);
+		}
+	}
+
+	// Adaptive quality.
+	if (key == 'o')
+	{
+		adaptiveQuality = !adaptiveQuality;
+		ofLogNotice("ofApp") << (adaptiveQuality ? "Adaptive quality on." : "Adaptive quality off; keeping the current settings.");
+	}
+
+	// Camera recording and replay.
+	if (key == 'p')
+	{
+		if (recordingCamera)
+		{
+			recordingCamera = false;
+			cameraRecording.save(ofToDataPath("camera_path.txt"));
+			ofLogNotice("ofApp") << "Saved " << cameraRecording.getDuration() << " s camera path.";
+		}
+		else if (!replayingCamera)
+		{
+			cameraRecording.clear();
+			recordingStartTime = ofGetElapsedTimef();
+			recordingCamera = true;
+		}
+	}
+	if (key == 'l' && !replayingCamera)
+	{
+		CameraPath path;
+		if (path.load(ofToDataPath("camera_path.txt")))
+			startReplay(path);
+	}
+	if (key == 'k' && !replayingCamera)
+		startReplay(makeSprintRoute());
+
+	// The replay is in control of the camera.
+	if (replayingCamera)
+		return;
+
+	// Terrain editing under the camera (the high res terrain is one unit per pixel in x and z).
+	const glm::vec2 editCenter = glm::vec2(cameraPosition.x, cameraPosition.z);
+	if (key == 'c')
+		heightmapEditor.applyCrater(editCenter, 24, 0.02f);
+	if (key == 'r')
+		heightmapEditor.applyBrush(editCenter, 32, 0.005f);
+	else if (key == 'f')
+		heightmapEditor.applyBrush(editCenter, 32, -0.005f);
+
+	// Movement keys are sampled every frame in updateSimulationInput().
+	if (key == ' ')
+		simulationInput.jumpCount++;
+	if (key == 'g')
+	{
+		simulationInput.walking = !simulationInput.walking;
+		ofLogNotice("ofApp") << (simulationInput.walking ? "Walking on the terrain." : "Flying.");
+	}
 }
 
 //--------------------------------------------------------------
@@ -194,6 +604,10 @@ void ofApp::mouseMoved(int x, int y)
 	lastMouseX = x;
 	lastMouseY = y;
 
+	// The replay is in control of the camera.
+	if (replayingCamera)
+		return;
+
 	// Apply sensitivity to mouse movement.
 	const float sensitivity = 0.5f;
 	dx *= sensitivity;
@@ -2,12 +2,39 @@
 
 #include "ofMain.h"
 #include "CellManager.h"
+#include "NoiseHeightSource.h"
+#include "HeightmapPyramid.h"
+#include "CameraPath.h"
+#include "FrameStatsLog.h"
+#include "Profiler.h"
+#include "MemoryTracker.h"
+#include "SimulationThread.h"
+#include "QualityController.h"
 #include <vector>
+#include <chrono>
+
+// Settings for an automated camera replay, usually from the command line (see main.cpp).
+struct ReplaySettings
+{
+	// A camera path file to replay at startup; empty for none.
+	std::string cameraPathFile {};
+
+	// Replay the generated sprint stress route at startup instead of a file.
+	bool sprintRoute { false };
+
+	// Run without a window or GL context; only streaming and culling are measured.
+	bool headless { false };
+
+	// Where to write the stats, without an extension; ".csv" and ".json" files are written.
+	std::string statsPath { "replay_stats" };
+};
 
 class ofApp : public ofBaseApp
 {
 
 public:
+	ofApp(const ReplaySettings& replaySettings = ReplaySettings());
+
 	void setup();
 	void update();
 	void draw();
@@ -26,11 +53,27 @@ public:
 	void gotMessage(ofMessage msg);
 
 private:
-	ofShortImage heightmapLowRes;
 	ofShortImage heightmapHighRes;
-	CellManager<4> cellManager{heightmapHighRes, 1600, 256};
+	// Every coarser level of the high res heightmap; the low res terrain uses the level matching resolutionRatio.
+	HeightmapPyramid heightmapPyramid;
+	// Held exclusively while the high res heightmap is edited, and shared by the cell loaders and the simulation while they read it.
+	std::shared_timed_mutex heightmapMutex;
+	HeightmapHeightSource heightSourceHighRes{heightmapHighRes.getPixels(), &heightmapMutex};
+	// Endless procedural terrain; pass this to the cell manager instead to fly past the edge of the map.
+	NoiseHeightSource noiseHeightSource{1234, glm::ivec2(8192)};
+	// Switch to CellRenderMode::HeightTexture to displace a shared grid patch in the vertex shader instead of building meshes.
+	// Two observers share the cells: the camera and an optional spectator.
+	// The cell size is fixed at compile time so that cell building is specialized for it.
+	CellManager<4, 2, 256> cellManager{heightSourceHighRes, 1600, 256, CellRenderMode::Mesh};
+	// Trees, rocks and grass scattered over the cells as they load.
+	std::vector<PropType> makePropTypes() const;
 	ofShader shader;
 
+	// Runtime terrain deformation; edits go straight into the high res heightmap.
+	HeightmapEditor heightmapEditor{heightmapHighRes.getPixels(), &heightmapMutex};
+
+	// Water for the low res terrain; the cell manager makes its own for the cells.
+	ofMesh waterMesh;
 	ofVbo waterVBO;
 
 	const float heightScale = 32;
@@ -44,15 +87,76 @@ private:
 	glm::vec3 cameraFront = glm::vec3(0, 0, -1);
 	glm::vec3 cameraUp = glm::vec3(0, 1, 0);
 
+	// The camera moves on the simulation thread at a fixed tick rate; the held keys and mouse direction are passed to it
+	// every frame, and cameraPosition is the simulated position interpolated to the present.
+	// The simulation works in the World's space, where the high res terrain starts at a height of 0 rather than worldOrigin.y.
+	World world;
+	const glm::vec3 worldOrigin = glm::vec3(0, -heightScale * 32, 0);
+	SimulationThread simulation{world};
+	SimulationInput simulationInput;
+	void updateSimulationInput();
+	void teleportSimulation(glm::vec3 position);
+
 	// Camera rotation (direction).
 	glm::vec3 cameraDirection = glm::vec3(0, 0, 0);
 	float cameraPitch = 0; // In radians.
 	float cameraHead = 0; // In radians.
 
+	// A second, fixed camera drawn in the corner of the window, with its own terrain kept loaded; toggled with 'v'.
+	int spectatorObserver = -1;
+	glm::vec3 spectatorPosition;
+	glm::vec3 spectatorFront;
+	// The main view's culling, since the spectator view is drawn after it.
+	CellCullingStats mainViewCulling;
+	void drawScene(glm::vec3 eyePosition, glm::vec3 eyeFront, float aspectRatio);
+
 	// Mouse controls.
 	int lastMouseX = ofGetViewportWidth() / 2;
 	int lastMouseY = ofGetViewportHeight() / 2;
 
+	// Camera flythrough recording and replay.
+	ReplaySettings replaySettings;
+	CameraPath cameraRecording;
+	bool recordingCamera = false;
+	double recordingStartTime = 0;
+	CameraPath cameraReplay;
+	bool replayingCamera = false;
+	// Replays always advance by this much per frame, whatever the real frame time, so every run sees the same frames.
+	const double replayTimestep = 1.0 / 60.0;
+	double replayTime = 0;
+	unsigned int replayFrame = 0;
+	std::chrono::steady_clock::time_point replayFrameStart;
+	FrameStatsLog replayStats;
+	// Set for replays started from the command line, which close the app when they finish.
+	bool exitAfterReplay = false;
+	CameraPath makeSprintRoute() const;
+	void startReplay(const CameraPath& path);
+	void finishReplay();
+	void recordReplayFrame();
+
+	// Adaptive quality: the high res draw distance, cell detail and loaded area follow the CPU frame time; toggled with 'o'.
+	// It's left alone during replays so that every run of a path is measured at the same quality.
+	QualityController qualityController;
+	bool adaptiveQuality = true;
+	float highResDrawDistance = qualityController.getSettings().highResDrawDistance;
+	std::chrono::steady_clock::time_point frameStart;
+	void updateQuality();
+	void applyQualitySettings(const QualitySettings& settings);
+
+	// Profiling; the summary is drawn over the scene while profiling is on.
+	bool showProfiler = false;
+	void drawProfilerSummary();
+
+	// Memory accounting; the report is drawn over the scene when enabled.
+	MemoryTracker memoryTracker;
+	bool showMemory = false;
+	// Limits for the terrain cells (0 for no limit); over budget, the cells drop CPU copies and then detail.
+	const MemoryUsage cellMemoryBudget = { 0, 0 };
+	// Throw away CPU copies of meshes once they're on the GPU.
+	const bool discardMeshesAfterUpload = false;
+	void updateMemoryTracker();
+	size_t lowResTerrainBytes = 0;
+
 	// Helper functions.
 	void buildCube(ofVbo& cubeVBO);
 	void buildCircle(ofVbo& circleVBO, int sides);